@@ -5,9 +5,15 @@
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 //
 
+#include <nudb/test/item_generator.hpp>
+#include <nudb/test/key_distribution.hpp>
 #include <nudb/test/test_store.hpp>
+#include <nudb/mem_file.hpp>
+#include <nudb/progress.hpp>
 #include <nudb/util.hpp>
-#include <beast/unit_test/dstream.hpp>
+#include <nudb/verify.hpp>
+#include "bench_util.hpp"
+#include "json_writer.hpp"
 
 #if WITH_ROCKSDB
 #include "rocksdb/db.h"
@@ -19,23 +25,33 @@ char const* rocksdb_build_compile_date="Benchmark Dummy Compile Date";
 #include <boost/program_options.hpp>
 #include <boost/system/system_error.hpp>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <ctime>
+#include <fstream>
 #include <iomanip>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <random>
 #include <set>
+#include <sstream>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace nudb {
 namespace test {
 
-beast::unit_test::dstream dout{std::cout};
-beast::unit_test::dstream derr{std::cerr};
-
 struct Timer
 {
     using clock = std::chrono::steady_clock;
@@ -78,27 +94,144 @@ public:
     }
 };
 
+// If latency is not null, the latency of each call to f is added
 template <class Generator, class F>
 std::chrono::duration<double>
-time_block(std::uint64_t n, Generator&& g, F&& f, BenchProgress& progress)
+time_block(std::uint64_t n, Generator&& g, F&& f, BenchProgress& progress,
+    latency_samples* latency = nullptr)
 {
+    using clock = std::chrono::steady_clock;
     Timer timer;
     for (std::uint64_t i = 0; i < n; ++i)
     {
-        f(g());
+        if (latency)
+        {
+            auto const item = g();
+            auto const t0 = clock::now();
+            f(item);
+            latency->add(clock::now() - t0);
+        }
+        else
+        {
+            f(g());
+        }
         if (!(i % 1000))
             progress.update(i);
     }
     return timer.elapsed();
 }
 
+// I/O done by this process, from /proc/self/io
+struct io_counters
+{
+    bool valid = false;             // `true` if the counters are available
+    std::uint64_t reads = 0;        // read system calls
+    std::uint64_t writes = 0;       // write system calls
+    std::uint64_t rchar = 0;        // bytes read by system calls
+    std::uint64_t wchar = 0;        // bytes written by system calls
+    std::uint64_t read_bytes = 0;   // bytes read from storage
+    std::uint64_t write_bytes = 0;  // bytes written to storage
+
+    static
+    io_counters
+    now()
+    {
+        io_counters result;
+        std::ifstream is{"/proc/self/io"};
+        std::string name;
+        std::uint64_t value;
+        while (is >> name >> value)
+        {
+            result.valid = true;
+            if (name == "syscr:")
+                result.reads = value;
+            else if (name == "syscw:")
+                result.writes = value;
+            else if (name == "rchar:")
+                result.rchar = value;
+            else if (name == "wchar:")
+                result.wchar = value;
+            else if (name == "read_bytes:")
+                result.read_bytes = value;
+            else if (name == "write_bytes:")
+                result.write_bytes = value;
+        }
+        return result;
+    }
+
+    // Returns the I/O done since an earlier sample
+    io_counters
+    since(io_counters const& start) const
+    {
+        io_counters result;
+        result.valid = valid && start.valid;
+        result.reads = reads - start.reads;
+        result.writes = writes - start.writes;
+        result.rchar = rchar - start.rchar;
+        result.wchar = wchar - start.wchar;
+        result.read_bytes = read_bytes - start.read_bytes;
+        result.write_bytes = write_bytes - start.write_bytes;
+        return result;
+    }
+};
+
+// Returns `true` if files can be evicted from the page cache
+bool
+can_evict()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Write a file's dirty pages and remove
+// all of its pages from the page cache
+void
+evict(path_type const& path, error_code& ec)
+{
+#ifdef __linux__
+    auto const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        ec = error_code{errno, system_category()};
+        return;
+    }
+    if (::fsync(fd) != 0)
+        ec = error_code{errno, system_category()};
+    else if (auto const ev = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+        ec = error_code{ev, system_category()};
+    ::close(fd);
+#else
+    (void)path;
+    ec = make_error_code(errc::not_supported);
+#endif
+}
+
+// Commit inserted values, then evict the store's
+// files so that fetches are served by the device.
+template<class File>
+void
+make_cold(basic_test_store<File>& ts, error_code& ec)
+{
+    ts.db.commit(ec);
+    if (ec)
+        return;
+    evict(ts.dp, ec);
+    if (ec)
+        return;
+    evict(ts.kp, ec);
+}
+
+template<class Store>
 class gen_key_value
 {
-    test_store& ts_;
+    Store& ts_;
     std::uint64_t cur_;
 
 public:
-    gen_key_value(test_store& ts,
+    gen_key_value(Store& ts,
         std::uint64_t cur)
         : ts_(ts),
         cur_(cur)
@@ -111,17 +244,21 @@ public:
     }
 };
 
+template<class Store>
 class rand_existing_key
 {
     xor_shift_engine rng_;
-    std::uniform_int_distribution<std::uint64_t> dist_;
-    test_store& ts_;
+    key_distribution const& keys_;
+    std::uint64_t num_keys_;
+    Store& ts_;
 
 public:
-    rand_existing_key(test_store& ts,
+    rand_existing_key(Store& ts,
         std::uint64_t max_index,
+        key_distribution const& keys,
         std::uint64_t seed = 1337)
-        : dist_(0, max_index),
+        : keys_(keys),
+          num_keys_(max_index + 1),
           ts_(ts)
     {
         rng_.seed(seed);
@@ -129,18 +266,76 @@ public:
     item_type
     operator()()
     {
-        return ts_[dist_(rng_)];
+        return ts_[keys_(rng_, num_keys_)];
     }
 };
 
+//------------------------------------------------------------------------------
+
+// Timing of one kind of operation
+struct op_stats
+{
+    std::uint64_t count = 0;
+    std::chrono::duration<double> elapsed{0};
+    latency_samples latency;            // sorted, if recorded
+    io_counters io;
+
+    // Operations per second
+    double
+    rate() const
+    {
+        return elapsed.count() > 0 ? count / elapsed.count() : 0;
+    }
+
+    void
+    merge(latency_samples const& v)
+    {
+        count += v.size();
+        latency.merge(v);
+    }
+};
+
+// Time n calls to f, optionally recording each latency
+template <class Generator, class F>
+op_stats
+time_op(std::uint64_t n, Generator&& g, F&& f, BenchProgress& progress,
+    bool latencies)
+{
+    op_stats result;
+    if (latencies)
+        result.latency.reserve(n);
+    auto const io = io_counters::now();
+    result.elapsed = time_block(n, std::forward<Generator>(g),
+        std::forward<F>(f), progress, latencies ? &result.latency : nullptr);
+    result.io = io_counters::now().since(io);
+    result.count = n;
+    result.latency.sort();
+    return result;
+}
+
+struct mixed_options
+{
+    std::size_t readers = 0;
+    std::size_t writers = 0;
+    std::uint64_t ops = 1000000;
+    double read_ratio = 0.9;
+    double miss_ratio = 0;
+    std::string values = "uniform:250:750";
+    bool cold = false;
+};
+
+//------------------------------------------------------------------------------
+
 #if WITH_ROCKSDB
-std::map<std::string, std::chrono::duration<double>>
+std::map<std::string, op_stats>
 do_timings_rocks(std::uint64_t num_inserts,
     std::uint64_t num_fetches,
     std::uint32_t key_size,
+    key_distribution const& keys,
+    bool latencies,
     BenchProgress& progress)
 {
-    std::map<std::string, std::chrono::duration<double>> result;
+    std::map<std::string, op_stats> result;
     temp_dir td;
 
     std::unique_ptr<rocksdb::DB> pdb = [&td]
@@ -178,32 +373,42 @@ do_timings_rocks(std::uint64_t num_inserts,
     };
 
     test_store ts{key_size, 0, 0};
-    result["insert"] = time_block(
-        num_inserts, gen_key_value{ts, 0}, inserter, progress);
+    result["insert"] = time_op(
+        num_inserts, gen_key_value<test_store>{ts, 0}, inserter, progress,
+        latencies);
     progress.incBatchStart(num_inserts);
-    result["fetch"] = time_block(
-        num_fetches, rand_existing_key{ts, num_inserts - 1}, fetcher, progress);
+    result["fetch"] = time_op(
+        num_fetches, rand_existing_key<test_store>{ts, num_inserts - 1, keys},
+        fetcher,
+        progress, latencies);
     progress.incBatchStart(num_fetches);
 
     return result;
 }
 #endif
 
-std::map<std::string, std::chrono::duration<double>>
+// If info is not null, the database is verified afterwards
+template<class File>
+std::map<std::string, op_stats>
 do_timings(std::uint64_t num_inserts,
     std::uint64_t num_fetches,
     std::uint32_t key_size,
     std::size_t block_size,
     float load_factor,
+    key_distribution const& keys,
+    bool cold,
+    bool latencies,
+    verify_info* info,
     BenchProgress& progress)
 {
-    std::map<std::string, std::chrono::duration<double>> result;
+    std::map<std::string, op_stats> result;
 
     boost::system::error_code ec;
 
     try
     {
-        test_store ts{key_size, block_size, load_factor};
+        using store_type = basic_test_store<File>;
+        store_type ts{key_size, block_size, load_factor};
         ts.create(ec);
         if (ec)
             goto fail;
@@ -223,12 +428,196 @@ do_timings(std::uint64_t num_inserts,
                 throw boost::system::system_error(ec);
         };
 
-        result["insert"] = time_block(
-            num_inserts, gen_key_value{ts, 0}, inserter, progress);
+        result["insert"] = time_op(
+            num_inserts, gen_key_value<store_type>{ts, 0}, inserter, progress,
+            latencies);
         progress.incBatchStart(num_inserts);
-        result["fetch"] = time_block(
-            num_fetches, rand_existing_key{ts, num_inserts - 1}, fetcher, progress);
+        if (cold)
+        {
+            make_cold(ts, ec);
+            if (ec)
+                goto fail;
+        }
+        result["fetch"] = time_op(
+            num_fetches,
+            rand_existing_key<store_type>{ts, num_inserts - 1, keys},
+            fetcher, progress, latencies || cold);
         progress.incBatchStart(num_fetches);
+        if (info)
+        {
+            ts.close(ec);
+            if (ec)
+                goto fail;
+            verify<xxhasher, File>(
+                *info, ts.dp, ts.kp, 0, no_progress{}, ec);
+            if (ec)
+                goto fail;
+        }
+    }
+    catch (boost::system::system_error const& e)
+    {
+        ec = e.code();
+    }
+    catch (std::exception const& e)
+    {
+        derr << "Error: " << e.what() << '\n';
+    }
+
+fail:
+    if (ec)
+        derr << "Error: " << ec.message() << '\n';
+
+    return result;
+}
+
+// Fetch from readers while writers insert, starting with
+// num_keys values. Each writer w inserts the items with
+// indexes num_keys + k * writers + w in order of k, so that
+// readers can pick from a range of keys known to exist.
+std::map<std::string, op_stats>
+do_mixed(std::uint64_t num_keys,
+    mixed_options const& opt,
+    std::uint32_t key_size,
+    std::size_t block_size,
+    float load_factor,
+    key_distribution const& keys)
+{
+    std::map<std::string, op_stats> result;
+    using clock = std::chrono::steady_clock;
+    item_generator const items{key_size, value_sizes{opt.values}};
+    auto const num_reads = opt.readers > 0 ? static_cast<std::uint64_t>(
+        opt.ops * (opt.writers > 0 ? opt.read_ratio : 1)) : 0;
+    auto const num_writes = opt.writers > 0 ? opt.ops - num_reads : 0;
+
+    boost::system::error_code ec;
+    std::mutex m;
+    std::atomic<bool> stop{false};
+    auto const set_error = [&](error_code const& ev)
+    {
+        std::lock_guard<std::mutex> lock{m};
+        if (!ec)
+            ec = ev;
+        stop = true;
+    };
+
+    try
+    {
+        test_store ts{key_size, block_size, load_factor};
+        ts.create(ec);
+        if (ec)
+            goto fail;
+        ts.open(ec);
+        if (ec)
+            goto fail;
+        {
+            Buffer buf;
+            for (std::uint64_t i = 0; i < num_keys; ++i)
+            {
+                auto const item = items(i, buf);
+                ts.db.insert(item.key, item.data, item.size, ec);
+                if (ec)
+                    goto fail;
+            }
+        }
+        if (opt.cold)
+        {
+            make_cold(ts, ec);
+            if (ec)
+                goto fail;
+        }
+
+        // Number of items inserted by each writer
+        std::unique_ptr<std::atomic<std::uint64_t>[]> progress{
+            new std::atomic<std::uint64_t>[opt.writers]};
+        for (std::size_t w = 0; w < opt.writers; ++w)
+            progress[w] = 0;
+        // All indexes below this are in the database
+        auto const existing = [&]
+        {
+            std::uint64_t k = std::numeric_limits<std::uint64_t>::max();
+            for (std::size_t w = 0; w < opt.writers; ++w)
+                k = std::min<std::uint64_t>(k, progress[w]);
+            return num_keys + (opt.writers > 0 ? k * opt.writers : 0);
+        };
+
+        std::vector<latency_samples> fetch_latency(opt.readers);
+        std::vector<latency_samples> insert_latency(opt.writers);
+        std::vector<std::thread> threads;
+        auto const start = clock::now();
+        for (std::size_t r = 0; r < opt.readers; ++r)
+            threads.emplace_back([&, r]
+            {
+                auto& latency = fetch_latency[r];
+                auto const n = num_reads / opt.readers +
+                    (r < num_reads % opt.readers ? 1 : 0);
+                latency.reserve(n);
+                xor_shift_engine g{r + 1};
+                std::uniform_real_distribution<double> coin{0, 1};
+                Buffer buf;
+                error_code ev;
+                for (std::uint64_t i = 0; i < n && !stop; ++i)
+                {
+                    auto const limit = existing();
+                    auto const miss =
+                        limit == 0 || coin(g) < opt.miss_ratio;
+                    auto const index = miss ?
+                        item_generator::missing + g() % item_generator::missing :
+                        keys(g, limit);
+                    auto const key = items.key(index, buf);
+                    auto const t0 = clock::now();
+                    ts.db.fetch(key, [](void const*, std::size_t) {}, ev);
+                    latency.add(clock::now() - t0);
+                    if (miss && ev == error::key_not_found)
+                        ev = {};
+                    if (ev)
+                        return set_error(ev);
+                }
+            });
+        std::vector<clock::time_point> writers_done(opt.writers);
+        auto const io = io_counters::now();
+        for (std::size_t w = 0; w < opt.writers; ++w)
+            threads.emplace_back([&, w]
+            {
+                auto& latency = insert_latency[w];
+                auto const n = num_writes / opt.writers +
+                    (w < num_writes % opt.writers ? 1 : 0);
+                latency.reserve(n);
+                Buffer buf;
+                error_code ev;
+                for (std::uint64_t k = 0; k < n && !stop; ++k)
+                {
+                    auto const item = items(
+                        num_keys + k * opt.writers + w, buf);
+                    auto const t0 = clock::now();
+                    ts.db.insert(item.key, item.data, item.size, ev);
+                    latency.add(clock::now() - t0);
+                    if (ev)
+                        return set_error(ev);
+                    ++progress[w];
+                }
+                writers_done[w] = clock::now();
+            });
+        for (auto& t : threads)
+            t.join();
+        auto const finish = clock::now();
+        if (ec)
+            goto fail;
+        // The I/O is for the whole phase
+        result["fetch"].io = io_counters::now().since(io);
+        result["insert"].io = result["fetch"].io;
+
+        auto& fetches = result["fetch"];
+        for (auto const& v : fetch_latency)
+            fetches.merge(v);
+        fetches.elapsed = finish - start;
+        auto& inserts = result["insert"];
+        for (auto const& v : insert_latency)
+            inserts.merge(v);
+        if (!writers_done.empty())
+            inserts.elapsed = *std::max_element(
+                writers_done.begin(), writers_done.end()) - start;
+        for (auto& e : result)
+            e.second.latency.sort();
     }
     catch (boost::system::system_error const& e)
     {
@@ -246,16 +635,63 @@ fail:
     return result;
 }
 
-namespace po = boost::program_options;
+void
+write_json(json_writer& w, op_stats const& s)
+{
+    w.begin_object();
+    w.field("ops", s.count);
+    w.field("seconds", s.elapsed.count());
+    w.field("per_second", s.rate());
+    if (!s.latency.empty())
+    {
+        w.field("p50_us", s.latency.percentile(0.5));
+        w.field("p99_us", s.latency.percentile(0.99));
+        w.field("p999_us", s.latency.percentile(0.999));
+    }
+    if (s.io.valid)
+    {
+        w.field("read_calls", s.io.reads);
+        w.field("write_calls", s.io.writes);
+        w.field("bytes_read", s.io.rchar);
+        w.field("bytes_written", s.io.wchar);
+        w.field("storage_bytes_read", s.io.read_bytes);
+        w.field("storage_bytes_written", s.io.write_bytes);
+    }
+    w.end_object();
+}
 
 void
-print_help(std::string const& prog_name, const po::options_description& desc)
+write_json(json_writer& w, verify_info const& info)
 {
-    derr << prog_name << ' ' << desc;
+    w.begin_object();
+    w.field("key_size", info.key_size);
+    w.field("block_size", info.block_size);
+    w.field("load_factor", double(info.load_factor));
+    w.field("capacity", info.capacity);
+    w.field("buckets", info.buckets);
+    w.field("key_file_size", info.key_file_size);
+    w.field("dat_file_size", info.dat_file_size);
+    w.field("key_count", info.key_count);
+    w.field("value_count", info.value_count);
+    w.field("value_bytes", info.value_bytes);
+    w.field("spill_count", info.spill_count);
+    w.field("spill_count_tot", info.spill_count_tot);
+    w.field("spill_bytes", info.spill_bytes);
+    w.field("spill_bytes_tot", info.spill_bytes_tot);
+    w.field("avg_fetch", double(info.avg_fetch));
+    w.field("waste", double(info.waste));
+    w.field("overhead", double(info.overhead));
+    w.field("actual_load", double(info.actual_load));
+    w.key("hist");
+    w.begin_array();
+    for (auto n : info.hist)
+        w.value(n);
+    w.end_array();
+    w.end_object();
 }
 
-po::variables_map
-parse_args(int argc, char** argv, po::options_description& desc)
+void
+add_options(po::options_description& desc)
 {
 
 #if WITH_ROCKSDB
@@ -275,27 +711,37 @@ parse_args(int argc, char** argv, po::options_description& desc)
           "Number of fetches Default: 1000000)")
         ("dbs",
          po::value<std::vector<std::string>>()->multitoken(),
-          "databases (Default: nudb rocksdb)")
+          "databases: nudb, nudb_mem (nudb on files held in memory), "
+          "or rocksdb (Default: nudb rocksdb)")
         ("block_size", po::value<size_t>(),
          "nudb block size (default: 4096)")
         ("key_size", po::value<size_t>(),
          "key size (default: 64)")
         ("load_factor", po::value<float>(),
          "nudb load factor (default: 0.5)")
+        ("keys", po::value<std::string>(),
+         "fetched keys: uniform, zipf:THETA, scrambled_zipf:THETA, "
+         "hotspot:KEYS:OPS, or latest:THETA (default: uniform)")
+        ("cold", "evict the database from the page cache before fetching")
+        ("json", po::value<std::string>(),
+         "also write the results as JSON to this file")
+        ("revision", po::value<std::string>(),
+         "source revision recorded in the JSON results "
+         "(default: the revision the program was built from)")
+        ("readers", po::value<size_t>(),
+         "mixed workload reader threads (default: 0)")
+        ("writers", po::value<size_t>(),
+         "mixed workload writer threads (default: 0)")
+        ("mixed_ops", po::value<std::uint64_t>(),
+         "mixed workload operations (default: 1000000)")
+        ("read_ratio", po::value<double>(),
+         "mixed workload fraction of fetches (default: 0.9)")
+        ("miss_ratio", po::value<double>(),
+         "mixed workload fraction of fetches for absent keys (default: 0)")
+        ("values", po::value<std::string>(),
+         "mixed workload value sizes: fixed:N, uniform:MIN:MAX, or "
+         "lognormal:MEDIAN:SIGMA (default: uniform:250:750)")
             ;
-
-        po::variables_map vm;
-        po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
-        po::notify(vm);
-
-        return vm;
-}
-
-template<class T>
-T
-get_opt(po::variables_map const& vm, std::string const& key, T const& default_value)
-{
-    return vm.count(key) ? vm[key].as<T>() : default_value;
 }
 
 } // test
@@ -310,24 +756,9 @@ main(int argc, char** argv)
 
     {
         po::options_description desc{"Benchmark Options"};
-        bool parse_error = false;
-        try
-        {
-            vm = parse_args(argc, argv, desc);
-        }
-        catch (std::exception const& e)
-        {
-            derr << "Incorrect command line syntax.\n";
-            derr << "Exception: " << e.what() << '\n';
-            parse_error = true;
-        }
-
-        if (vm.count("help") || parse_error)
-        {
-            auto prog_name = boost::filesystem::path(argv[0]).stem().string();
-            print_help(prog_name, desc);
+        add_options(desc);
+        if (!parse_options(argc, argv, desc, vm))
             return 0;
-        }
     }
 
     auto const block_size = get_opt<size_t>(vm, "block_size", 4096);
@@ -336,6 +767,34 @@ main(int argc, char** argv)
     auto const inserts =
             get_opt<std::vector<std::uint64_t>>(vm, "inserts", {100000, 1000000});
     auto const fetches = get_opt<std::uint64_t>(vm, "fetches", 1000000);
+    mixed_options mixed;
+    mixed.readers = get_opt<size_t>(vm, "readers", mixed.readers);
+    mixed.writers = get_opt<size_t>(vm, "writers", mixed.writers);
+    mixed.ops = get_opt<std::uint64_t>(vm, "mixed_ops", mixed.ops);
+    mixed.read_ratio = get_opt<double>(vm, "read_ratio", mixed.read_ratio);
+    mixed.miss_ratio = get_opt<double>(vm, "miss_ratio", mixed.miss_ratio);
+    mixed.values = get_opt<std::string>(vm, "values", mixed.values);
+    bool const with_mixed = mixed.readers > 0 || mixed.writers > 0;
+    bool const cold = vm.count("cold") != 0;
+    mixed.cold = cold;
+    if (cold && !can_evict())
+    {
+        derr << "Cold cache mode is not supported on this platform\n";
+        exit(1);
+    }
+    std::unique_ptr<key_distribution> pkeys;
+    try
+    {
+        value_sizes{mixed.values};
+        pkeys.reset(new key_distribution{
+            get_opt<std::string>(vm, "keys", "uniform")});
+    }
+    catch (std::exception const& e)
+    {
+        derr << e.what() << '\n';
+        exit(1);
+    }
+    auto const& keys = *pkeys;
 #if WITH_ROCKSDB
     std::vector<std::string> const default_dbs({"nudb", "rocksdb"});
 #else
@@ -357,7 +816,7 @@ main(int argc, char** argv)
             continue;
         }
 
-        if (db != "nudb" && db != "rocksdb")
+        if (db != "nudb" && db != "nudb_mem" && db != "rocksdb")
         {
             derr << "Unsupported database: " << db << '\n';
             exit(1);
@@ -367,11 +826,18 @@ main(int argc, char** argv)
     bool const with_rocksdb = dbs.count("rocksdb") != 0;
     (void) with_rocksdb;
     bool const with_nudb = dbs.count("nudb") != 0;
+    bool const with_nudb_mem = dbs.count("nudb_mem") != 0;
+
+    auto const json_path = get_opt<std::string>(vm, "json", "");
+    bool const with_json = !json_path.empty();
 
     std::map<std::pair<std::string,std::uint64_t>,
-             std::map<std::string, std::chrono::duration<double>>> timings;
+             std::map<std::string, op_stats>> timings;
+    std::map<std::uint64_t, std::map<std::string, op_stats>> mixed_timings;
+    std::map<std::uint64_t, nudb::verify_info> infos;
 
-    std::uint64_t const numDB = int(with_nudb) + int(with_rocksdb);
+    std::uint64_t const numDB =
+        int(with_nudb) + int(with_nudb_mem) + int(with_rocksdb);
     std::uint64_t const totalOps =
         (std::accumulate(inserts.begin(), inserts.end(), 0ull) +
             inserts.size() * fetches) *
@@ -382,12 +848,23 @@ main(int argc, char** argv)
         derr << "# Running inserts: " << n << '\n';
         if (with_nudb)
             timings[{"nudb",n}]=
-                do_timings(n, fetches, key_size, block_size, load_factor, progress);
+                do_timings<nudb::native_file>(n, fetches, key_size, block_size,
+                    load_factor, keys, cold, with_json,
+                    with_json ? &infos[n] : nullptr, progress);
+        // The files are never on a device, so --cold does not apply
+        if (with_nudb_mem)
+            timings[{"nudb_mem",n}]=
+                do_timings<nudb::mem_file>(n, fetches, key_size, block_size,
+                    load_factor, keys, false, with_json, nullptr, progress);
 
 #if WITH_ROCKSDB
         if (with_rocksdb)
-            timings[{"rocksdb",n}] = do_timings_rocks(n, fetches, key_size, progress);
+            timings[{"rocksdb",n}] = do_timings_rocks(n, fetches, key_size, keys,
+                with_json, progress);
 #endif
+        if (with_nudb && with_mixed)
+            mixed_timings[n] =
+                do_mixed(n, mixed, key_size, block_size, load_factor, keys);
     }
 
 
@@ -398,7 +875,10 @@ main(int argc, char** argv)
 
     for(auto const& t : tests)
     {
-        dout << '\n' << t << " (per second)\n";
+        dout << '\n' << t << " (per second";
+        if (!strcmp(t, "fetch") && keys.str() != "uniform")
+            dout << ", keys " << keys.str();
+        dout << ")\n";
         if (!strcmp(t, "fetch"))
         {
             dout << std::setw(iter_w) << "# db keys";
@@ -409,6 +889,8 @@ main(int argc, char** argv)
         }
         if (with_nudb)
             dout << std::setw(col_w) << "nudb";
+        if (with_nudb_mem)
+            dout << std::setw(col_w) << "nudb_mem";
 #if WITH_ROCKSDB
         if (with_rocksdb)
             dout << std::setw(col_w) << "rocksdb";
@@ -421,14 +903,145 @@ main(int argc, char** argv)
             if (with_nudb)
                 dout << std::setw(col_w) << std::fixed
                     << std::setprecision(2)
-                    << num_ops/timings[{"nudb", n}][t].count();
+                    << num_ops/timings[{"nudb", n}][t].elapsed.count();
+            if (with_nudb_mem)
+                dout << std::setw(col_w) << std::fixed
+                    << std::setprecision(2)
+                    << num_ops/timings[{"nudb_mem", n}][t].elapsed.count();
 #if WITH_ROCKSDB
             if (with_rocksdb)
                 dout << std::setw(col_w) << std::fixed
                     << std::setprecision(2)
-                    << num_ops/timings[{"rocksdb", n}][t].count();
+                    << num_ops/timings[{"rocksdb", n}][t].elapsed.count();
 #endif
             dout << '\n';
         }
     }
+    if (cold && with_nudb)
+    {
+        dout << "\ncold fetch (nudb)\n";
+        dout << std::setw(iter_w) << "# db keys"
+            << std::setw(col_w) << "per second"
+            << std::setw(col_w) << "p50 (us)"
+            << std::setw(col_w) << "p99 (us)"
+            << std::setw(col_w) << "p999 (us)"
+            << std::setw(col_w) << "reads/fetch"
+            << std::setw(col_w) << "KiB/fetch" << '\n';
+        for (auto n : inserts)
+        {
+            auto const& f = timings[{"nudb", n}]["fetch"];
+            auto const count = std::max<std::uint64_t>(f.count, 1);
+            dout << std::setw(iter_w) << n
+                << std::fixed << std::setprecision(2)
+                << std::setw(col_w) << f.rate()
+                << std::setw(col_w) << f.latency.percentile(0.5)
+                << std::setw(col_w) << f.latency.percentile(0.99)
+                << std::setw(col_w) << f.latency.percentile(0.999)
+                << std::setw(col_w) << double(f.io.reads) / count
+                << std::setw(col_w)
+                << f.io.read_bytes / 1024.0 / count << '\n';
+        }
+    }
+
+    if (with_mixed)
+    {
+        for (auto const& t : tests)
+        {
+            dout << "\nmixed " << t << " (nudb, " << mixed.readers
+                << " readers, " << mixed.writers << " writers, read ratio "
+                << mixed.read_ratio << ", miss ratio " << mixed.miss_ratio
+                << ", values " << value_sizes{mixed.values}.str()
+                << ", keys " << keys.str() << (cold ? ", cold" : "")
+                << ")\n";
+            dout << std::setw(iter_w) << "# db keys"
+                << std::setw(col_w) << "per second"
+                << std::setw(col_w) << "p50 (us)"
+                << std::setw(col_w) << "p99 (us)"
+                << std::setw(col_w) << "p999 (us)" << '\n';
+            for (auto n : inserts)
+            {
+                auto const& op = mixed_timings[n][t];
+                dout << std::setw(iter_w) << n
+                    << std::fixed << std::setprecision(2)
+                    << std::setw(col_w) << op.rate()
+                    << std::setw(col_w) << op.latency.percentile(0.5)
+                    << std::setw(col_w) << op.latency.percentile(0.99)
+                    << std::setw(col_w) << op.latency.percentile(0.999) << '\n';
+            }
+        }
+    }
+
+    if (!with_json)
+        return 0;
+    std::ofstream os{json_path};
+    json_writer w{os};
+    w.begin_object();
+    w.field("program", "bench");
+    w.field("revision", get_opt<std::string>(
+        vm, "revision", NUDB_GIT_REVISION));
+    w.field("time", static_cast<std::uint64_t>(std::time(nullptr)));
+    w.key("config");
+    w.begin_object();
+    w.key("dbs");
+    w.begin_array();
+    for (auto const& db : dbs)
+        w.value(db);
+    w.end_array();
+    w.key("inserts");
+    w.begin_array();
+    for (auto n : inserts)
+        w.value(n);
+    w.end_array();
+    w.field("fetches", fetches);
+    w.field("key_size", key_size);
+    w.field("block_size", block_size);
+    w.field("load_factor", double(load_factor));
+    w.field("keys", keys.str());
+    w.field("cold", cold);
+    w.field("readers", mixed.readers);
+    w.field("writers", mixed.writers);
+    w.field("mixed_ops", mixed.ops);
+    w.field("read_ratio", mixed.read_ratio);
+    w.field("miss_ratio", mixed.miss_ratio);
+    w.field("values", value_sizes{mixed.values}.str());
+    w.end_object();
+    w.key("results");
+    w.begin_array();
+    for (auto const& e : timings)
+    {
+        w.begin_object();
+        w.field("db", e.first.first);
+        w.field("keys", e.first.second);
+        w.key("phases");
+        w.begin_object();
+        for (auto const& op : e.second)
+        {
+            w.key(op.first);
+            write_json(w, op.second);
+        }
+        if (e.first.first == "nudb" && mixed_timings.count(e.first.second))
+        {
+            for (auto const& op : mixed_timings[e.first.second])
+            {
+                if (op.second.count == 0)
+                    continue;
+                w.key("mixed_" + op.first);
+                write_json(w, op.second);
+            }
+        }
+        w.end_object();
+        if (e.first.first == "nudb" && infos.count(e.first.second))
+        {
+            w.key("verify");
+            write_json(w, infos[e.first.second]);
+        }
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    if (!os)
+    {
+        derr << "Error: could not write " << json_path << '\n';
+        return 1;
+    }
 }
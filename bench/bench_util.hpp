@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_BENCH_BENCH_UTIL_HPP
+#define NUDB_BENCH_BENCH_UTIL_HPP
+
+// Pieces shared by the benchmark programs. Each program
+// is a single translation unit which includes this once.
+
+#include <beast/unit_test/dstream.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef NUDB_GIT_REVISION
+#define NUDB_GIT_REVISION "unknown"
+#endif
+
+namespace nudb {
+namespace test {
+
+beast::unit_test::dstream dout{std::cout};
+beast::unit_test::dstream derr{std::cerr};
+
+namespace po = boost::program_options;
+
+template<class T>
+T
+get_opt(po::variables_map const& vm, std::string const& key, T const& default_value)
+{
+    return vm.count(key) ? vm[key].as<T>() : default_value;
+}
+
+// Print the program name and its options
+inline
+void
+print_help(char const* argv0, po::options_description const& desc)
+{
+    derr << boost::filesystem::path(argv0).stem().string() << ' ' << desc;
+}
+
+// Parse the command line into vm. Returns false, after
+// printing the options, when the command line is not
+// valid or help was requested.
+inline
+bool
+parse_options(int argc, char** argv,
+    po::options_description const& desc, po::variables_map& vm)
+{
+    try
+    {
+        po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+        po::notify(vm);
+    }
+    catch (std::exception const& e)
+    {
+        derr << "Incorrect command line syntax.\n";
+        derr << "Exception: " << e.what() << '\n';
+        print_help(argv[0], desc);
+        return false;
+    }
+    if (vm.count("help"))
+    {
+        print_help(argv[0], desc);
+        return false;
+    }
+    return true;
+}
+
+// Latencies of one kind of operation
+class latency_samples
+{
+    std::vector<std::uint64_t> nanos_;
+
+public:
+    void
+    reserve(std::size_t n)
+    {
+        nanos_.reserve(n);
+    }
+
+    void
+    add(std::chrono::steady_clock::duration d)
+    {
+        nanos_.push_back(std::chrono::duration_cast<
+            std::chrono::nanoseconds>(d).count());
+    }
+
+    void
+    merge(latency_samples const& other)
+    {
+        nanos_.insert(nanos_.end(),
+            other.nanos_.begin(), other.nanos_.end());
+    }
+
+    bool
+    empty() const
+    {
+        return nanos_.empty();
+    }
+
+    std::size_t
+    size() const
+    {
+        return nanos_.size();
+    }
+
+    // Must be called before percentile
+    void
+    sort()
+    {
+        std::sort(nanos_.begin(), nanos_.end());
+    }
+
+    // Returns the latency at fraction p of the
+    // sorted samples in microseconds, or zero
+    // if there are none. p of 1 is the largest.
+    double
+    percentile(double p) const
+    {
+        if (nanos_.empty())
+            return 0;
+        auto const i = static_cast<std::size_t>(
+            p * (nanos_.size() - 1) + 0.5);
+        return nanos_[i] / 1e3;
+    }
+};
+
+} // test
+} // nudb
+
+#endif
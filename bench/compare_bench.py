@@ -0,0 +1,109 @@
+#/usr/bin/env python
+
+# Script to compare two JSON results of the benchmark programs and flag
+# regressions.
+# Options:
+#   `-b arg` : baseline result (JSON written by `bench --json`,
+#              `replay --json` or `micro --json`)
+#   `-n arg` : new result to compare against the baseline
+#   `-t arg` : noise threshold, as a fraction (default 0.05)
+# Notes: Throughput is a regression when it falls, and latency is a
+#        regression when it rises, by more than the threshold. The exit
+#        code is 1 if any regression was found.
+#        Tested with python 3 only.
+
+import argparse
+import json
+import sys
+
+# Metrics compared for each phase, and whether higher values are better
+METRICS = [
+    ('per_second', True),
+    ('p50_us', False),
+    ('p99_us', False),
+    ('p999_us', False),
+    ('ns_per_op', False),
+]
+
+
+# Return a dict mapping (db, keys, phase) to the phase results. Each
+# microbenchmark is a phase of the `micro` program.
+def load_phases(filename):
+    with open(filename) as f:
+        result = json.load(f)
+    phases = {}
+    for r in result['results']:
+        if result.get('program') == 'micro':
+            phases[('micro', '-', r['name'])] = r
+            continue
+        for phase, v in r['phases'].items():
+            phases[(r['db'], r['keys'], phase)] = v
+    return result, phases
+
+
+# Return the relative change from base to new, positive when worse
+def regression(base, new, higher_is_better):
+    if base == 0:
+        return 0.0
+    change = (new - base) / base
+    return -change if higher_is_better else change
+
+
+def run_main(base_filename, new_filename, threshold):
+    base, base_phases = load_phases(base_filename)
+    new, new_phases = load_phases(new_filename)
+    print('baseline: {}'.format(base.get('revision', 'unknown')))
+    print('new:      {}'.format(new.get('revision', 'unknown')))
+    if base['config'] != new['config']:
+        print('warning: the configurations differ')
+    print('{:>10} {:>10} {:>22} {:>12} {:>14} {:>14} {:>9}'.format(
+        'db', 'keys', 'phase', 'metric', 'baseline', 'new', 'change'))
+    regressions = 0
+    for key in sorted(base_phases):
+        if key not in new_phases:
+            print('{:>10} {:>10} {:>22} missing from new result'.format(*key))
+            continue
+        for metric, higher_is_better in METRICS:
+            b = base_phases[key].get(metric)
+            n = new_phases[key].get(metric)
+            if b is None or n is None:
+                continue
+            worse = regression(b, n, higher_is_better)
+            flag = ''
+            if worse > threshold:
+                flag = '  REGRESSION'
+                regressions += 1
+            print('{:>10} {:>10} {:>22} {:>12} {:>14.2f} {:>14.2f} {:>+8.1f}%{}'
+                  .format(key[0], key[1], key[2], metric, b, n,
+                          100.0 * (n - b) / b if b else 0.0, flag))
+    print('{} regression(s) beyond {:.1f}%'.format(
+        regressions, 100.0 * threshold))
+    return regressions
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description=('Compare two benchmark results'))
+    parser.add_argument(
+        '--base',
+        '-b',
+        help=('baseline result'), )
+    parser.add_argument(
+        '--new',
+        '-n',
+        help=('new result'), )
+    parser.add_argument(
+        '--threshold',
+        '-t',
+        type=float,
+        default=0.05,
+        help=('noise threshold as a fraction'), )
+    return parser.parse_args()
+
+
+if __name__ == '__main__':
+    args = parse_args()
+    if not args.base or not args.new:
+        print('Both a baseline and a new result must be specified. Exiting')
+        sys.exit(2)
+    sys.exit(1 if run_main(args.base, args.new, args.threshold) else 0)
@@ -0,0 +1,528 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Inserts continuously up to a target number of keys, and
+// records how the database behaves at each power of ten.
+
+#include <nudb/test/item_generator.hpp>
+#include <nudb/test/key_distribution.hpp>
+#include <nudb/test/test_store.hpp>
+#include <nudb/detail/bucket.hpp>
+#include <nudb/detail/format.hpp>
+#include "bench_util.hpp"
+#include "json_writer.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace nudb {
+namespace test {
+
+using clock_type = std::chrono::steady_clock;
+
+// Commits only when asked, so that each commit can be timed
+using growth_store = basic_test_store<native_file, single_thread>;
+
+// Returns the elapsed time since start, in nanoseconds
+std::uint64_t
+nanos_since(clock_type::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now() - start).count();
+}
+
+/*  Statistics of the key file, from a sample of buckets.
+
+    Sampled buckets are read with their spill records, and the
+    value of each entry is read from the data file to check that
+    its key hashes to the entry and to the bucket. The counts are
+    scaled up to the whole key file, and are exact when every
+    bucket is sampled.
+*/
+struct bucket_sample
+{
+    nbuck_t buckets = 0;            // buckets in the key file
+    nkey_t capacity = 0;            // entries per bucket
+    nbuck_t sampled = 0;            // buckets read
+    std::uint64_t keys = 0;         // entries in sampled buckets
+    std::uint64_t spills = 0;       // spill records of sampled buckets
+    std::uint64_t reads = 0;        // bucket reads to find each entry
+    std::array<nbuck_t, 10> hist;   // sampled buckets with n spills
+
+    bucket_sample()
+    {
+        hist.fill(0);
+    }
+
+    // Estimated spill records in use
+    double
+    spill_count() const
+    {
+        return sampled ? double(spills) * buckets / sampled : 0;
+    }
+
+    // Average reads per fetch, excluding the value, as
+    // reported by verify
+    double
+    avg_fetch() const
+    {
+        return keys ? double(reads) / keys : 0;
+    }
+
+    // Fraction of bucket entries in use
+    double
+    actual_load() const
+    {
+        return sampled ? double(keys) / (double(sampled) * capacity) : 0;
+    }
+};
+
+template<class Hasher>
+void
+sample_buckets(bucket_sample& s, path_type const& dat_path,
+    path_type const& key_path, nbuck_t samples, error_code& ec)
+{
+    using namespace detail;
+    s = {};
+    native_file df;
+    df.open(file_mode::read, dat_path, ec);
+    if (ec)
+        return;
+    native_file kf;
+    kf.open(file_mode::read, key_path, ec);
+    if (ec)
+        return;
+    key_file_header kh;
+    read(kf, kh, ec);
+    if (ec)
+        return;
+    s.buckets = kh.buckets;
+    s.capacity = kh.capacity;
+
+    // Every bucket, or distinct buckets chosen at random
+    std::vector<nbuck_t> chosen;
+    if (samples >= kh.buckets)
+    {
+        for (nbuck_t n = 0; n < kh.buckets; ++n)
+            chosen.push_back(n);
+    }
+    else
+    {
+        xor_shift_engine g{kh.buckets};
+        std::set<nbuck_t> set;
+        std::uniform_int_distribution<nbuck_t> dist{0, kh.buckets - 1};
+        while (set.size() < samples)
+            set.insert(dist(g));
+        chosen.assign(set.begin(), set.end());
+    }
+
+    buffer buf{kh.block_size};
+    buffer key{kh.key_size};
+    bucket b{kh.block_size, buf.get(), empty};
+    for (auto n : chosen)
+    {
+        b.read(kf, static_cast<noff_t>(n + 1) * kh.block_size, ec);
+        if (ec)
+            return;
+        std::size_t nspill = 0;
+        for (;;)
+        {
+            s.keys += b.size();
+            s.reads += b.size() * (nspill + 1);
+            for (nkey_t i = 0; i < b.size(); ++i)
+            {
+                auto const e = b[i];
+                df.read(e.offset + field<uint48_t>::size,
+                    key.get(), kh.key_size, ec);
+                if (ec)
+                    return;
+                auto const h = hash<Hasher>(
+                    key.get(), kh.key_size, kh.salt);
+                if (h != e.hash ||
+                    bucket_index(h, kh.buckets, kh.modulus) != n)
+                {
+                    ec = error::hash_mismatch;
+                    return;
+                }
+            }
+            auto const spill = b.spill();
+            if (!spill)
+                break;
+            b.read(df, spill, ec);
+            if (ec)
+                return;
+            ++nspill;
+        }
+        s.spills += nspill;
+        ++s.hist[std::min<std::size_t>(nspill, s.hist.size() - 1)];
+        ++s.sampled;
+    }
+}
+
+// What was measured when the database reached a milestone
+struct milestone
+{
+    std::uint64_t keys = 0;
+    std::chrono::duration<double> elapsed{0};   // since the start
+    double inserts_per_second = 0;  // since the last milestone
+    double commit_share = 0;        // fraction of that time in commit
+    std::size_t commits = 0;
+    double commit_p50_ms = 0;
+    double commit_p99_ms = 0;
+    double commit_max_ms = 0;
+    double fetches_per_second = 0;
+    double fetch_p50_us = 0;
+    double fetch_p99_us = 0;
+    double fetch_p999_us = 0;
+    std::uint64_t dat_file_size = 0;
+    std::uint64_t key_file_size = 0;
+    bucket_sample sample;
+};
+
+// Returns the powers of ten from first up to target, and target
+std::vector<std::uint64_t>
+milestones(std::uint64_t first, std::uint64_t target)
+{
+    std::vector<std::uint64_t> v;
+    std::uint64_t n = 1;
+    while (n < first)
+        n *= 10;
+    for (; n < target; n *= 10)
+    {
+        v.push_back(n);
+        if (n > target / 10)
+            break;
+    }
+    v.push_back(target);
+    return v;
+}
+
+// Fetch existing keys, recording the latency of each
+void
+time_fetches(milestone& m, growth_store& ts, item_generator const& items,
+    key_distribution const& keys, std::uint64_t fetches, error_code& ec)
+{
+    if (fetches == 0)
+        return;
+    xor_shift_engine g{m.keys};
+    Buffer buf;
+    latency_samples latency;
+    latency.reserve(fetches);
+    auto const start = clock_type::now();
+    for (std::uint64_t i = 0; i < fetches; ++i)
+    {
+        auto const key = items.key(keys(g, m.keys), buf);
+        auto const t = clock_type::now();
+        ts.db.fetch(key, [](void const*, std::size_t) {}, ec);
+        latency.add(clock_type::now() - t);
+        if (ec)
+            return;
+    }
+    std::chrono::duration<double> const elapsed = clock_type::now() - start;
+    latency.sort();
+    m.fetches_per_second = fetches / elapsed.count();
+    m.fetch_p50_us = latency.percentile(0.5);
+    m.fetch_p99_us = latency.percentile(0.99);
+    m.fetch_p999_us = latency.percentile(0.999);
+}
+
+void
+print_header()
+{
+    dout << "# inserts/s and commit times are since the previous row;\n"
+        "# spills and avg_fetch are estimated from sampled buckets\n";
+    dout << std::setw(12) << "keys"
+        << std::setw(11) << "inserts/s"
+        << std::setw(9) << "commit%"
+        << std::setw(11) << "c p50 ms"
+        << std::setw(11) << "c p99 ms"
+        << std::setw(11) << "c max ms"
+        << std::setw(11) << "fetches/s"
+        << std::setw(11) << "f p50 us"
+        << std::setw(11) << "f p99 us"
+        << std::setw(11) << "dat MB"
+        << std::setw(11) << "key MB"
+        << std::setw(12) << "buckets"
+        << std::setw(11) << "spills"
+        << std::setw(10) << "avg_fetch"
+        << std::setw(7) << "load"
+        << '\n';
+}
+
+void
+print(milestone const& m)
+{
+    dout << std::setw(12) << m.keys
+        << std::fixed << std::setprecision(0)
+        << std::setw(11) << m.inserts_per_second
+        << std::setprecision(1)
+        << std::setw(9) << 100 * m.commit_share
+        << std::setprecision(2)
+        << std::setw(11) << m.commit_p50_ms
+        << std::setw(11) << m.commit_p99_ms
+        << std::setw(11) << m.commit_max_ms
+        << std::setprecision(0)
+        << std::setw(11) << m.fetches_per_second
+        << std::setprecision(2)
+        << std::setw(11) << m.fetch_p50_us
+        << std::setw(11) << m.fetch_p99_us
+        << std::setprecision(1)
+        << std::setw(11) << m.dat_file_size / 1e6
+        << std::setw(11) << m.key_file_size / 1e6
+        << std::setw(12) << m.sample.buckets
+        << std::setprecision(0)
+        << std::setw(11) << m.sample.spill_count()
+        << std::setprecision(3)
+        << std::setw(10) << m.sample.avg_fetch()
+        << std::setprecision(2)
+        << std::setw(7) << m.sample.actual_load()
+        << '\n';
+}
+
+void
+write_json(json_writer& w, milestone const& m)
+{
+    w.begin_object();
+    w.field("keys", m.keys);
+    w.field("seconds", m.elapsed.count());
+    w.field("inserts_per_second", m.inserts_per_second);
+    w.field("commit_share", m.commit_share);
+    w.field("commits", m.commits);
+    w.field("commit_p50_ms", m.commit_p50_ms);
+    w.field("commit_p99_ms", m.commit_p99_ms);
+    w.field("commit_max_ms", m.commit_max_ms);
+    w.field("fetches_per_second", m.fetches_per_second);
+    w.field("fetch_p50_us", m.fetch_p50_us);
+    w.field("fetch_p99_us", m.fetch_p99_us);
+    w.field("fetch_p999_us", m.fetch_p999_us);
+    w.field("dat_file_size", m.dat_file_size);
+    w.field("key_file_size", m.key_file_size);
+    w.key("sample");
+    w.begin_object();
+    w.field("buckets", m.sample.buckets);
+    w.field("capacity", m.sample.capacity);
+    w.field("sampled", m.sample.sampled);
+    w.field("spill_count", m.sample.spill_count());
+    w.field("avg_fetch", m.sample.avg_fetch());
+    w.field("actual_load", m.sample.actual_load());
+    w.key("hist");
+    w.begin_array();
+    for (auto n : m.sample.hist)
+        w.value(n);
+    w.end_array();
+    w.end_object();
+    w.end_object();
+}
+
+} // test
+} // nudb
+
+int
+main(int argc, char** argv)
+{
+    using namespace nudb;
+    using namespace nudb::test;
+
+    po::options_description desc{"Growth Benchmark Options"};
+    desc.add_options()
+        ("help,h", "Display this message.")
+        ("target", po::value<std::uint64_t>(),
+         "values to insert (default: 1000000000)")
+        ("first", po::value<std::uint64_t>(),
+         "smallest milestone, rounded up to a power of ten (default: 1000)")
+        ("batch", po::value<std::size_t>(),
+         "inserts between commits (default: 100000)")
+        ("fetches", po::value<std::uint64_t>(),
+         "fetches timed at each milestone (default: 100000)")
+        ("samples", po::value<std::size_t>(),
+         "buckets sampled at each milestone (default: 1000)")
+        ("keys", po::value<std::string>(),
+         "fetched keys: uniform, zipf:THETA, scrambled_zipf:THETA, "
+         "hotspot:KEYS:OPS, or latest:THETA (default: uniform)")
+        ("values", po::value<std::string>(),
+         "value sizes: fixed:N, uniform:MIN:MAX, or "
+         "lognormal:MEDIAN:SIGMA (default: uniform:250:750)")
+        ("json", po::value<std::string>(),
+         "also write the results as JSON to this file, "
+         "rewritten at each milestone")
+        ("revision", po::value<std::string>(),
+         "source revision recorded in the JSON results "
+         "(default: the revision the program was built from)")
+        ("block_size", po::value<size_t>(),
+         "nudb block size (default: 4096)")
+        ("key_size", po::value<size_t>(),
+         "key size (default: 64)")
+        ("load_factor", po::value<float>(),
+         "nudb load factor (default: 0.5)")
+        ;
+
+    po::variables_map vm;
+    if (!parse_options(argc, argv, desc, vm))
+        return 0;
+
+    auto const target = get_opt<std::uint64_t>(vm, "target", 1000000000);
+    auto const first = get_opt<std::uint64_t>(vm, "first", 1000);
+    auto const batch = get_opt<std::size_t>(vm, "batch", 100000);
+    auto const fetches = get_opt<std::uint64_t>(vm, "fetches", 100000);
+    auto const samples = get_opt<std::size_t>(vm, "samples", 1000);
+    auto const block_size = get_opt<size_t>(vm, "block_size", 4096);
+    auto const key_size = get_opt<size_t>(vm, "key_size", 64);
+    auto const load_factor = get_opt<float>(vm, "load_factor", 0.5f);
+    auto const json_path = get_opt<std::string>(vm, "json", "");
+    auto const revision = get_opt<std::string>(
+        vm, "revision", NUDB_GIT_REVISION);
+    std::unique_ptr<key_distribution> keys;
+    std::unique_ptr<value_sizes> values;
+    try
+    {
+        keys.reset(new key_distribution{
+            get_opt<std::string>(vm, "keys", "uniform")});
+        values.reset(new value_sizes{
+            get_opt<std::string>(vm, "values", "uniform:250:750")});
+    }
+    catch (std::exception const& e)
+    {
+        derr << e.what() << '\n';
+        return 1;
+    }
+    if (target < 1 || batch < 1 || samples < 1)
+    {
+        derr << "target, batch and samples must be positive\n";
+        return 1;
+    }
+
+    // Rewrites the JSON results with the milestones so far
+    auto const write_results =
+        [&](std::vector<milestone> const& results)
+        {
+            std::ofstream os{json_path};
+            json_writer w{os};
+            w.begin_object();
+            w.field("program", "growth");
+            w.field("revision", revision);
+            w.field("time", static_cast<std::uint64_t>(std::time(nullptr)));
+            w.key("config");
+            w.begin_object();
+            w.field("target", target);
+            w.field("batch", batch);
+            w.field("fetches", fetches);
+            w.field("samples", samples);
+            w.field("key_size", key_size);
+            w.field("block_size", block_size);
+            w.field("load_factor", double(load_factor));
+            w.field("keys", keys->str());
+            w.field("values", values->str());
+            w.end_object();
+            w.key("milestones");
+            w.begin_array();
+            for (auto const& m : results)
+                write_json(w, m);
+            w.end_array();
+            w.end_object();
+            return bool(os);
+        };
+
+    item_generator const items{key_size, *values};
+    error_code ec;
+    growth_store ts{key_size, block_size, load_factor};
+    ts.create(ec);
+    if (!ec)
+        ts.open(ec);
+    if (ec)
+    {
+        derr << "Error: " << ec.message() << '\n';
+        return 1;
+    }
+
+    dout << "growth (nudb, " << target << " keys, commit every " << batch
+        << " inserts, keys " << keys->str() << ", values "
+        << values->str() << ")\n";
+    print_header();
+    std::vector<milestone> results;
+    std::uint64_t next = 0;
+    auto const start = clock_type::now();
+    for (auto const goal : milestones(first, target))
+    {
+        milestone m;
+        m.keys = goal;
+        std::uint64_t const begin = next;
+        std::uint64_t insert_nanos = 0;
+        std::uint64_t commit_nanos = 0;
+        latency_samples commit_latency;
+        Buffer buf;
+        while (next < goal && !ec)
+        {
+            auto const end = std::min<std::uint64_t>(goal, next + batch);
+            auto t = clock_type::now();
+            for (; next < end && !ec; ++next)
+            {
+                auto const item = items(next, buf);
+                ts.db.insert(item.key, item.data, item.size, ec);
+            }
+            insert_nanos += nanos_since(t);
+            if (ec)
+                break;
+            t = clock_type::now();
+            ts.db.commit(ec);
+            auto const d = clock_type::now() - t;
+            commit_latency.add(d);
+            commit_nanos += std::chrono::duration_cast<
+                std::chrono::nanoseconds>(d).count();
+        }
+        if (ec)
+            break;
+        auto const total_nanos = insert_nanos + commit_nanos;
+        m.inserts_per_second = (goal - begin) * 1e9 / total_nanos;
+        m.commit_share = 1 - double(insert_nanos) / total_nanos;
+        commit_latency.sort();
+        m.commits = commit_latency.size();
+        m.commit_p50_ms = commit_latency.percentile(0.5) / 1e3;
+        m.commit_p99_ms = commit_latency.percentile(0.99) / 1e3;
+        m.commit_max_ms = commit_latency.percentile(1) / 1e3;
+
+        time_fetches(m, ts, items, *keys, fetches, ec);
+        if (ec)
+            break;
+        boost::system::error_code fec;
+        m.dat_file_size = boost::filesystem::file_size(ts.dp, fec);
+        m.key_file_size = boost::filesystem::file_size(ts.kp, fec);
+        sample_buckets<xxhasher>(m.sample, ts.dp, ts.kp,
+            static_cast<nbuck_t>(samples), ec);
+        if (ec)
+            break;
+        m.elapsed = clock_type::now() - start;
+        print(m);
+        results.push_back(m);
+        if (!json_path.empty() && !write_results(results))
+        {
+            derr << "Error: could not write " << json_path << '\n';
+            return 1;
+        }
+    }
+    if (ec)
+    {
+        derr << "Error: " << ec.message() << '\n';
+        return 1;
+    }
+    ts.close(ec);
+    if (ec)
+    {
+        derr << "Error: " << ec.message() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,187 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_BENCH_JSON_WRITER_HPP
+#define NUDB_BENCH_JSON_WRITER_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace nudb {
+namespace test {
+
+// Writes indented JSON to a stream, for benchmark reports
+class json_writer
+{
+    std::ostream& os_;
+    std::vector<bool> first_;   // no element yet, per level
+    bool after_key_ = false;
+
+public:
+    explicit
+    json_writer(std::ostream& os)
+        : os_(os)
+    {
+    }
+
+    void
+    begin_object()
+    {
+        open('{');
+    }
+
+    void
+    end_object()
+    {
+        close('}');
+    }
+
+    void
+    begin_array()
+    {
+        open('[');
+    }
+
+    void
+    end_array()
+    {
+        close(']');
+    }
+
+    void
+    key(std::string const& k)
+    {
+        separate();
+        string(k);
+        os_ << ": ";
+        after_key_ = true;
+    }
+
+    void
+    value(std::string const& v)
+    {
+        separate();
+        string(v);
+    }
+
+    void
+    value(char const* v)
+    {
+        value(std::string{v});
+    }
+
+    void
+    value(bool v)
+    {
+        separate();
+        os_ << (v ? "true" : "false");
+    }
+
+    void
+    value(double v)
+    {
+        separate();
+        if (!std::isfinite(v))
+        {
+            os_ << "null";
+            return;
+        }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.15g", v);
+        os_ << buf;
+    }
+
+    template <class T>
+    typename std::enable_if<std::is_integral<T>::value>::type
+    value(T v)
+    {
+        separate();
+        os_ << +v;
+    }
+
+    template <class T>
+    void
+    field(std::string const& k, T const& v)
+    {
+        key(k);
+        value(v);
+    }
+
+private:
+    void
+    open(char c)
+    {
+        separate();
+        os_ << c;
+        first_.push_back(true);
+    }
+
+    void
+    close(char c)
+    {
+        auto const empty = first_.back();
+        first_.pop_back();
+        if (!empty)
+            newline();
+        os_ << c;
+        if (first_.empty())
+            os_ << '\n';
+    }
+
+    // Write the separator before an element
+    void
+    separate()
+    {
+        if (after_key_)
+        {
+            after_key_ = false;
+            return;
+        }
+        if (first_.empty())
+            return;
+        if (!first_.back())
+            os_ << ',';
+        first_.back() = false;
+        newline();
+    }
+
+    void
+    newline()
+    {
+        os_ << '\n' << std::string(2 * first_.size(), ' ');
+    }
+
+    void
+    string(std::string const& s)
+    {
+        os_ << '"';
+        for (unsigned char c : s)
+        {
+            if (c == '"' || c == '\\')
+                os_ << '\\' << c;
+            else if (c < 0x20)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                os_ << buf;
+            }
+            else
+                os_ << c;
+        }
+        os_ << '"';
+    }
+};
+
+} // test
+} // nudb
+
+#endif
@@ -0,0 +1,734 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Microbenchmarks of the in-memory structures used by
+// insert, fetch and commit, each timed without file I/O.
+
+#include <nudb/test/xor_shift_engine.hpp>
+#include <nudb/detail/arena.hpp>
+#include <nudb/detail/bucket.hpp>
+#include <nudb/detail/bulkio.hpp>
+#include <nudb/detail/cache.hpp>
+#include <nudb/detail/field.hpp>
+#include <nudb/detail/format.hpp>
+#include <nudb/detail/pool.hpp>
+#include <nudb/detail/stream.hpp>
+#include <nudb/detail/xxhash.hpp>
+#include "bench_util.hpp"
+#include "json_writer.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nudb {
+namespace test {
+
+using clock_type = std::chrono::steady_clock;
+
+// Keeps the compiler from discarding a computed value
+template<class T>
+inline
+void
+do_not_optimize(T const& v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(v) : "memory");
+#else
+    static void const* volatile sink;
+    sink = &v;
+#endif
+}
+
+struct micro_config
+{
+    std::size_t key_size = 64;
+    std::size_t block_size = 4096;
+    float load_factor = 0.5f;
+    std::size_t value_size = 500;
+    std::size_t pool_keys = 100000;
+    std::size_t cache_buckets = 10000;
+};
+
+struct micro_benchmark
+{
+    std::string name;
+    std::size_t bytes;  // bytes processed per operation, or 0
+    std::function<void(std::size_t)> run;   // performs n operations
+
+    // Operations between resets of the benchmark's state,
+    // such as clearing a full bucket. Batches are a multiple
+    // of this, so that each one includes the same number of
+    // resets.
+    std::size_t period;
+
+    micro_benchmark(std::string name_, std::size_t bytes_,
+            std::function<void(std::size_t)> run_,
+                std::size_t period_ = 1)
+        : name(std::move(name_))
+        , bytes(bytes_)
+        , run(std::move(run_))
+        , period(period_)
+    {
+    }
+};
+
+struct micro_result
+{
+    std::string name;
+    std::size_t bytes = 0;
+    std::uint64_t batch = 0;        // operations per sample
+    std::vector<double> samples;    // ns per operation, sorted
+
+    double
+    median() const
+    {
+        return median_of(samples);
+    }
+
+    double
+    min() const
+    {
+        return samples.front();
+    }
+
+    double
+    max() const
+    {
+        return samples.back();
+    }
+
+    // Median absolute deviation of the samples, as a
+    // fraction of the median. Unlike the range, this is
+    // not moved by a few batches which were interrupted.
+    double
+    deviation() const
+    {
+        auto const m = median();
+        std::vector<double> v;
+        for (auto s : samples)
+            v.push_back(std::abs(s - m));
+        std::sort(v.begin(), v.end());
+        return median_of(v) / m;
+    }
+
+private:
+    // v must be sorted
+    static
+    double
+    median_of(std::vector<double> const& v)
+    {
+        auto const n = v.size();
+        return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    }
+};
+
+// Returns the time taken by n operations, in nanoseconds
+double
+time_batch(micro_benchmark const& b, std::size_t n)
+{
+    auto const start = clock_type::now();
+    b.run(n);
+    return std::chrono::duration<double, std::nano>(
+        clock_type::now() - start).count();
+}
+
+/*  Time a benchmark.
+
+    The batch size is doubled until a batch takes at least
+    min_time, which also warms up the caches and the branch
+    predictors, and then rounded up to a multiple of the
+    benchmark's period. After one more warmup batch, each
+    repetition times a batch and records the nanoseconds per
+    operation. The median of the repetitions is reported.
+*/
+micro_result
+measure(micro_benchmark const& b,
+    std::size_t repetitions, std::chrono::duration<double> min_time)
+{
+    auto const min_ns = min_time.count() * 1e9;
+    std::size_t n = 1;
+    for (;;)
+    {
+        auto const ns = time_batch(b, n);
+        if (ns >= min_ns)
+            break;
+        // Grow quickly once the timing is meaningful
+        if (ns > min_ns / 100)
+            n = static_cast<std::size_t>(n * 1.2 * min_ns / ns) + 1;
+        else
+            n *= 2;
+    }
+    n = (n + b.period - 1) / b.period * b.period;
+    time_batch(b, n);
+    micro_result result;
+    result.name = b.name;
+    result.bytes = b.bytes;
+    result.batch = n;
+    for (std::size_t i = 0; i < repetitions; ++i)
+        result.samples.push_back(time_batch(b, n) / n);
+    std::sort(result.samples.begin(), result.samples.end());
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+// Inputs are taken from tables of a power of two
+// size, so that choosing one costs only a mask.
+std::size_t constexpr table_size = 4096;
+std::size_t constexpr table_mask = table_size - 1;
+
+std::vector<detail::nhash_t>
+random_hashes(std::size_t n, std::uint64_t seed)
+{
+    xor_shift_engine g{seed};
+    std::vector<detail::nhash_t> v(n);
+    for (auto& h : v)
+        h = detail::make_hash<detail::f_hash>(g());
+    return v;
+}
+
+std::vector<std::uint8_t>
+random_bytes(std::size_t n, std::uint64_t seed)
+{
+    xor_shift_engine g{seed};
+    std::vector<std::uint8_t> v(n);
+    for (auto& b : v)
+        b = static_cast<std::uint8_t>(g());
+    return v;
+}
+
+// A File which discards writes, so that bulk_writer
+// is timed without I/O.
+struct null_file
+{
+    void
+    write(std::uint64_t, void const*, std::size_t, error_code&)
+    {
+    }
+};
+
+// Fill a bucket with random hashes up to the load factor
+void
+fill_bucket(detail::bucket& b, float load_factor, std::uint64_t seed)
+{
+    auto const n = std::max<std::size_t>(1, static_cast<std::size_t>(
+        detail::bucket_capacity(b.block_size()) * load_factor));
+    auto const hashes = random_hashes(n, seed);
+    for (std::size_t i = 0; i < n; ++i)
+        b.insert(i, 100, hashes[i]);
+}
+
+void
+add_hash_benchmarks(std::vector<micro_benchmark>& v, micro_config const&)
+{
+    auto const data = std::make_shared<
+        std::vector<std::uint8_t>>(random_bytes(4096 + 64, 1));
+    for (std::size_t size : {8, 16, 32, 64, 128, 256, 1024, 4096})
+        v.push_back({"XXH64/" + std::to_string(size), size,
+            [data, size](std::size_t n)
+            {
+                std::uint64_t sum = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                    sum += detail::XXH64(
+                        data->data() + (i & 7) * 8, size, 0);
+                do_not_optimize(sum);
+            }});
+}
+
+void
+add_bucket_benchmarks(std::vector<micro_benchmark>& v, micro_config const& c)
+{
+    auto const block_size = static_cast<nsize_t>(c.block_size);
+    auto const hashes = std::make_shared<
+        std::vector<detail::nhash_t>>(random_hashes(table_size, 2));
+
+    // A modulus which is not a power of two, as in a store
+    // part way between doublings of the number of buckets.
+    v.push_back({"bucket_index", 0,
+        [hashes](std::size_t n)
+        {
+            nbuck_t const buckets = 1000003;
+            auto const modulus = detail::ceil_pow2(
+                static_cast<std::uint64_t>(buckets));
+            std::uint64_t sum = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                sum += detail::bucket_index(
+                    (*hashes)[i & table_mask], buckets, modulus);
+            do_not_optimize(sum);
+        }});
+
+    // Searches a bucket filled to the load factor
+    {
+        auto const buf = std::make_shared<detail::buffer>(block_size);
+        detail::bucket b{block_size, buf->get(), detail::empty};
+        fill_bucket(b, c.load_factor, 3);
+        v.push_back({"bucket_t::lower_bound", 0,
+            [buf, b, hashes](std::size_t n)
+            {
+                std::uint64_t sum = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                    sum += b.lower_bound((*hashes)[i & table_mask]);
+                do_not_optimize(sum);
+            }});
+    }
+
+    // Inserts until the bucket is full, then clears it. The
+    // cost of clear is spread over the inserts.
+    {
+        auto const buf = std::make_shared<detail::buffer>(block_size);
+        auto const b = std::make_shared<detail::bucket>(
+            block_size, buf->get(), detail::empty);
+        v.push_back({"bucket_t::insert", 0,
+            [buf, b, hashes](std::size_t n)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    if (b->full())
+                        b->clear();
+                    b->insert(i, 100, (*hashes)[i & table_mask]);
+                }
+                do_not_optimize(buf->get()[0]);
+            }, detail::bucket_capacity(block_size)});
+    }
+
+    // Erases entries at random positions until the bucket is
+    // empty, then copies in the full bucket again. The cost of
+    // the copy is spread over the erases.
+    {
+        auto const full = std::make_shared<detail::buffer>(block_size);
+        detail::bucket fb{block_size, full->get(), detail::empty};
+        while (!fb.full())
+            fb.insert(fb.size(), 100, (*hashes)[fb.size() & table_mask]);
+        auto const buf = std::make_shared<detail::buffer>(block_size);
+        auto const b = std::make_shared<detail::bucket>(
+            block_size, buf->get(), detail::empty);
+        v.push_back({"bucket_t::erase", 0,
+            [full, buf, b, hashes](std::size_t n)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    if (b->empty())
+                    {
+                        std::memcpy(buf->get(), full->get(), full->size());
+                        *b = detail::bucket{b->block_size(), buf->get()};
+                    }
+                    b->erase(static_cast<nkey_t>(
+                        (*hashes)[i & table_mask] % b->size()));
+                }
+                do_not_optimize(buf->get()[0]);
+            }, detail::bucket_capacity(block_size)});
+    }
+}
+
+void
+add_pool_benchmarks(std::vector<micro_benchmark>& v, micro_config const& c)
+{
+    auto const key_size = static_cast<nsize_t>(c.key_size);
+    auto const value_size = static_cast<nsize_t>(c.value_size);
+    auto const arena_size = 32 * c.block_size;
+    auto const keys = std::make_shared<std::vector<std::uint8_t>>(
+        random_bytes(c.pool_keys * key_size, 4));
+    auto const hashes = std::make_shared<
+        std::vector<detail::nhash_t>>(random_hashes(table_size, 5));
+    auto const value = std::make_shared<
+        std::vector<std::uint8_t>>(random_bytes(value_size, 6));
+    auto const pool_keys = c.pool_keys;
+
+    // Inserts pool_keys values, then clears the pool as a
+    // commit does. The cost of clear is spread over the inserts.
+    {
+        auto const p = std::make_shared<detail::pool>(key_size, arena_size);
+        auto const next = std::make_shared<std::size_t>(0);
+        v.push_back({"pool_t::insert", value_size,
+            [=](std::size_t n)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    if (*next == pool_keys)
+                    {
+                        p->clear();
+                        *next = 0;
+                    }
+                    p->insert((*hashes)[i & table_mask],
+                        keys->data() + *next * key_size,
+                            value->data(), value_size);
+                    ++*next;
+                }
+            }, pool_keys});
+    }
+
+    // Finds keys in a pool holding pool_keys values
+    {
+        auto const p = std::make_shared<detail::pool>(key_size, arena_size);
+        for (std::size_t i = 0; i < pool_keys; ++i)
+            p->insert((*hashes)[i & table_mask],
+                keys->data() + i * key_size, value->data(), value_size);
+        auto const order = random_hashes(table_size, 7);
+        auto const index = std::make_shared<std::vector<std::size_t>>();
+        for (auto h : order)
+            index->push_back(h % pool_keys);
+        v.push_back({"pool_t::find", 0,
+            [=](std::size_t n)
+            {
+                std::size_t found = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                    found += p->find(keys->data() +
+                        (*index)[i & table_mask] * key_size) != p->end();
+                do_not_optimize(found);
+            }});
+    }
+}
+
+void
+add_cache_benchmarks(std::vector<micro_benchmark>& v, micro_config const& c)
+{
+    auto const key_size = static_cast<nsize_t>(c.key_size);
+    auto const block_size = static_cast<nsize_t>(c.block_size);
+    auto const buckets = static_cast<nbuck_t>(c.cache_buckets);
+    auto const buf = std::make_shared<detail::buffer>(block_size);
+    auto const b = std::make_shared<detail::bucket>(
+        block_size, buf->get(), detail::empty);
+    fill_bucket(*b, c.load_factor, 8);
+
+    // Inserts copies of a bucket into the cache, then clears it
+    // as a commit does. The cost of clear is spread over the inserts.
+    {
+        auto const cache = std::make_shared<detail::cache>(
+            key_size, block_size);
+        auto const next = std::make_shared<nbuck_t>(0);
+        v.push_back({"cache_t::insert", block_size,
+            [=](std::size_t n)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    if (*next == buckets)
+                    {
+                        cache->clear();
+                        *next = 0;
+                    }
+                    cache->insert((*next)++, *b);
+                }
+            }, buckets});
+    }
+
+    // Finds buckets in a cache holding cache_buckets buckets
+    {
+        auto const cache = std::make_shared<detail::cache>(
+            key_size, block_size);
+        for (nbuck_t n = 0; n < buckets; ++n)
+            cache->insert(n, *b);
+        auto const order = random_hashes(table_size, 9);
+        auto const index = std::make_shared<std::vector<nbuck_t>>();
+        for (auto h : order)
+            index->push_back(static_cast<nbuck_t>(h % buckets));
+        v.push_back({"cache_t::find", 0,
+            [=](std::size_t n)
+            {
+                std::size_t found = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                    found += cache->find(
+                        (*index)[i & table_mask]) != cache->end();
+                do_not_optimize(found);
+            }});
+    }
+}
+
+void
+add_arena_benchmarks(std::vector<micro_benchmark>& v, micro_config const& c)
+{
+    auto const arena_size = 32 * c.block_size;
+    auto const pool_keys = c.pool_keys;
+    for (std::size_t size : {c.key_size, c.value_size})
+    {
+        auto const a = std::make_shared<detail::arena>(arena_size);
+        auto const count = std::make_shared<std::size_t>(0);
+        v.push_back({"arena_t::alloc/" + std::to_string(size), size,
+            [=](std::size_t n)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    // Reuse the blocks as a pool does after a commit
+                    if (++*count == pool_keys)
+                    {
+                        a->clear();
+                        *count = 0;
+                    }
+                    do_not_optimize(a->alloc(size));
+                }
+            }, pool_keys});
+    }
+}
+
+void
+add_bulkio_benchmarks(std::vector<micro_benchmark>& v, micro_config const& c)
+{
+    auto const key_size = c.key_size;
+    auto const value_size = c.value_size;
+    auto const buffer_size = 32 * c.block_size;
+    auto const record_size = detail::value_size(value_size, key_size);
+    auto const record = std::make_shared<std::vector<std::uint8_t>>(
+        random_bytes(key_size + value_size, 10));
+
+    // Appends data records as commit does, with
+    // the same buffer size as the store.
+    v.push_back({"bulk_writer::prepare", record_size,
+        [=](std::size_t n)
+        {
+            null_file f;
+            error_code ec;
+            detail::bulk_writer<null_file> w{f, 0, buffer_size};
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                auto os = w.prepare(record_size, ec);
+                detail::write<detail::uint48_t>(os, value_size);
+                detail::write(os, record->data(), key_size);
+                detail::write(os, record->data() + key_size, value_size);
+            }
+            w.flush(ec);
+        }, std::max<std::size_t>(1, buffer_size / record_size)});
+}
+
+// Writes and reads one field at a time through a stream
+// over a buffer, restarting at the beginning when full.
+template<class T>
+void
+add_field_benchmarks(std::vector<micro_benchmark>& v, std::string const& type)
+{
+    std::size_t constexpr size = detail::field<T>::size;
+    std::size_t constexpr count = 4096 / size;
+    auto const buf = std::make_shared<std::vector<std::uint8_t>>(
+        random_bytes(count * size, 11));
+    auto const values = std::make_shared<std::vector<std::uint64_t>>();
+    xor_shift_engine g{12};
+    for (std::size_t i = 0; i < table_size; ++i)
+        values->push_back(g() & detail::field<T>::max);
+
+    v.push_back({"field::write/" + type, size,
+        [buf, values](std::size_t n)
+        {
+            detail::ostream os{buf->data(), buf->size()};
+            for (std::size_t i = 0, j = 0; i < n; ++i)
+            {
+                if (j++ == count)
+                {
+                    os = detail::ostream{buf->data(), buf->size()};
+                    j = 1;
+                }
+                detail::write<T>(os, (*values)[i & table_mask]);
+            }
+            do_not_optimize((*buf)[0]);
+        }, count});
+    v.push_back({"field::read/" + type, size,
+        [buf](std::size_t n)
+        {
+            std::uint64_t sum = 0;
+            detail::istream is{buf->data(), buf->size()};
+            for (std::size_t i = 0, j = 0; i < n; ++i)
+            {
+                if (j++ == count)
+                {
+                    is = detail::istream{buf->data(), buf->size()};
+                    j = 1;
+                }
+                std::uint64_t u;
+                detail::read<T>(is, u);
+                sum += u;
+            }
+            do_not_optimize(sum);
+        }, count});
+}
+
+std::vector<micro_benchmark>
+make_benchmarks(micro_config const& c)
+{
+    std::vector<micro_benchmark> v;
+    add_hash_benchmarks(v, c);
+    add_bucket_benchmarks(v, c);
+    add_pool_benchmarks(v, c);
+    add_cache_benchmarks(v, c);
+    add_arena_benchmarks(v, c);
+    add_bulkio_benchmarks(v, c);
+    add_field_benchmarks<std::uint16_t>(v, "uint16");
+    add_field_benchmarks<detail::uint24_t>(v, "uint24");
+    add_field_benchmarks<std::uint32_t>(v, "uint32");
+    add_field_benchmarks<detail::uint48_t>(v, "uint48");
+    add_field_benchmarks<std::uint64_t>(v, "uint64");
+    return v;
+}
+
+void
+print(micro_result const& r)
+{
+    auto const col_w = 12;
+    dout << std::left << std::setw(24) << r.name << std::right
+        << std::fixed << std::setprecision(2)
+        << std::setw(col_w) << r.median()
+        << std::setw(col_w) << r.min()
+        << std::setw(col_w) << r.max()
+        << std::setw(col_w - 1) << 100 * r.deviation() << '%';
+    if (r.bytes)
+        dout << std::setw(col_w) << r.bytes / r.median() * 1e3;
+    dout << '\n';
+}
+
+} // test
+} // nudb
+
+int
+main(int argc, char** argv)
+{
+    using namespace nudb;
+    using namespace nudb::test;
+
+    po::options_description desc{"Microbenchmark Options"};
+    desc.add_options()
+        ("help,h", "Display this message.")
+        ("filter", po::value<std::string>(),
+         "run only benchmarks whose name contains this string")
+        ("list", "list the benchmarks and exit")
+        ("repetitions", po::value<std::size_t>(),
+         "timed batches per benchmark (default: 15)")
+        ("min_time", po::value<double>(),
+         "least time per batch, in milliseconds (default: 20)")
+        ("json", po::value<std::string>(),
+         "also write the results as JSON to this file")
+        ("revision", po::value<std::string>(),
+         "source revision recorded in the JSON results "
+         "(default: the revision the program was built from)")
+        ("key_size", po::value<size_t>(),
+         "key size (default: 64)")
+        ("block_size", po::value<size_t>(),
+         "nudb block size (default: 4096)")
+        ("load_factor", po::value<float>(),
+         "fraction of each searched bucket which is full (default: 0.5)")
+        ("value_size", po::value<size_t>(),
+         "value size (default: 500)")
+        ("pool_keys", po::value<size_t>(),
+         "values in the pool between clears (default: 100000)")
+        ("cache_buckets", po::value<size_t>(),
+         "buckets in the cache between clears (default: 10000)")
+        ;
+
+    po::variables_map vm;
+    if (!parse_options(argc, argv, desc, vm))
+        return 0;
+
+    micro_config c;
+    c.key_size = get_opt<size_t>(vm, "key_size", c.key_size);
+    c.block_size = get_opt<size_t>(vm, "block_size", c.block_size);
+    c.load_factor = get_opt<float>(vm, "load_factor", c.load_factor);
+    c.value_size = get_opt<size_t>(vm, "value_size", c.value_size);
+    c.pool_keys = get_opt<size_t>(vm, "pool_keys", c.pool_keys);
+    c.cache_buckets = get_opt<size_t>(vm, "cache_buckets", c.cache_buckets);
+    auto const filter = get_opt<std::string>(vm, "filter", "");
+    auto const repetitions = get_opt<std::size_t>(vm, "repetitions", 15);
+    auto const min_time = std::chrono::duration<double, std::milli>{
+        get_opt<double>(vm, "min_time", 20)};
+    auto const json_path = get_opt<std::string>(vm, "json", "");
+    if (c.key_size < 1 || c.value_size < 1 || c.pool_keys < 1 ||
+        c.cache_buckets < 1 || repetitions < 1 ||
+        !(c.load_factor > 0 && c.load_factor <= 1) ||
+        c.block_size < detail::bucket_size(2) ||
+        c.block_size > detail::field<std::uint16_t>::max)
+    {
+        derr << "Invalid options\n";
+        return 1;
+    }
+
+    auto const benchmarks = make_benchmarks(c);
+    if (vm.count("list"))
+    {
+        for (auto const& b : benchmarks)
+            dout << b.name << '\n';
+        return 0;
+    }
+
+    dout << "microbenchmarks (key size " << c.key_size << ", block size "
+        << c.block_size << ", load factor " << c.load_factor
+        << ", value size " << c.value_size << ")\n";
+    dout << "# ns per operation: median, fastest and slowest of "
+        << repetitions << " batches, and median absolute deviation\n";
+    dout << std::left << std::setw(24) << "benchmark" << std::right
+        << std::setw(12) << "ns/op"
+        << std::setw(12) << "min"
+        << std::setw(12) << "max"
+        << std::setw(12) << "+/-"
+        << std::setw(12) << "MB/s"
+        << '\n';
+    std::vector<micro_result> results;
+    for (auto const& b : benchmarks)
+    {
+        if (b.name.find(filter) == std::string::npos)
+            continue;
+        results.push_back(measure(b, repetitions, min_time));
+        print(results.back());
+    }
+
+    if (json_path.empty())
+        return 0;
+    std::ofstream os{json_path};
+    json_writer w{os};
+    w.begin_object();
+    w.field("program", "micro");
+    w.field("revision", get_opt<std::string>(
+        vm, "revision", NUDB_GIT_REVISION));
+    w.field("time", static_cast<std::uint64_t>(std::time(nullptr)));
+    w.key("config");
+    w.begin_object();
+    w.field("key_size", c.key_size);
+    w.field("block_size", c.block_size);
+    w.field("load_factor", double(c.load_factor));
+    w.field("value_size", c.value_size);
+    w.field("pool_keys", c.pool_keys);
+    w.field("cache_buckets", c.cache_buckets);
+    w.field("repetitions", repetitions);
+    w.field("min_time_ms", min_time.count());
+    w.end_object();
+    w.key("results");
+    w.begin_array();
+    for (auto const& r : results)
+    {
+        w.begin_object();
+        w.field("name", r.name);
+        w.field("batch", r.batch);
+        w.field("ns_per_op", r.median());
+        w.field("min_ns_per_op", r.min());
+        w.field("max_ns_per_op", r.max());
+        w.field("deviation", r.deviation());
+        if (r.bytes)
+        {
+            w.field("bytes_per_op", r.bytes);
+            w.field("mb_per_second", r.bytes / r.median() * 1e3);
+        }
+        w.key("samples");
+        w.begin_array();
+        for (auto s : r.samples)
+            w.value(s);
+        w.end_array();
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    if (!os)
+    {
+        derr << "Error: could not write " << json_path << '\n';
+        return 1;
+    }
+}
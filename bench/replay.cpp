@@ -0,0 +1,278 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Plays a recorded trace against a new database, and reports
+// the latency of each kind of operation. Delays may be added to
+// file operations to study the effect of slow storage.
+
+#include <nudb/test/slow_file.hpp>
+#include <nudb/test/test_store.hpp>
+#include <nudb/replay.hpp>
+#include "bench_util.hpp"
+#include "json_writer.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+namespace nudb {
+namespace test {
+
+// Latencies of one kind of operation
+struct op_latencies
+{
+    char const* name;
+    latency_samples latency;
+};
+
+using thread_latencies = std::array<op_latencies, 3>;
+
+std::size_t
+index(trace_op op)
+{
+    return static_cast<std::size_t>(op) - 1;
+}
+
+} // test
+} // nudb
+
+int
+main(int argc, char** argv)
+{
+    using namespace nudb;
+    using namespace nudb::test;
+
+    po::options_description desc{"Replay Benchmark Options"};
+    desc.add_options()
+        ("help,h", "Display this message.")
+        ("trace", po::value<std::string>(),
+         "trace file recorded with basic_store::trace (required)")
+        ("speed", po::value<double>(),
+         "speed relative to the recorded times, or 0 to play "
+         "as fast as possible (default: 0)")
+        ("threads", po::value<std::size_t>(),
+         "threads issuing operations (default: 1)")
+        ("no_preload",
+         "do not insert the values which the trace fetches "
+         "before inserting them")
+        ("json", po::value<std::string>(),
+         "also write the results as JSON to this file")
+        ("revision", po::value<std::string>(),
+         "source revision recorded in the JSON results "
+         "(default: the revision the program was built from)")
+        ("block_size", po::value<size_t>(),
+         "nudb block size (default: 4096)")
+        ("load_factor", po::value<float>(),
+         "nudb load factor (default: 0.5)")
+        ("read_delay", po::value<std::string>(),
+         "delay added to each file read: none, fixed:US, or "
+         "lognormal:MEDIAN_US:SIGMA, optionally followed by "
+         ",stall:N:US to stall every Nth read (default: none)")
+        ("write_delay", po::value<std::string>(),
+         "delay added to each file write, as for --read_delay")
+        ("sync_delay", po::value<std::string>(),
+         "delay added to each file sync, as for --read_delay")
+        ("trunc_delay", po::value<std::string>(),
+         "delay added to each file truncation, as for --read_delay")
+        ("parallel_sync",
+         "sync the data file concurrently with the key and log "
+         "files during each commit")
+        ;
+
+    po::variables_map vm;
+    if (!parse_options(argc, argv, desc, vm))
+        return 0;
+    if (!vm.count("trace"))
+    {
+        print_help(argv[0], desc);
+        return 0;
+    }
+
+    auto const trace_path = get_opt<std::string>(vm, "trace", "");
+    auto const block_size = get_opt<size_t>(vm, "block_size", 4096);
+    auto const load_factor = get_opt<float>(vm, "load_factor", 0.5f);
+    auto const json_path = get_opt<std::string>(vm, "json", "");
+    auto const revision = get_opt<std::string>(
+        vm, "revision", NUDB_GIT_REVISION);
+    replay_options options;
+    options.speed = get_opt<double>(vm, "speed", options.speed);
+    options.threads = std::max<std::size_t>(1,
+        get_opt<std::size_t>(vm, "threads", options.threads));
+    options.preload = vm.count("no_preload") == 0;
+    auto const parallel_sync = vm.count("parallel_sync") != 0;
+    slow_file_delays delays;
+    try
+    {
+        delays.read = delay_distribution{
+            get_opt<std::string>(vm, "read_delay", "none")};
+        delays.write = delay_distribution{
+            get_opt<std::string>(vm, "write_delay", "none")};
+        delays.sync = delay_distribution{
+            get_opt<std::string>(vm, "sync_delay", "none")};
+        delays.trunc = delay_distribution{
+            get_opt<std::string>(vm, "trunc_delay", "none")};
+    }
+    catch (std::exception const& e)
+    {
+        derr << e.what() << '\n';
+        return 1;
+    }
+
+    error_code ec;
+    nsize_t key_size;
+    {
+        trace_reader tr;
+        tr.open(trace_path, ec);
+        if (ec)
+        {
+            derr << trace_path << ": " << ec.message() << '\n';
+            return 1;
+        }
+        key_size = tr.key_size();
+    }
+
+    test_store ts{key_size, block_size, load_factor};
+    basic_store<xxhasher, slow_file<native_file>> db;
+    db.parallel_sync(parallel_sync);
+    ts.create(ec);
+    if (!ec)
+        db.open(ts.dp, ts.kp, ts.lp, 16 * 1024 * 1024, ec, delays);
+    std::vector<thread_latencies> latencies(options.threads);
+    for (auto& t : latencies)
+    {
+        t[index(trace_op::fetch)].name = "fetch";
+        t[index(trace_op::insert)].name = "insert";
+        t[index(trace_op::commit)].name = "commit";
+    }
+    replay_info info;
+    if (!ec)
+    {
+        derr << "# Replaying " << trace_path << '\n';
+        replay(db, trace_path, options, info,
+            [&](std::size_t thread, trace_op op,
+                std::chrono::steady_clock::duration d)
+            {
+                latencies[thread][index(op)].latency.add(d);
+            }, ec);
+    }
+    if (!ec)
+        db.close(ec);
+    if (ec)
+    {
+        derr << "Error: " << ec.message() << '\n';
+        return 1;
+    }
+
+    // Combine the threads
+    thread_latencies ops = latencies[0];
+    for (std::size_t i = 1; i < latencies.size(); ++i)
+        for (std::size_t j = 0; j < ops.size(); ++j)
+            ops[j].latency.merge(latencies[i][j].latency);
+    for (auto& op : ops)
+        op.latency.sort();
+
+    auto const col_w = 14;
+    auto const elapsed = std::max(info.elapsed.count(), 1e-9);
+    dout << "replay (nudb, " << options.threads << " threads, speed ";
+    if (options.speed > 0)
+        dout << options.speed;
+    else
+        dout << "max";
+    if (parallel_sync)
+        dout << ", parallel sync";
+    dout << ", " << info.records << " records over "
+        << std::fixed << std::setprecision(2) << info.duration.count()
+        << "s, played in " << elapsed << "s)\n";
+    dout << std::setw(8) << "op"
+        << std::setw(col_w) << "count"
+        << std::setw(col_w) << "per second"
+        << std::setw(col_w) << "p50 (us)"
+        << std::setw(col_w) << "p99 (us)"
+        << std::setw(col_w) << "p999 (us)"
+        << std::setw(col_w) << "max (us)" << '\n';
+    for (auto const& op : ops)
+        dout << std::setw(8) << op.name
+            << std::setw(col_w) << op.latency.size()
+            << std::fixed << std::setprecision(2)
+            << std::setw(col_w) << op.latency.size() / elapsed
+            << std::setw(col_w) << op.latency.percentile(0.5)
+            << std::setw(col_w) << op.latency.percentile(0.99)
+            << std::setw(col_w) << op.latency.percentile(0.999)
+            << std::setw(col_w) << op.latency.percentile(1) << '\n';
+    dout << "preloaded " << info.preloaded
+        << ", fetch misses " << info.fetch_misses
+        << ", fetches differing from the trace " << info.mismatches
+        << ", duplicate inserts " << info.duplicates
+        << ", max lag " << std::setprecision(3)
+        << info.max_lag.count() * 1000 << "ms\n";
+    if (delays.total().count() > 0)
+        dout << "file delays added " << std::chrono::duration<double>(
+            delays.total()).count() << "s\n";
+
+    if (!json_path.empty())
+    {
+        std::ofstream os{json_path};
+        json_writer w{os};
+        w.begin_object();
+        w.field("program", "replay");
+        w.field("revision", revision);
+        w.field("time", static_cast<std::uint64_t>(std::time(nullptr)));
+        w.key("config");
+        w.begin_object();
+        w.field("trace", boost::filesystem::path(trace_path).filename().string());
+        w.field("speed", options.speed);
+        w.field("threads", options.threads);
+        w.field("preload", options.preload);
+        w.field("key_size", key_size);
+        w.field("block_size", block_size);
+        w.field("load_factor", double(load_factor));
+        w.field("read_delay", delays.read.str());
+        w.field("write_delay", delays.write.str());
+        w.field("sync_delay", delays.sync.str());
+        w.field("trunc_delay", delays.trunc.str());
+        w.field("parallel_sync", parallel_sync);
+        w.end_object();
+        w.key("results");
+        w.begin_array();
+        w.begin_object();
+        w.field("db", "nudb");
+        w.field("keys", "trace");
+        w.field("records", info.records);
+        w.field("preloaded", info.preloaded);
+        w.field("mismatches", info.mismatches);
+        w.field("max_lag_ms", info.max_lag.count() * 1000);
+        w.key("phases");
+        w.begin_object();
+        for (auto const& op : ops)
+        {
+            w.key(op.name);
+            w.begin_object();
+            w.field("count", op.latency.size());
+            w.field("per_second", op.latency.size() / elapsed);
+            w.field("p50_us", op.latency.percentile(0.5));
+            w.field("p99_us", op.latency.percentile(0.99));
+            w.field("p999_us", op.latency.percentile(0.999));
+            w.end_object();
+        }
+        w.end_object();
+        w.end_object();
+        w.end_array();
+        w.end_object();
+        if (!os)
+        {
+            derr << "Error writing " << json_path << '\n';
+            return 1;
+        }
+    }
+}
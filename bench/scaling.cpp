@@ -0,0 +1,406 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures fetch throughput as the number of reader threads
+// grows, while a writer keeps the store committing.
+
+#include <nudb/test/item_generator.hpp>
+#include <nudb/test/key_distribution.hpp>
+#include <nudb/test/test_store.hpp>
+#include <nudb/detail/gentex.hpp>
+#include "bench_util.hpp"
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nudb {
+namespace test {
+
+using clock_type = std::chrono::steady_clock;
+
+// Time spent by threads acquiring the store's locks, in nanoseconds
+struct lock_stats
+{
+    std::atomic<std::uint64_t> shared_wait{0};  // m_ shared, by fetch
+    std::atomic<std::uint64_t> unique_wait{0};  // m_ exclusive
+    std::atomic<std::uint64_t> gen_wait{0};     // g_ generation locks, by fetch
+    std::atomic<std::uint64_t> finish_wait{0};  // g_ finish, by commit
+    std::atomic<std::uint64_t> commits{0};
+
+    void
+    reset()
+    {
+        shared_wait = 0;
+        unique_wait = 0;
+        gen_wait = 0;
+        finish_wait = 0;
+        commits = 0;
+    }
+
+    static
+    void
+    add(std::atomic<std::uint64_t>& total, clock_type::time_point start)
+    {
+        total += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_type::now() - start).count();
+    }
+};
+
+lock_stats&
+stats()
+{
+    static lock_stats s;
+    return s;
+}
+
+// Set on the threads which fetch, so that waits by
+// inserts, which also lock m_ shared and g_, are not
+// counted in the waits reported per fetch.
+thread_local bool is_reader = false;
+
+// A shared mutex which records the time taken to lock it
+class timed_shared_mutex
+{
+    boost::shared_mutex m_;
+
+public:
+    void
+    lock()
+    {
+        auto const start = clock_type::now();
+        m_.lock();
+        lock_stats::add(stats().unique_wait, start);
+    }
+
+    bool
+    try_lock()
+    {
+        return m_.try_lock();
+    }
+
+    void
+    unlock()
+    {
+        m_.unlock();
+    }
+
+    void
+    lock_shared()
+    {
+        auto const start = clock_type::now();
+        m_.lock_shared();
+        if (is_reader)
+            lock_stats::add(stats().shared_wait, start);
+    }
+
+    bool
+    try_lock_shared()
+    {
+        return m_.try_lock_shared();
+    }
+
+    void
+    unlock_shared()
+    {
+        m_.unlock_shared();
+    }
+};
+
+// A gentex which records the time taken by each operation
+class timed_gentex
+{
+    detail::gentex g_;
+
+public:
+    void
+    start()
+    {
+        g_.start();
+    }
+
+    void
+    finish()
+    {
+        auto const start = clock_type::now();
+        g_.finish();
+        lock_stats::add(stats().finish_wait, start);
+        ++stats().commits;
+    }
+
+    std::size_t
+    lock_gen()
+    {
+        auto const start = clock_type::now();
+        auto const gen = g_.lock_gen();
+        if (is_reader)
+            lock_stats::add(stats().gen_wait, start);
+        return gen;
+    }
+
+    void
+    unlock_gen(std::size_t gen)
+    {
+        auto const start = clock_type::now();
+        g_.unlock_gen(gen);
+        if (is_reader)
+            lock_stats::add(stats().gen_wait, start);
+    }
+};
+
+// The multi_thread policy, with instrumented locks
+struct timed_policy
+{
+    static bool constexpr background = true;
+    using mutex_type = std::mutex;
+    using shared_mutex_type = timed_shared_mutex;
+    using gentex_type = timed_gentex;
+};
+
+using timed_store = basic_test_store<native_file, timed_policy>;
+
+struct step_result
+{
+    std::size_t readers = 0;
+    std::uint64_t fetches = 0;
+    std::uint64_t inserts = 0;
+    std::chrono::duration<double> elapsed{0};
+    std::uint64_t shared_wait = 0;
+    std::uint64_t unique_wait = 0;
+    std::uint64_t gen_wait = 0;
+    std::uint64_t finish_wait = 0;
+    std::uint64_t commits = 0;
+};
+
+// Run readers fetching existing keys for a while, as a
+// writer inserts batches and commits after each one.
+step_result
+run_step(timed_store& ts, item_generator const& items,
+    key_distribution const& keys, std::uint64_t num_keys,
+        std::uint64_t& next, std::size_t readers, std::size_t batch,
+            std::chrono::duration<double> duration, error_code& ec)
+{
+    step_result result;
+    result.readers = readers;
+    std::mutex m;
+    std::atomic<bool> stop{false};
+    auto const set_error = [&](error_code const& ev)
+    {
+        std::lock_guard<std::mutex> lock{m};
+        if (!ec)
+            ec = ev;
+        stop = true;
+    };
+    std::vector<std::uint64_t> fetches(readers);
+    std::vector<std::thread> threads;
+    stats().reset();
+    auto const start = clock_type::now();
+    for (std::size_t r = 0; r < readers; ++r)
+        threads.emplace_back([&, r]
+        {
+            is_reader = true;
+            xor_shift_engine g{r + 1};
+            Buffer buf;
+            error_code ev;
+            std::uint64_t n = 0;
+            while (!stop)
+            {
+                auto const key = items.key(keys(g, num_keys), buf);
+                ts.db.fetch(key, [](void const*, std::size_t) {}, ev);
+                if (ev)
+                    return set_error(ev);
+                ++n;
+            }
+            fetches[r] = n;
+        });
+    threads.emplace_back([&]
+    {
+        Buffer buf;
+        error_code ev;
+        while (!stop)
+        {
+            for (std::size_t i = 0; i < batch; ++i)
+            {
+                auto const item = items(next++, buf);
+                ts.db.insert(item.key, item.data, item.size, ev);
+                if (ev)
+                    return set_error(ev);
+                ++result.inserts;
+            }
+            ts.db.commit(ev);
+            if (ev)
+                return set_error(ev);
+        }
+    });
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& t : threads)
+        t.join();
+    result.elapsed = clock_type::now() - start;
+    for (auto n : fetches)
+        result.fetches += n;
+    result.shared_wait = stats().shared_wait;
+    result.unique_wait = stats().unique_wait;
+    result.gen_wait = stats().gen_wait;
+    result.finish_wait = stats().finish_wait;
+    result.commits = stats().commits;
+    return result;
+}
+
+void
+print(step_result const& r)
+{
+    auto const col_w = 14;
+    auto const fetches = std::max<std::uint64_t>(r.fetches, 1);
+    auto const commits = std::max<std::uint64_t>(r.commits, 1);
+    auto const rate = r.fetches / r.elapsed.count();
+    dout << std::setw(8) << r.readers
+        << std::fixed << std::setprecision(2)
+        << std::setw(col_w) << rate
+        << std::setw(col_w) << rate / r.readers
+        << std::setw(col_w) << double(r.shared_wait) / fetches
+        << std::setw(col_w) << double(r.gen_wait) / fetches
+        << std::setw(col_w) << r.commits / r.elapsed.count()
+        << std::setw(col_w) << r.finish_wait / 1e6 / commits
+        << std::setw(col_w) << r.unique_wait / 1e6 / r.elapsed.count()
+        << '\n';
+}
+
+} // test
+} // nudb
+
+int
+main(int argc, char** argv)
+{
+    using namespace nudb;
+    using namespace nudb::test;
+
+    auto const cores = std::max(1u, std::thread::hardware_concurrency());
+    po::options_description desc{"Scaling Benchmark Options"};
+    desc.add_options()
+        ("help,h", "Display this message.")
+        ("keys_count", po::value<std::uint64_t>(),
+         "values in the database before the sweep (default: 100000)")
+        ("max_readers", po::value<std::size_t>(),
+         "largest number of reader threads (default: 2 x cores)")
+        ("seconds", po::value<double>(),
+         "time to run each step (default: 2)")
+        ("batch", po::value<std::size_t>(),
+         "inserts by the writer between commits (default: 1000)")
+        ("keys", po::value<std::string>(),
+         "fetched keys: uniform, zipf:THETA, scrambled_zipf:THETA, "
+         "hotspot:KEYS:OPS, or latest:THETA (default: uniform)")
+        ("values", po::value<std::string>(),
+         "value sizes: fixed:N, uniform:MIN:MAX, or "
+         "lognormal:MEDIAN:SIGMA (default: uniform:250:750)")
+        ("block_size", po::value<size_t>(),
+         "nudb block size (default: 4096)")
+        ("key_size", po::value<size_t>(),
+         "key size (default: 64)")
+        ("load_factor", po::value<float>(),
+         "nudb load factor (default: 0.5)")
+        ;
+
+    po::variables_map vm;
+    if (!parse_options(argc, argv, desc, vm))
+        return 0;
+
+    auto const num_keys = get_opt<std::uint64_t>(vm, "keys_count", 100000);
+    auto const max_readers = get_opt<std::size_t>(vm, "max_readers", 2 * cores);
+    auto const seconds = get_opt<double>(vm, "seconds", 2);
+    auto const batch = get_opt<std::size_t>(vm, "batch", 1000);
+    auto const block_size = get_opt<size_t>(vm, "block_size", 4096);
+    auto const key_size = get_opt<size_t>(vm, "key_size", 64);
+    auto const load_factor = get_opt<float>(vm, "load_factor", 0.5f);
+    std::unique_ptr<key_distribution> keys;
+    std::unique_ptr<item_generator> items;
+    try
+    {
+        keys.reset(new key_distribution{
+            get_opt<std::string>(vm, "keys", "uniform")});
+        items.reset(new item_generator{key_size, value_sizes{
+            get_opt<std::string>(vm, "values", "uniform:250:750")}});
+    }
+    catch (std::exception const& e)
+    {
+        derr << e.what() << '\n';
+        return 1;
+    }
+    if (num_keys < 1 || max_readers < 1 || batch < 1)
+    {
+        derr << "keys_count, max_readers and batch must be positive\n";
+        return 1;
+    }
+
+    error_code ec;
+    timed_store ts{key_size, block_size, load_factor};
+    ts.create(ec);
+    if (!ec)
+        ts.open(ec);
+    std::uint64_t next = 0;
+    if (!ec)
+    {
+        Buffer buf;
+        derr << "# Inserting " << num_keys << " values\n";
+        while (next < num_keys && !ec)
+        {
+            auto const item = (*items)(next++, buf);
+            ts.db.insert(item.key, item.data, item.size, ec);
+        }
+    }
+    if (!ec)
+        ts.db.commit(ec);
+    if (ec)
+    {
+        derr << "Error: " << ec.message() << '\n';
+        return 1;
+    }
+
+    std::vector<std::size_t> steps;
+    for (std::size_t n = 1; n < max_readers; n *= 2)
+        steps.push_back(n);
+    steps.push_back(max_readers);
+
+    dout << "fetch scaling (nudb, " << num_keys << " keys, " << cores
+        << " cores, keys " << keys->str() << ", commit every "
+        << batch << " inserts)\n";
+    dout << "# m_ wait and g_ wait: ns per fetch locking m_ shared and g_\n"
+        "# g_ finish: ms per commit waiting for readers of the old buckets\n"
+        "# m_ unique: ms per second inserts and commits spent locking m_\n";
+    dout << std::setw(8) << "readers"
+        << std::setw(14) << "per second"
+        << std::setw(14) << "per reader"
+        << std::setw(14) << "m_ wait"
+        << std::setw(14) << "g_ wait"
+        << std::setw(14) << "commits/s"
+        << std::setw(14) << "g_ finish"
+        << std::setw(14) << "m_ unique"
+        << '\n';
+    for (auto readers : steps)
+    {
+        auto const r = run_step(ts, *items, *keys, num_keys, next,
+            readers, batch, std::chrono::duration<double>{seconds}, ec);
+        if (ec)
+        {
+            derr << "Error: " << ec.message() << '\n';
+            return 1;
+        }
+        print(r);
+    }
+    ts.close(ec);
+    if (ec)
+    {
+        derr << "Error: " << ec.message() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,145 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_TEST_ITEM_GENERATOR_HPP
+#define NUDB_TEST_ITEM_GENERATOR_HPP
+
+#include <nudb/test/test_store.hpp>
+#include <nudb/test/xor_shift_engine.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace nudb {
+namespace test {
+
+/** A distribution of value sizes.
+
+    The distribution is parsed from a string, one of
+    "fixed:N", "uniform:MIN:MAX", or "lognormal:MEDIAN:SIGMA".
+*/
+class value_sizes
+{
+    std::string kind_;
+    double a_;
+    double b_;
+
+public:
+    explicit
+    value_sizes(std::string const& spec)
+        : a_(0), b_(0)
+    {
+        std::istringstream is{spec};
+        std::getline(is, kind_, ':');
+        char colon = ':';
+        is >> a_;
+        if(kind_ != "fixed")
+            is >> colon >> b_;
+        if(! is || colon != ':' || ! is.eof() || a_ < 1 ||
+            (kind_ != "fixed" && kind_ != "uniform" &&
+                kind_ != "lognormal") ||
+            (kind_ == "uniform" && b_ < a_))
+            throw std::invalid_argument(
+                "invalid value size distribution: " + spec);
+    }
+
+    std::string
+    str() const
+    {
+        std::ostringstream os;
+        os << kind_ << ':' << a_;
+        if(kind_ != "fixed")
+            os << ':' << b_;
+        return os.str();
+    }
+
+    template<class Generator>
+    std::size_t
+    operator()(Generator& g) const
+    {
+        double size = a_;
+        if(kind_ == "uniform")
+            size = std::uniform_real_distribution<double>{a_, b_ + 1}(g);
+        else if(kind_ == "lognormal")
+            size = std::lognormal_distribution<double>{
+                std::log(a_), b_}(g);
+        return static_cast<std::size_t>(
+            std::min<double>(std::max<double>(size, 1), 0xffffffff));
+    }
+};
+
+/** Generates the key and value for an index.
+
+    Unlike @ref basic_test_store, the generator has no shared
+    state, so that many threads may produce items at once.
+    The key depends only on the index.
+*/
+class item_generator
+{
+    std::size_t key_size_;
+    value_sizes sizes_;
+
+public:
+    /// Indexes from here on are never inserted by workloads
+    static std::uint64_t constexpr missing = 1ull << 62;
+
+    item_generator(std::size_t key_size, value_sizes const& sizes)
+        : key_size_(key_size)
+        , sizes_(sizes)
+    {
+    }
+
+    item_type
+    operator()(std::uint64_t i, Buffer& buf) const
+    {
+        xor_shift_engine g{i + 1};
+        item_type item;
+        item.size = sizes_(g);
+        auto const needed = key_size_ + item.size;
+        item.key = buf.resize(needed);
+        item.data = item.key + key_size_;
+        fill(item.key, key_size_, g);
+        fill(item.data, item.size, g);
+        return item;
+    }
+
+    /// Returns only the key, which is cheaper
+    std::uint8_t const*
+    key(std::uint64_t i, Buffer& buf) const
+    {
+        xor_shift_engine g{i + 1};
+        sizes_(g);
+        auto const p = buf.resize(key_size_);
+        fill(p, key_size_, g);
+        return p;
+    }
+
+private:
+    static
+    void
+    fill(std::uint8_t* dest, std::size_t size, xor_shift_engine& g)
+    {
+        while(size > 0)
+        {
+            auto const v = g();
+            auto const n = std::min(size, sizeof(v));
+            std::memcpy(dest, &v, n);
+            dest += n;
+            size -= n;
+        }
+    }
+};
+
+} // test
+} // nudb
+
+#endif
@@ -0,0 +1,374 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_TEST_KEY_DISTRIBUTION_HPP
+#define NUDB_TEST_KEY_DISTRIBUTION_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace nudb {
+namespace test {
+
+/*  Distributions of the keys chosen by a workload.
+
+    Keys are identified by their index, from 0 for the first
+    key inserted up to but not including the number of keys
+    in the database. Each distribution returns an index given
+    a random number generator and the current number of keys,
+    which may grow between calls.
+*/
+
+/// Chooses every key with equal probability
+class uniform_keys
+{
+public:
+    template<class Generator>
+    std::uint64_t
+    operator()(Generator& g, std::uint64_t n) const
+    {
+        return std::uniform_int_distribution<
+            std::uint64_t>{0, n - 1}(g);
+    }
+};
+
+/** Chooses keys with a Zipfian distribution.
+
+    The key with index i is chosen with probability
+    proportional to 1 / (i + 1) ^ theta, so the first keys
+    inserted are the most popular. Samples are produced in
+    constant time by rejection-inversion, from Hormann and
+    Derflinger, "Rejection-inversion to generate variates
+    from monotone discrete distributions", 1996.
+*/
+class zipf_keys
+{
+    double theta_;
+    double s_;
+
+public:
+    explicit
+    zipf_keys(double theta = 0.99)
+        : theta_(theta)
+        , s_(2 - h_integral_inverse(h_integral(2.5) - h(2)))
+    {
+        if(! (theta > 0))
+            throw std::domain_error("invalid zipf theta");
+    }
+
+    double
+    theta() const
+    {
+        return theta_;
+    }
+
+    template<class Generator>
+    std::uint64_t
+    operator()(Generator& g, std::uint64_t n) const
+    {
+        auto const hx1 = h_integral(1.5) - 1;
+        auto const hn = h_integral(n + 0.5);
+        std::uniform_real_distribution<double> u01{0, 1};
+        for(;;)
+        {
+            auto const u = hn + u01(g) * (hx1 - hn);
+            auto const x = h_integral_inverse(u);
+            auto k = static_cast<std::uint64_t>(x + 0.5);
+            if(k < 1)
+                k = 1;
+            else if(k > n)
+                k = n;
+            if(k - x <= s_ || u >= h_integral(k + 0.5) - h(k))
+                return k - 1;
+        }
+    }
+
+private:
+    double
+    h(double x) const
+    {
+        return std::exp(-theta_ * std::log(x));
+    }
+
+    double
+    h_integral(double x) const
+    {
+        auto const log_x = std::log(x);
+        return helper2((1 - theta_) * log_x) * log_x;
+    }
+
+    double
+    h_integral_inverse(double x) const
+    {
+        auto t = x * (1 - theta_);
+        if(t < -1)
+            t = -1;
+        return std::exp(helper1(t) * x);
+    }
+
+    // log(1 + x) / x
+    static
+    double
+    helper1(double x)
+    {
+        if(std::abs(x) > 1e-8)
+            return std::log1p(x) / x;
+        return 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+    }
+
+    // (exp(x) - 1) / x
+    static
+    double
+    helper2(double x)
+    {
+        if(std::abs(x) > 1e-8)
+            return std::expm1(x) / x;
+        return 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+    }
+};
+
+/** Chooses keys with a Zipfian distribution over scattered keys.
+
+    The popularity of keys follows @ref zipf_keys, but the
+    popular keys are spread over the whole range of indexes
+    instead of being the first ones inserted.
+*/
+class scrambled_zipf_keys
+{
+    zipf_keys zipf_;
+
+public:
+    explicit
+    scrambled_zipf_keys(double theta = 0.99)
+        : zipf_(theta)
+    {
+    }
+
+    template<class Generator>
+    std::uint64_t
+    operator()(Generator& g, std::uint64_t n) const
+    {
+        return scramble(zipf_(g, n)) % n;
+    }
+
+private:
+    static
+    std::uint64_t
+    scramble(std::uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        return x ^ (x >> 33);
+    }
+};
+
+/** Chooses a fraction of operations from a small set of keys.
+
+    The hot set is the given fraction of keys with the lowest
+    indexes. Each key in the hot set, and each key outside it,
+    is equally likely to be chosen.
+*/
+class hotspot_keys
+{
+    double hot_keys_;
+    double hot_ops_;
+
+public:
+    /** Constructor.
+
+        @param hot_keys The fraction of keys in the hot set.
+
+        @param hot_ops The fraction of operations on the hot set.
+    */
+    explicit
+    hotspot_keys(double hot_keys = 0.2, double hot_ops = 0.8)
+        : hot_keys_(hot_keys)
+        , hot_ops_(hot_ops)
+    {
+        if(! (hot_keys > 0 && hot_keys <= 1 &&
+                hot_ops >= 0 && hot_ops <= 1))
+            throw std::domain_error("invalid hotspot fractions");
+    }
+
+    template<class Generator>
+    std::uint64_t
+    operator()(Generator& g, std::uint64_t n) const
+    {
+        auto hot = static_cast<std::uint64_t>(n * hot_keys_);
+        if(hot < 1)
+            hot = 1;
+        if(hot >= n ||
+            std::uniform_real_distribution<double>{0, 1}(g) < hot_ops_)
+            return std::uniform_int_distribution<
+                std::uint64_t>{0, hot - 1}(g);
+        return std::uniform_int_distribution<
+            std::uint64_t>{hot, n - 1}(g);
+    }
+};
+
+/** Chooses recently inserted keys most often.
+
+    The popularity of keys follows @ref zipf_keys, counting
+    back from the key inserted last.
+*/
+class latest_keys
+{
+    zipf_keys zipf_;
+
+public:
+    explicit
+    latest_keys(double theta = 0.99)
+        : zipf_(theta)
+    {
+    }
+
+    template<class Generator>
+    std::uint64_t
+    operator()(Generator& g, std::uint64_t n) const
+    {
+        return n - 1 - zipf_(g, n);
+    }
+};
+
+//------------------------------------------------------------------------------
+
+/** A key distribution selected at run time.
+
+    The distribution is parsed from a string such as
+    "uniform", "zipf:0.99", "scrambled_zipf:0.99",
+    "hotspot:0.2:0.8" or "latest:0.99". Parameters
+    which are left out take the default values of
+    the corresponding distribution.
+*/
+class key_distribution
+{
+    enum class kind
+    {
+        uniform,
+        zipf,
+        scrambled_zipf,
+        hotspot,
+        latest
+    };
+
+    kind kind_ = kind::uniform;
+    std::string spec_;
+    zipf_keys zipf_;
+    scrambled_zipf_keys scrambled_zipf_;
+    hotspot_keys hotspot_;
+    latest_keys latest_;
+
+public:
+    explicit
+    key_distribution(std::string const& spec = "uniform");
+
+    /// Returns the string the distribution was parsed from
+    std::string const&
+    str() const
+    {
+        return spec_;
+    }
+
+    template<class Generator>
+    std::uint64_t
+    operator()(Generator& g, std::uint64_t n) const;
+};
+
+inline
+key_distribution::
+key_distribution(std::string const& spec)
+    : spec_(spec)
+{
+    std::istringstream is{spec};
+    std::string name;
+    std::getline(is, name, ':');
+    std::vector<double> args;
+    for(std::string token; std::getline(is, token, ':');)
+    {
+        std::size_t pos = 0;
+        double v = 0;
+        try
+        {
+            v = std::stod(token, &pos);
+        }
+        catch(std::exception const&)
+        {
+        }
+        if(pos == 0 || pos != token.size())
+            throw std::invalid_argument(
+                "invalid key distribution: " + spec);
+        args.push_back(v);
+    }
+    auto const arg =
+        [&](std::size_t i, double value)
+        {
+            return i < args.size() ? args[i] : value;
+        };
+    std::size_t max_args = 1;
+    if(name == "uniform")
+        max_args = 0;
+    else if(name == "zipf")
+    {
+        kind_ = kind::zipf;
+        zipf_ = zipf_keys{arg(0, 0.99)};
+    }
+    else if(name == "scrambled_zipf")
+    {
+        kind_ = kind::scrambled_zipf;
+        scrambled_zipf_ = scrambled_zipf_keys{arg(0, 0.99)};
+    }
+    else if(name == "hotspot")
+    {
+        kind_ = kind::hotspot;
+        hotspot_ = hotspot_keys{arg(0, 0.2), arg(1, 0.8)};
+        max_args = 2;
+    }
+    else if(name == "latest")
+    {
+        kind_ = kind::latest;
+        latest_ = latest_keys{arg(0, 0.99)};
+    }
+    else
+        throw std::invalid_argument(
+            "invalid key distribution: " + spec);
+    if(args.size() > max_args)
+        throw std::invalid_argument(
+            "invalid key distribution: " + spec);
+}
+
+template<class Generator>
+std::uint64_t
+key_distribution::
+operator()(Generator& g, std::uint64_t n) const
+{
+    switch(kind_)
+    {
+    case kind::zipf:
+        return zipf_(g, n);
+    case kind::scrambled_zipf:
+        return scrambled_zipf_(g, n);
+    case kind::hotspot:
+        return hotspot_(g, n);
+    case kind::latest:
+        return latest_(g, n);
+    default:
+        break;
+    }
+    return uniform_keys{}(g, n);
+}
+
+} // test
+} // nudb
+
+#endif
@@ -0,0 +1,391 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_TEST_SLOW_FILE_HPP
+#define NUDB_TEST_SLOW_FILE_HPP
+
+#include <nudb/test/xor_shift_engine.hpp>
+#include <nudb/detail/file_hints.hpp>
+#include <nudb/error.hpp>
+#include <nudb/file.hpp>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace nudb {
+namespace test {
+
+/** A distribution of delays added to a kind of file operation.
+
+    The distribution is parsed from a string such as "none",
+    "fixed:US" or "lognormal:MEDIAN:SIGMA", where times are in
+    microseconds. It may be followed by ",stall:N:US", which
+    adds a stall of US microseconds to every Nth operation,
+    to model periodic pauses of a device such as fsync stalls.
+*/
+class delay_distribution
+{
+    enum class kind
+    {
+        none,
+        fixed,
+        lognormal
+    };
+
+    kind kind_ = kind::none;
+    std::string spec_ = "none";
+    double a_ = 0;
+    double b_ = 0;
+    std::uint64_t stall_every_ = 0;
+    double stall_ = 0;
+
+public:
+    delay_distribution() = default;
+
+    explicit
+    delay_distribution(std::string const& spec);
+
+    /// Returns the string the distribution was parsed from
+    std::string const&
+    str() const
+    {
+        return spec_;
+    }
+
+    /// Returns `true` if no operation is delayed
+    bool
+    empty() const
+    {
+        return kind_ == kind::none && stall_every_ == 0;
+    }
+
+    /** Returns the delay for an operation.
+
+        @param g The random number generator to use.
+
+        @param n The ordinal of the operation, starting at 1.
+    */
+    template<class Generator>
+    std::chrono::duration<double, std::micro>
+    operator()(Generator& g, std::uint64_t n) const;
+};
+
+inline
+delay_distribution::
+delay_distribution(std::string const& spec)
+    : spec_(spec)
+{
+    auto const fail =
+        [&]
+        {
+            throw std::invalid_argument(
+                "invalid delay distribution: " + spec);
+        };
+    // Splits "name:arg:arg" into the name and the arguments
+    auto const parse =
+        [&](std::string const& s, std::vector<double>& args)
+        {
+            std::istringstream is{s};
+            std::string name;
+            std::getline(is, name, ':');
+            for(std::string token; std::getline(is, token, ':');)
+            {
+                std::size_t pos = 0;
+                double v = 0;
+                try
+                {
+                    v = std::stod(token, &pos);
+                }
+                catch(std::exception const&)
+                {
+                }
+                if(pos == 0 || pos != token.size() || v < 0)
+                    fail();
+                args.push_back(v);
+            }
+            return name;
+        };
+    auto const comma = spec.find(',');
+    std::vector<double> args;
+    auto const name = parse(spec.substr(0, comma), args);
+    if(name == "none" && args.empty())
+        kind_ = kind::none;
+    else if(name == "fixed" && args.size() == 1)
+    {
+        kind_ = kind::fixed;
+        a_ = args[0];
+    }
+    else if(name == "lognormal" && args.size() == 2 && args[0] > 0)
+    {
+        kind_ = kind::lognormal;
+        a_ = args[0];
+        b_ = args[1];
+    }
+    else
+        fail();
+    if(comma == std::string::npos)
+        return;
+    args.clear();
+    if(parse(spec.substr(comma + 1), args) != "stall" ||
+            args.size() != 2 || args[0] < 1)
+        fail();
+    stall_every_ = static_cast<std::uint64_t>(args[0]);
+    stall_ = args[1];
+}
+
+template<class Generator>
+std::chrono::duration<double, std::micro>
+delay_distribution::
+operator()(Generator& g, std::uint64_t n) const
+{
+    double us = 0;
+    switch(kind_)
+    {
+    case kind::fixed:
+        us = a_;
+        break;
+    case kind::lognormal:
+        us = std::lognormal_distribution<double>{
+            std::log(a_), b_}(g);
+        break;
+    default:
+        break;
+    }
+    if(stall_every_ != 0 && n % stall_every_ == 0)
+        us += stall_;
+    return std::chrono::duration<double, std::micro>{us};
+}
+
+//------------------------------------------------------------------------------
+
+/** Delays to add to file operations.
+
+    One instance is shared by every @ref slow_file constructed
+    with it. Set the distributions before the files are used.
+    Delays are produced by sleeping the calling thread, so
+    short delays may be lengthened by the scheduler.
+*/
+class slow_file_delays
+{
+    template<class>
+    friend class slow_file;
+
+    std::mutex m_;
+    xor_shift_engine g_;
+    std::atomic<std::uint64_t> reads_{0};
+    std::atomic<std::uint64_t> writes_{0};
+    std::atomic<std::uint64_t> syncs_{0};
+    std::atomic<std::uint64_t> truncs_{0};
+    std::atomic<std::uint64_t> nanos_{0};
+
+public:
+    delay_distribution read;
+    delay_distribution write;
+    delay_distribution sync;
+    delay_distribution trunc;
+
+    slow_file_delays(slow_file_delays const&) = delete;
+    slow_file_delays& operator=(slow_file_delays const&) = delete;
+
+    /// Construct with no delays, seeding the random number generator.
+    explicit
+    slow_file_delays(std::uint64_t seed = 1)
+        : g_(seed)
+    {
+    }
+
+    /// Returns the total delay added so far
+    std::chrono::nanoseconds
+    total() const
+    {
+        return std::chrono::nanoseconds(nanos_.load());
+    }
+
+private:
+    void
+    wait(delay_distribution const& d,
+        std::atomic<std::uint64_t>& count);
+};
+
+inline
+void
+slow_file_delays::
+wait(delay_distribution const& d,
+    std::atomic<std::uint64_t>& count)
+{
+    if(d.empty())
+        return;
+    std::chrono::nanoseconds delay;
+    {
+        std::lock_guard<std::mutex> lock{m_};
+        delay = std::chrono::duration_cast<
+            std::chrono::nanoseconds>(d(g_, ++count));
+    }
+    if(delay.count() <= 0)
+        return;
+    nanos_ += delay.count();
+    std::this_thread::sleep_for(delay);
+}
+
+/** A file wrapper to simulate slow storage.
+
+    This wraps an object meeting the requirements of File. Before
+    each read, write, sync, or truncation, the calling thread is
+    delayed by an amount chosen from the corresponding distribution
+    in the @ref slow_file_delays given on construction. This allows
+    the effect of slow disks, or of stalls, on commit and fetch
+    latency to be measured without special hardware.
+*/
+template<class File>
+class slow_file
+{
+    File f_;
+    slow_file_delays* d_ = nullptr;
+
+public:
+    slow_file() = default;
+    slow_file(slow_file const&) = delete;
+    slow_file& operator=(slow_file const&) = delete;
+    ~slow_file() = default;
+
+    slow_file(slow_file&&);
+
+    slow_file&
+    operator=(slow_file&& other);
+
+    template<class... Args>
+    explicit
+    slow_file(slow_file_delays& d, Args&&... args);
+
+    bool
+    is_open() const
+    {
+        return f_.is_open();
+    }
+
+    std::uint64_t
+    size(error_code& ec) const
+    {
+        return f_.size(ec);
+    }
+
+    void
+    close()
+    {
+        f_.close();
+    }
+
+    void
+    create(file_mode mode, path_type const& path, error_code& ec)
+    {
+        return f_.create(mode, path, ec);
+    }
+
+    void
+    open(file_mode mode, path_type const& path, error_code& ec)
+    {
+        return f_.open(mode, path, ec);
+    }
+
+    static
+    void
+    erase(path_type const& path, error_code& ec)
+    {
+        File::erase(path, ec);
+    }
+
+    void
+    read(std::uint64_t offset,
+        void* buffer, std::size_t bytes, error_code& ec)
+    {
+        if(d_)
+            d_->wait(d_->read, d_->reads_);
+        f_.read(offset, buffer, bytes, ec);
+    }
+
+    void
+    write(std::uint64_t offset,
+        void const* buffer, std::size_t bytes, error_code& ec)
+    {
+        if(d_)
+            d_->wait(d_->write, d_->writes_);
+        f_.write(offset, buffer, bytes, ec);
+    }
+
+    void
+    sync(error_code& ec)
+    {
+        if(d_)
+            d_->wait(d_->sync, d_->syncs_);
+        f_.sync(ec);
+    }
+
+    void
+    trunc(std::uint64_t length, error_code& ec)
+    {
+        if(d_)
+            d_->wait(d_->trunc, d_->truncs_);
+        f_.trunc(length, ec);
+    }
+
+    void
+    prefetch(std::uint64_t offset,
+        std::size_t bytes, error_code& ec)
+    {
+        detail::prefetch(f_, offset, bytes, ec);
+    }
+
+    void
+    allocate(std::uint64_t offset,
+        std::uint64_t bytes, error_code& ec)
+    {
+        detail::allocate(f_, offset, bytes, ec);
+    }
+};
+
+template<class File>
+slow_file<File>::
+slow_file(slow_file&& other)
+    : f_(std::move(other.f_))
+    , d_(other.d_)
+{
+    other.d_ = nullptr;
+}
+
+template<class File>
+slow_file<File>&
+slow_file<File>::
+operator=(slow_file&& other)
+{
+    f_ = std::move(other.f_);
+    d_ = other.d_;
+    other.d_ = nullptr;
+    return *this;
+}
+
+template<class File>
+template<class... Args>
+slow_file<File>::
+slow_file(slow_file_delays& d, Args&&... args)
+    : f_(std::forward<Args>(args)...)
+    , d_(&d)
+{
+}
+
+} // test
+} // nudb
+
+#endif
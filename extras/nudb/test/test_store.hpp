@@ -192,7 +192,7 @@ struct item_type
 };
    
 /// Interface to facilitate tests
-template<class File>
+template<class File, class Policy = multi_thread>
 class basic_test_store
 {
     using Hasher = xxhasher;
@@ -212,7 +212,7 @@ public:
     float const loadFactor;
     static std::uint64_t constexpr appnum = 1;
     static std::uint64_t constexpr salt = 42;
-    basic_store<xxhasher, File> db;
+    basic_store<xxhasher, File, Policy> db;
 
     template<class... Args>
     basic_test_store(std::size_t keySize,
@@ -247,9 +247,9 @@ private:
         void* dest, std::size_t size, Generator& g);
 };
 
-template<class File>
+template<class File, class Policy>
 template<class... Args>
-basic_test_store<File>::
+basic_test_store<File, Policy>::
 basic_test_store(std::size_t keySize_, std::size_t blockSize_,
         float loadFactor_, Args&&... args)
     : sizef_(250, 750)
@@ -276,16 +276,16 @@ basic_test_store(std::size_t keySize_, std::size_t blockSize_,
 {
 }
 
-template<class File>
-basic_test_store<File>::
+template<class File, class Policy>
+basic_test_store<File, Policy>::
 ~basic_test_store()
 {
     erase();
 }
 
-template<class File>
+template<class File, class Policy>
 auto
-basic_test_store<File>::
+basic_test_store<File, Policy>::
 operator[](std::uint64_t i) ->
     item_type
 {
@@ -301,17 +301,17 @@ operator[](std::uint64_t i) ->
     return item;
 }
 
-template<class File>
+template<class File, class Policy>
 void
-basic_test_store<File>::
+basic_test_store<File, Policy>::
 create(error_code& ec)
 {
     createf_(ec);
 }
 
-template<class File>
+template<class File, class Policy>
 void
-basic_test_store<File>::
+basic_test_store<File, Policy>::
 open(error_code& ec)
 {
     openf_(ec);
@@ -323,20 +323,20 @@ open(error_code& ec)
         ec = error::invalid_block_size;
 }
 
-template<class File>
+template<class File, class Policy>
 void
-basic_test_store<File>::
+basic_test_store<File, Policy>::
 erase()
 {
-    erase_file(dp);
-    erase_file(kp);
-    erase_file(lp);
+    erase_file<File>(dp);
+    erase_file<File>(kp);
+    erase_file<File>(lp);
 }
 
-template<class File>
+template<class File, class Policy>
 template<class Generator>
 void
-basic_test_store<File>::
+basic_test_store<File, Policy>::
 rngfill(
     void* dest, std::size_t size, Generator& g)
 {
@@ -8,16 +8,26 @@
 #ifndef NUDB_BASIC_STORE_HPP
 #define NUDB_BASIC_STORE_HPP
 
+#include <nudb/commit_executor.hpp>
 #include <nudb/file.hpp>
+#include <nudb/rate_limiter.hpp>
+#include <nudb/thread_policy.hpp>
+#include <nudb/trace.hpp>
 #include <nudb/type_traits.hpp>
+#include <nudb/write_batch.hpp>
+#include <nudb/detail/bucket_cache.hpp>
 #include <nudb/detail/cache.hpp>
-#include <nudb/detail/gentex.hpp>
+#include <nudb/detail/io_priority.hpp>
+#include <nudb/detail/key_image.hpp>
 #include <nudb/detail/pool.hpp>
+#include <nudb/detail/recent_cache.hpp>
 #include <boost/optional.hpp>
 #include <boost/thread/lock_types.hpp>
-#include <boost/thread/shared_mutex.hpp>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <string>
 #include <thread>
 
 namespace nudb {
@@ -27,23 +37,57 @@ namespace nudb {
     @tparam Hasher The hash function to use on key
 
     @tparam File The type of File object to use.
+
+    @tparam Policy The thread policy, either @ref multi_thread
+    or @ref single_thread.
 */
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy = multi_thread>
 class basic_store
 {
 public:
     using hash_type = Hasher;
     using file_type = File;
+    using policy_type = Policy;
 
 private:
     using clock_type =
         std::chrono::steady_clock;
 
+    using mutex_type =
+        typename Policy::mutex_type;
+
+    using shared_mutex_type =
+        typename Policy::shared_mutex_type;
+
+    using gentex_type =
+        typename Policy::gentex_type;
+
     using shared_lock_type =
-        boost::shared_lock<boost::shared_mutex>;
+        boost::shared_lock<shared_mutex_type>;
 
     using unique_lock_type =
-        boost::unique_lock<boost::shared_mutex>;
+        boost::unique_lock<shared_mutex_type>;
+
+    // Holds values too large for the arena until
+    // they are appended to the data file by commit.
+    struct stage_file
+    {
+        File f;
+        path_type path;
+        noff_t size = 0;
+
+        stage_file(stage_file const&) = delete;
+        stage_file& operator=(stage_file const&) = delete;
+
+        stage_file(stage_file&&) = default;
+        stage_file& operator=(stage_file&&) = default;
+
+        stage_file(File&& f_, path_type const& path_)
+            : f(std::move(f_))
+            , path(path_)
+        {
+        }
+    };
 
     struct state
     {
@@ -58,11 +102,25 @@ private:
         detail::pool p1;
         detail::cache c0;
         detail::cache c1;
+        stage_file sf0;     // staged values in p0
+        stage_file sf1;     // staged values in p1
         detail::key_file_header kh;
 
         // pool commit high water mark
         std::size_t pool_thresh = 1;
 
+        // values larger than this are staged
+        std::size_t stage_thresh;
+
+        // copies of recently committed values
+        detail::recent_cache recent;
+
+        // copy of the key file when resident
+        detail::key_image ki;
+
+        // second level bucket cache, if open
+        detail::bucket_cache<File> bc;
+
         state(state const&) = delete;
         state& operator=(state const&) = delete;
 
@@ -70,6 +128,7 @@ private:
         state& operator=(state&&) = default;
 
         state(File&& df_, File&& kf_, File&& lf_,
+            File&& sf0_, File&& sf1_, File&& bc_,
             path_type const& dp_, path_type const& kp_,
                 path_type const& lp_,
                     detail::key_file_header const& kh_,
@@ -88,10 +147,13 @@ private:
     nbuck_t buckets_;               // number of buckets
     nbuck_t modulus_;               // hash modulus
 
-    std::mutex u_;                  // serializes insert()
-    detail::gentex g_;
-    boost::shared_mutex m_;
+    mutex_type u_;                  // serializes insert()
+    mutex_type cm_;                 // serializes commit()
+    gentex_type g_;
+    mutable shared_mutex_type m_;
     std::thread thread_;
+    std::thread warm_thread_;
+    std::atomic<bool> warm_stop_{false}; // cancels warm_thread_
     std::condition_variable_any cond_;
 
     // These allow insert to block, preventing the pool
@@ -101,6 +163,66 @@ private:
     std::size_t commit_limit_ = 1UL * 1024 * 1024 * 1024;
     std::condition_variable_any cond_limit_;
 
+    // Insert started by insert_prepare or a streaming
+    // insert. While set, u_ is held and the commit
+    // thread may not swap the pools.
+    boost::optional<detail::pool::value_type> pending_;
+    std::unique_lock<mutex_type> pending_lock_;
+    std::atomic<std::thread::id> pending_thread_{};
+    std::condition_variable_any cond_pending_;
+
+    // Bytes of committed values kept for fetch
+    std::atomic<std::size_t> recent_limit_{0};
+
+    // `true` to hold the key file in memory
+    bool resident_ = false;
+
+    // Second level bucket cache file
+    path_type bucket_cache_path_;
+    std::uint64_t bucket_cache_size_ = 0;
+
+    // Set when an operation on the cache file fails. The
+    // cache is only an optimization, so it stops being
+    // used, and is discarded at the next open.
+    std::atomic<bool> bc_failed_{false};
+
+    // Shared commit threads, used instead of thread_
+    commit_executor* ex_ = nullptr;
+    std::string device_;
+    std::size_t ex_id_ = 0;
+    bool released_ = false;         // memory released while idle
+
+    // Throttles commit writes, or null
+    rate_limiter* limiter_ = nullptr;
+
+    // Records operations, or null
+    trace_writer* tracer_ = nullptr;
+
+    // Longest time a commit write waits for
+    // fetches reading from disk, zero to disable.
+    std::chrono::microseconds read_priority_{0};
+    std::atomic<std::size_t> readers_{0};
+    std::mutex readers_m_;
+    std::condition_variable readers_cv_; // signals readers_ reached zero
+
+    // Time the current commit may still spend waiting
+    std::chrono::steady_clock::duration read_wait_left_{};
+
+    // `true` to sync the data file on a helper thread
+    bool parallel_sync_ = false;
+
+    // Size of the reusable log file, or zero
+    // to truncate the log after each commit.
+    std::uint64_t log_reserve_ = 0;
+    std::uint64_t log_sequence_ = 0;
+
+    // Sizes in which to allocate storage ahead of
+    // the data and key files, or zero to disable.
+    std::uint64_t dat_extent_ = 0;
+    std::uint64_t key_extent_ = 0;
+    noff_t dat_allocated_ = 0;
+    noff_t key_allocated_ = 0;
+
     error_code ec_;
     std::atomic<bool> ecb_;         // `true` when ec_ set
 
@@ -228,12 +350,297 @@ public:
     std::size_t
     block_size() const;
 
+    /** Return `true` if the key file is held in memory.
+
+        Thread safety:
+            Undefined behavior if called concurrently with
+            @ref resident(bool).
+    */
+    bool
+    resident() const
+    {
+        return resident_;
+    }
+
+    /** Set whether the key file is held in memory.
+
+        When enabled, @ref open reads the entire key file into
+        memory. Fetches and inserts then find buckets in memory
+        instead of reading them from the key file, so a fetch
+        costs one read of the data file plus any spill records.
+        Commits update the copy in memory as well as the key
+        file. The memory used grows with the key file and can be
+        queried with @ref resident_size. Disabled by default.
+
+        Preconditions:
+            The database must not be open.
+
+        @param enable `true` to hold the key file in memory.
+    */
+    void
+    resident(bool enable);
+
+    /** Return the memory used to hold the key file.
+
+        Preconditions:
+            The database must be open.
+
+        Thread safety:
+            Safe to call concurrently with any function
+            except @ref open or @ref close.
+
+        @return The number of bytes allocated, or zero
+        if the key file is not held in memory.
+    */
+    std::size_t
+    resident_size() const;
+
+    /** Set a second level cache file for key file buckets.
+
+        When set, @ref open opens or creates a cache file at the
+        given path, typically on a device faster than the one
+        holding the key file. Buckets which fetch and insert read
+        from the key file are copied into the cache file, and
+        buckets changed by a commit are written to it, so later
+        reads of those buckets come from the faster device.
+
+        The cache file is reused across opens only if the
+        database was closed cleanly with the cache in use, and
+        the key file and data file have not changed since.
+        Otherwise its contents are discarded. The cache is
+        not used when the key file is held in memory.
+
+        If reading or writing the cache file fails after it is
+        opened, the cache stops being used until the database
+        is opened again, and fetches and commits continue to
+        use the key file.
+
+        Preconditions:
+            The database must not be open.
+
+        @param path The path of the cache file, or an empty
+        string to disable the cache.
+
+        @param bytes The approximate size of the cache file.
+    */
+    void
+    bucket_cache(path_type const& path, std::uint64_t bytes);
+
+    /** Set a shared executor to commit inserted data.
+
+        When set, @ref open does not start a thread for the
+        database. Instead, commits are run by the threads of
+        the executor, which may be shared by many databases.
+        Commits for databases given the same device name do
+        not exceed the executor's limit on concurrent commits
+        per device.
+
+        Preconditions:
+            The database must not be open. The thread policy
+            must be @ref multi_thread. The executor must
+            outlive the next call to @ref close.
+
+        @param ex The executor to use.
+
+        @param device A name for the device holding the
+        database files. Databases on the same device should
+        use the same name.
+    */
+    void
+    executor(commit_executor& ex,
+        std::string const& device = {});
+
+    /** Set a rate limiter for commit writes.
+
+        When set, writes to the data, key, and log files made
+        while committing take tokens from the limiter, so that
+        commits do not starve reads of the same device. Fetches
+        are never limited. A limiter may be shared with other
+        databases, or with operations such as @ref verify given
+        a @ref rate_limited_file.
+
+        Setting a limiter may allow the pool of inserted data
+        to grow while a commit waits, until inserts block on
+        the commit limit.
+
+        Preconditions:
+            The database must not be open.
+
+        @param r The limiter to use, or `nullptr` for none.
+        The limiter must outlive the next call to @ref close.
+    */
+    void
+    commit_rate(rate_limiter* r);
+
+    /** Record operations to a trace.
+
+        When set, each fetch, each successful insert, and each
+        call to @ref commit is recorded by the writer after it
+        finishes, with the key, the size of the value, and the
+        time. Fetches record the size of the value found, or
+        zero if the key was not found or an error occurred.
+        Commits made by the background thread are not recorded.
+        The trace may be played back against another database
+        using @ref replay.
+
+        Recording takes a lock for each operation, which may
+        limit the rate of concurrent fetches.
+
+        Preconditions:
+            The database must not be open. The key size of
+            the writer must equal that of the database, or
+            @ref open fails with @ref error::key_size_mismatch.
+
+        @param w The writer to use, or `nullptr` for none.
+        The writer must outlive the next call to @ref close.
+    */
+    void
+    trace(trace_writer* w);
+
+    /** Give fetches priority over commit writes.
+
+        When enabled, each write made while committing first
+        waits, up to the given time, for fetches which are
+        reading from disk to finish. Commit writes are issued
+        in slices of at most a few dozen blocks, so this bounds
+        how long a fetch queues behind a commit. The thread
+        started by @ref open also lowers its I/O priority,
+        where the operating system supports it.
+
+        Enabling this may lengthen commits while fetches are
+        frequent, until inserts block on the commit limit.
+        The waits made by one commit add up to at most 64
+        times the given time, however many slices it writes.
+
+        Preconditions:
+            The database must not be open.
+
+        @param max_wait The longest time to delay each write,
+        or zero to disable.
+    */
+    void
+    read_priority(std::chrono::microseconds max_wait);
+
+    /** Sync the data file concurrently with the key and log files.
+
+        When enabled, each commit syncs the data file on a
+        helper thread as soon as all of its writes are issued,
+        while the log file and key file are written and synced.
+        The log file is truncated only after both syncs finish,
+        so recovery is unaffected. This shortens commits on
+        devices where each sync is slow, at the cost of
+        starting a thread for each commit.
+
+        This is disabled by default. The `--parallel_sync`
+        option of the replay benchmark measures the effect
+        on commit latency, together with `--sync_delay`.
+
+        Preconditions:
+            The database must not be open.
+
+        @param value `true` to sync concurrently.
+    */
+    void
+    parallel_sync(bool value);
+
+    /** Keep the log file between commits.
+
+        Normally each commit finishes by truncating the log
+        file, @ref open creates it, and @ref close erases it.
+        When enabled, the log file is instead allocated to
+        at least the given size when the database is opened,
+        and kept when it is closed. Each commit writes over
+        the previous contents, and finishes by marking the
+        log as unused in its header. Records left by earlier
+        commits are ignored by @ref recover, using a sequence
+        number and a checksum stored in every record.
+
+        This avoids the file system work of shrinking and
+        growing the log file on every commit. The log file
+        written in this mode cannot be recovered by versions
+        of the library which do not support it.
+
+        Preconditions:
+            The database must not be open.
+
+        @param bytes The size to allocate for the log file,
+        or zero to truncate the log after each commit.
+    */
+    void
+    reusable_log(std::uint64_t bytes);
+
+    /** Allocate storage ahead of the data and key files.
+
+        Normally the data file grows with each bulk write past
+        its end, and the key file grows one block at a time as
+        buckets split, which can leave long-lived files spread
+        over a very large number of extents. When enabled, a
+        commit which would write past the allocated storage
+        first allocates the file system blocks for the next
+        whole extent, if the @b File type supports it. The
+        size of each file is not changed, so the files have the
+        same contents as without this setting. Storage allocated
+        past the end of a file remains in use after it closes.
+
+        Preconditions:
+            The database must not be open.
+
+        @param dat_bytes The extent size for the data file,
+        or zero to disable.
+
+        @param key_bytes The extent size for the key file,
+        or zero to disable.
+    */
+    void
+    preallocate(std::uint64_t dat_bytes,
+        std::uint64_t key_bytes);
+
+    /** Return the size of the recently committed cache.
+
+        Thread safety:
+            Safe to call concurrently with any function
+            except @ref recent_limit(std::size_t).
+
+        @return The limit in bytes, or zero if disabled.
+    */
+    std::size_t
+    recent_limit() const
+    {
+        return recent_limit_.load();
+    }
+
+    /** Set the size of the recently committed cache.
+
+        When enabled, copies of the key/value pairs written by
+        each commit are kept in memory afterwards, up to the
+        specified number of bytes, so that @ref fetch of
+        recently inserted keys does not need to read from
+        disk. The copies are looked up by the hash of the
+        key, and the oldest are discarded first. The limit
+        counts every allocation made for the copies,
+        including the memory used to index them. The cache
+        is disabled by default.
+
+        Thread safety:
+            Safe to call concurrently with @ref fetch
+            and @ref insert.
+
+        @param bytes The limit on the memory used by the
+        cache, or zero to disable the cache.
+    */
+    void
+    recent_limit(std::size_t bytes);
+
     /** Close the database.
 
         All data is committed before closing.
 
         If an error occurs, the database is still closed.
 
+        Preconditions:
+            No insert started by @ref insert_prepare
+            may be in progress.
+
         @param ec Set to the error, if any occurred.
     */
     void
@@ -316,6 +723,79 @@ public:
     void
     fetch(void const* key, Callback && callback, error_code& ec);
 
+    /** Load the key file into the operating system cache.
+
+        This function starts a background thread which reads
+        the key file sequentially using large reads, so that
+        fetches soon after opening the database do not each
+        wait for a random read from the disk. The database may
+        be used normally while the key file is warming. The
+        thread stops early when the database is closed. Errors
+        encountered while warming end the warming silently.
+
+        Preconditions:
+            The database must be open. No previous warming
+            may have been started since the database was opened.
+
+        Thread safety:
+            Safe to call concurrently with any function
+            except @ref open or @ref close.
+
+        @param bufferSize The number of bytes to read at a time.
+
+        @param progress A function which will be called on the
+        background thread as the key file is read. The equivalent
+        signature of the progress function must be:
+        @code
+        void progress(
+            std::uint64_t amount,   // Amount of work done so far
+            std::uint64_t total     // Total amount of work to do
+        );
+        @endcode
+    */
+    template<class Progress>
+    void
+    warm(std::size_t bufferSize, Progress&& progress);
+
+    /** Hint that keys will be fetched soon.
+
+        For each key which is not held in memory, this function
+        asks the operating system to begin reading the key file
+        bucket the key hashes to, without waiting for it, so
+        that a later call to @ref fetch finds the data already
+        cached. Hints are ignored if the `File` type does not
+        provide the optional member function:
+        @code
+        void prefetch(
+            std::uint64_t offset,   // The offset to read from
+            std::size_t bytes,      // The number of bytes
+            error_code& ec          // Set to the error, if any
+        );
+        @endcode
+
+        Preconditions:
+            The database must be open.
+
+        Thread safety:
+            Safe to call concurrently with any function
+            except @ref open or @ref close.
+
+        @param keys An array of pointers to buffers holding the
+        keys. The size of each buffer should be at least the
+        `key_size` associated with the open database.
+
+        @param n The number of keys.
+
+        @param values If `true`, the buckets are read and the
+        data file records of matching entries are also hinted.
+        This function then blocks while reading the key file.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    prefetch(void const* const* keys, std::size_t n,
+        bool values, error_code& ec);
+
     /** Insert a value.
 
         This function attempts to insert the specified key/value
@@ -351,7 +831,186 @@ public:
     insert(void const* key, void const* data,
         nsize_t bytes, error_code& ec);
 
+    /** Begin inserting a value in place.
+
+        This function checks that the key does not already
+        exist, then allocates space for the value in the
+        memory used to buffer insertions and returns it.
+        The caller writes exactly `bytes` bytes of value
+        data to the returned buffer and then calls
+        @ref insert_commit to make the value visible, or
+        @ref insert_cancel to abandon it. This avoids the
+        copy performed by @ref insert when the value is
+        produced by a serializer.
+
+        Until the insert is completed, other inserts block
+        and the background commit is deferred, so the value
+        should be written promptly.
+
+        Preconditions:
+            The database must be open. No other insert
+            started by this function may be in progress.
+
+        Thread safety:
+            May be used concurrently with @ref fetch.
+            @ref insert_commit or @ref insert_cancel must
+            be called from the same thread.
+
+        @param key A buffer holding the key to be inserted. The
+        size of the buffer should be at least the `key_size`
+        associated with the open database.
+
+        @param bytes The size of the value data. This value must
+        be greater than 0 and no more than 0xffffffff.
+
+        @param ec Set to the error, if any occurred. If the key
+        already exists, this is set to @ref error::key_exists.
+
+        @return A buffer of `bytes` bytes to receive the value
+        data, or `nullptr` if an error occurred.
+    */
+    void*
+    insert_prepare(void const* key, nsize_t bytes, error_code& ec);
+
+    /** Complete an insert started by @ref insert_prepare.
+
+        The value becomes visible to subsequent calls to
+        @ref fetch.
+
+        Preconditions:
+            An insert started by @ref insert_prepare
+            is in progress.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    insert_commit(error_code& ec);
+
+    /** Abandon an insert started by @ref insert_prepare.
+
+        The key is not inserted. The memory allocated for
+        the value is reclaimed after the next commit.
+
+        Preconditions:
+            An insert started by @ref insert_prepare
+            is in progress.
+    */
+    void
+    insert_cancel();
+
+    /** Insert a value supplied in pieces.
+
+        This function attempts to insert a key/value pair
+        whose value data is produced incrementally by a
+        reader. Values no larger than the arena block size
+        passed to @ref open are read directly into the memory
+        used to buffer insertions. Larger values are staged
+        in a temporary file next to the log file and copied
+        to the data file by the next commit, so they neither
+        occupy memory nor count against the commit limit.
+
+        If the key already exists, `ec` is set to
+        @ref error::key_exists and the reader is not called.
+
+        Until the value is completely read, other inserts
+        block and the background commit is deferred.
+
+        Preconditions:
+            The database must be open.
+
+        Thread safety:
+            Safe to call concurrently with @ref fetch
+            and other inserts.
+
+        @param key A buffer holding the key to be inserted. The
+        size of the buffer should be at least the `key_size`
+        associated with the open database.
+
+        @param bytes The total size of the value data. This
+        value must be greater than 0 and no more than 0xffffffff.
+
+        @param reader A function which will be called one or
+        more times to produce consecutive pieces of the value,
+        in order, until `bytes` bytes have been read. The
+        equivalent signature must be:
+        @code
+        void reader(
+            void* buffer,       // The buffer to fill
+            std::size_t size,   // The exact number of bytes to read
+            error_code& ec      // Set to the error, if any
+        );
+        @endcode
+        If the reader sets `ec`, the insert is abandoned and
+        the error is returned to the caller.
+
+        @param ec Set to the error, if any occurred.
+    */
+    template<class Reader>
+    void
+    insert(void const* key, nsize_t bytes,
+        Reader&& reader, error_code& ec);
+
+    /** Commit inserted data to the database files.
+
+        This function writes all values inserted so far to the
+        data file and updates the key file, returning when the
+        data is durable. With the @ref multi_thread policy, the
+        background thread also commits periodically, and calling
+        this function is only necessary to control when data
+        reaches the disk. With the @ref single_thread policy,
+        inserted data accumulates in memory until this function
+        or @ref close is called.
+
+        @note If an error occurs, all subsequent calls to
+        @ref fetch, @ref insert, and this function will return
+        the same error until the database is closed.
+
+        Preconditions:
+            The database must be open. No insert started by
+            @ref insert_prepare on the calling thread may be
+            in progress, since the commit waits for it.
+
+        Thread safety:
+            Safe to call concurrently with @ref fetch
+            and @ref insert, when the policy allows it.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    commit(error_code& ec);
+
+    /** Insert a batch of values.
+
+        This function attempts to insert every key/value pair
+        in the batch. If any key already exists, `ec` is set to
+        @ref error::key_exists and nothing is inserted.
+        Otherwise all of the values become visible to
+        @ref fetch together and are written by the same commit,
+        so a crash followed by recovery either keeps all of
+        them or none of them.
+
+        Preconditions:
+            The database must be open. The key size of the
+            batch must equal the key size of the database.
+
+        Thread safety:
+            Safe to call concurrently with @ref fetch
+            and other inserts.
+
+        @param batch The values to insert. The batch is not
+        modified, and may be cleared and reused afterwards.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    insert(write_batch const& batch, error_code& ec);
+
 private:
+    template<class Callback>
+    void
+    do_fetch(detail::nhash_t h, void const* key,
+        Callback && callback, error_code& ec);
+
     template<class Callback>
     void
     fetch(detail::nhash_t h, void const* key,
@@ -361,6 +1020,27 @@ private:
     exists(detail::nhash_t h, void const* key,
         shared_lock_type* lock, detail::bucket b, error_code& ec);
 
+    bool
+    exists(detail::nhash_t h, void const* key, error_code& ec);
+
+    detail::bucket
+    read_bucket(nbuck_t n, void* buf,
+        shared_lock_type& m, error_code& ec);
+
+    bool
+    begin_insert(void const* key, nsize_t size,
+        bool stage, error_code& ec);
+
+    void
+    after_insert(unique_lock_type& m);
+
+    std::size_t
+    pool_bytes(detail::pool const& p) const;
+
+    void
+    reserve(File& f, noff_t size, noff_t end,
+        std::uint64_t extent, noff_t& allocated);
+
     void
     split(detail::bucket& b1, detail::bucket& b2,
         detail::bucket& tmp, nbuck_t n1, nbuck_t n2,
@@ -372,7 +1052,43 @@ private:
         detail::cache& c0, void* buf, error_code& ec);
 
     void
-    commit(error_code& ec);
+    do_commit(error_code& ec);
+
+    static
+    detail::log_file_header
+    make_log_header(detail::key_file_header const& kh);
+
+    void
+    init_log(File& lf, detail::key_file_header const& kh,
+        error_code& ec);
+
+    void
+    wake();
+
+    void
+    before_write(std::size_t bytes);
+
+    bool
+    use_bc() const
+    {
+        return s_->bc.is_open() && ! bc_failed_;
+    }
+
+    void
+    bc_error(error_code& ec)
+    {
+        if(ec)
+        {
+            bc_failed_ = true;
+            ec = {};
+        }
+    }
+
+    bool
+    shrink();
+
+    void
+    work(bool idle);
 
     void
     run();
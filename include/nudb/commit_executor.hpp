@@ -0,0 +1,307 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_COMMIT_EXECUTOR_HPP
+#define NUDB_COMMIT_EXECUTOR_HPP
+
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nudb {
+
+template<class Hasher, class File, class Policy>
+class basic_store;
+
+/** A pool of threads which commits data for many databases.
+
+    By default each open @ref basic_store starts its own thread
+    to commit inserted data. When a process holds many databases,
+    an executor may be set on each of them with
+    @ref basic_store::executor before opening. The databases then
+    share the executor's threads, and no more than a configured
+    number of commits run at once against each device.
+
+    The executor also replaces the periodic wakeup of each
+    database's own thread: at every interval it commits data
+    which is waiting in each attached database, and releases
+    memory once a database has been idle.
+
+    Preconditions:
+        All databases using the executor must be closed
+        before the executor is destroyed.
+
+    Thread safety:
+        Safe to use from multiple threads.
+*/
+template<class = void>
+class commit_executor_t
+{
+    template<class, class, class>
+    friend class basic_store;
+
+    struct client
+    {
+        std::function<void(bool)> work;
+        std::string device;
+        bool queued = false;        // in queue_
+        bool idle = false;          // queued only by the timer
+        bool running = false;       // work in progress
+    };
+
+    std::size_t per_device_;
+    std::chrono::milliseconds interval_;
+    std::mutex m_;
+    std::condition_variable cond_;  // signals queue_ or stop_
+    std::condition_variable cond_done_; // signals work finished
+    std::map<std::size_t, client> clients_;
+    std::map<std::string, std::size_t> busy_; // commits per device
+    std::deque<std::size_t> queue_;
+    std::size_t next_id_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+    std::thread timer_;
+
+public:
+    /// Copy constructor (disallowed)
+    commit_executor_t(commit_executor_t const&) = delete;
+
+    /// Copy assignment (disallowed)
+    commit_executor_t& operator=(commit_executor_t const&) = delete;
+
+    /** Constructor.
+
+        @param threads The number of threads which run commits.
+        This must be greater than zero.
+
+        @param per_device The largest number of commits that
+        may run at once for databases on the same device.
+        This must be greater than zero.
+
+        @param interval The time between periodic commits.
+    */
+    explicit
+    commit_executor_t(
+        std::size_t threads = 1,
+        std::size_t per_device = 1,
+        std::chrono::milliseconds interval =
+            std::chrono::seconds{1});
+
+    /** Destructor.
+
+        Blocks until all running commits complete.
+    */
+    ~commit_executor_t();
+
+    /// Returns the number of threads which run commits
+    std::size_t
+    threads() const
+    {
+        return threads_.size();
+    }
+
+    /// Returns the largest number of commits per device
+    std::size_t
+    per_device() const
+    {
+        return per_device_;
+    }
+
+private:
+    // Add a database, returning its id
+    std::size_t
+    attach(std::function<void(bool)> work,
+        std::string const& device);
+
+    // Schedule a commit for a database
+    void
+    notify(std::size_t id);
+
+    // Remove a database, after any
+    // running commit for it completes
+    void
+    detach(std::size_t id);
+
+    void
+    enqueue(std::size_t id, client& c, bool idle);
+
+    void
+    run();
+
+    void
+    tick();
+};
+
+template<class _>
+commit_executor_t<_>::
+commit_executor_t(std::size_t threads,
+        std::size_t per_device,
+            std::chrono::milliseconds interval)
+    : per_device_(per_device)
+    , interval_(interval)
+{
+    BOOST_ASSERT(threads > 0);
+    BOOST_ASSERT(per_device > 0);
+    threads_.reserve(threads);
+    for(std::size_t i = 0; i < threads; ++i)
+        threads_.emplace_back(&commit_executor_t::run, this);
+    timer_ = std::thread(&commit_executor_t::tick, this);
+}
+
+template<class _>
+commit_executor_t<_>::
+~commit_executor_t()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_};
+        BOOST_ASSERT(clients_.empty());
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for(auto& t : threads_)
+        t.join();
+    timer_.join();
+}
+
+template<class _>
+std::size_t
+commit_executor_t<_>::
+attach(std::function<void(bool)> work,
+    std::string const& device)
+{
+    std::lock_guard<std::mutex> lock{m_};
+    auto const id = next_id_++;
+    auto& c = clients_[id];
+    c.work = std::move(work);
+    c.device = device;
+    return id;
+}
+
+template<class _>
+void
+commit_executor_t<_>::
+notify(std::size_t id)
+{
+    std::lock_guard<std::mutex> lock{m_};
+    auto const it = clients_.find(id);
+    if(it != clients_.end())
+        enqueue(id, it->second, false);
+}
+
+template<class _>
+void
+commit_executor_t<_>::
+detach(std::size_t id)
+{
+    std::unique_lock<std::mutex> lock{m_};
+    auto const it = clients_.find(id);
+    BOOST_ASSERT(it != clients_.end());
+    queue_.erase(std::remove(
+        queue_.begin(), queue_.end(), id), queue_.end());
+    cond_done_.wait(lock,
+        [&]
+        {
+            return ! it->second.running;
+        });
+    clients_.erase(it);
+}
+
+// Called with m_ held
+template<class _>
+void
+commit_executor_t<_>::
+enqueue(std::size_t id, client& c, bool idle)
+{
+    if(c.queued)
+    {
+        // A requested commit takes
+        // precedence over an idle one.
+        c.idle = c.idle && idle;
+        return;
+    }
+    c.queued = true;
+    c.idle = idle;
+    queue_.push_back(id);
+    cond_.notify_all();
+}
+
+template<class _>
+void
+commit_executor_t<_>::
+run()
+{
+    std::unique_lock<std::mutex> lock{m_};
+    for(;;)
+    {
+        // Find the first database that is not
+        // running and whose device is not busy.
+        auto it = queue_.end();
+        for(;;)
+        {
+            if(stop_)
+                return;
+            it = std::find_if(queue_.begin(), queue_.end(),
+                [&](std::size_t id)
+                {
+                    auto const& c = clients_.at(id);
+                    return ! c.running &&
+                        busy_[c.device] < per_device_;
+                });
+            if(it != queue_.end())
+                break;
+            cond_.wait(lock);
+        }
+        auto& c = clients_.at(*it);
+        queue_.erase(it);
+        auto const idle = c.idle;
+        c.queued = false;
+        c.running = true;
+        ++busy_[c.device];
+        lock.unlock();
+        // detach waits for us, so c stays valid
+        c.work(idle);
+        lock.lock();
+        c.running = false;
+        --busy_[c.device];
+        cond_.notify_all();
+        cond_done_.notify_all();
+    }
+}
+
+template<class _>
+void
+commit_executor_t<_>::
+tick()
+{
+    std::unique_lock<std::mutex> lock{m_};
+    for(;;)
+    {
+        if(cond_.wait_for(lock, interval_,
+                [this]
+                {
+                    return stop_;
+                }))
+            return;
+        for(auto& e : clients_)
+            enqueue(e.first, e.second, true);
+    }
+}
+
+using commit_executor = commit_executor_t<>;
+
+} // nudb
+
+#endif
@@ -0,0 +1,268 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_DETAIL_BUCKET_CACHE_HPP
+#define NUDB_DETAIL_BUCKET_CACHE_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/file.hpp>
+#include <nudb/type_traits.hpp>
+#include <nudb/detail/buffer.hpp>
+#include <nudb/detail/stream.hpp>
+#include <nudb/detail/xxhash.hpp>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace nudb {
+namespace detail {
+
+/*  Bucket cache file
+
+    Holds copies of key file buckets, usually on a device
+    faster than the one holding the key file. Buckets are
+    stored in direct-mapped slots:
+
+    Header
+        Type            8 bytes     "nudb.l2c"
+        Version         2 bytes
+        UID             8 bytes     Key file UID
+        BlockSize       2 bytes
+        Slots           8 bytes
+        DataFileSize    8 bytes     At the last clean close
+        Clean           1 byte      1 if closed cleanly
+        (Reserved)      27 bytes
+
+    Slot
+        Index           8 bytes     Bucket index
+        Checksum        8 bytes     Hash of index and block
+        Block           BlockSize bytes
+
+    A slot whose checksum does not match, for example
+    after a torn write, is treated as empty. Since the
+    contents are only valid for the key file as it was
+    when last written, the cache is discarded on open
+    unless it was closed cleanly with the same data file.
+*/
+template<class File>
+class bucket_cache
+{
+    static std::size_t constexpr header_size = 64;
+    static std::size_t constexpr slot_header_size = 16;
+    static std::size_t constexpr version = 1;
+
+    File f_;
+    nsize_t block_size_ = 0;
+    std::uint64_t salt_ = 0;
+    std::uint64_t uid_ = 0;
+    std::uint64_t slots_ = 0;
+
+public:
+    bucket_cache(bucket_cache&&) = default;
+    bucket_cache& operator=(bucket_cache&&) = default;
+
+    explicit
+    bucket_cache(File&& f)
+        : f_(std::move(f))
+    {
+    }
+
+    bool
+    is_open() const
+    {
+        return f_.is_open();
+    }
+
+    // Open or create the cache file, discarding
+    // contents which may not match the key file.
+    void
+    open(path_type const& path, std::uint64_t uid,
+        std::uint64_t salt, nsize_t block_size,
+            std::uint64_t bytes, noff_t dat_file_size,
+                error_code& ec);
+
+    // Record a clean close and close the file
+    void
+    close(noff_t dat_file_size, error_code& ec);
+
+    // Close the file without recording a clean
+    // close, so the contents are discarded on open.
+    void
+    abandon()
+    {
+        f_.close();
+    }
+
+    // Returns `true` if bucket n was found
+    // and copied to buf
+    bool
+    read(nbuck_t n, void* buf, error_code& ec);
+
+    // Store the block for bucket n
+    void
+    write(nbuck_t n, void const* buf, error_code& ec);
+
+private:
+    noff_t
+    offset(nbuck_t n) const
+    {
+        return header_size + (n % slots_) *
+            (slot_header_size + block_size_);
+    }
+
+    std::uint64_t
+    checksum(nbuck_t n, void const* buf) const
+    {
+        return XXH64(buf, block_size_, salt_ ^ n);
+    }
+
+    void
+    write_header(noff_t dat_file_size,
+        bool clean, error_code& ec);
+};
+
+template<class File>
+void
+bucket_cache<File>::
+open(path_type const& path, std::uint64_t uid,
+    std::uint64_t salt, nsize_t block_size,
+        std::uint64_t bytes, noff_t dat_file_size,
+            error_code& ec)
+{
+    uid_ = uid;
+    salt_ = salt;
+    block_size_ = block_size;
+    slots_ = bytes / (slot_header_size + block_size);
+    if(slots_ < 1)
+        slots_ = 1;
+    f_.open(file_mode::write, path, ec);
+    if(ec == errc::no_such_file_or_directory)
+    {
+        ec = {};
+        f_.create(file_mode::write, path, ec);
+    }
+    if(ec)
+        return;
+    auto valid = false;
+    std::array<std::uint8_t, header_size> buf;
+    error_code ec2;
+    f_.read(0, buf.data(), buf.size(), ec2);
+    if(! ec2)
+    {
+        istream is(buf);
+        char type[8];
+        std::size_t version_in;
+        std::uint64_t uid_in;
+        nsize_t block_size_in;
+        std::uint64_t slots_in;
+        noff_t dat_file_size_in;
+        std::uint8_t clean;
+        detail::read(is, type, sizeof(type));
+        detail::read<std::uint16_t>(is, version_in);
+        detail::read<std::uint64_t>(is, uid_in);
+        detail::read<std::uint16_t>(is, block_size_in);
+        detail::read<std::uint64_t>(is, slots_in);
+        detail::read<std::uint64_t>(is, dat_file_size_in);
+        detail::read<std::uint8_t>(is, clean);
+        valid =
+            std::memcmp(type, "nudb.l2c", 8) == 0 &&
+            version_in == version &&
+            uid_in == uid &&
+            block_size_in == block_size &&
+            slots_in == slots_ &&
+            dat_file_size_in == dat_file_size &&
+            clean == 1;
+    }
+    if(! valid)
+    {
+        // Slots past the end of the file read as empty
+        f_.trunc(0, ec);
+        if(ec)
+            return;
+    }
+    write_header(dat_file_size, false, ec);
+    if(ec)
+        return;
+    f_.sync(ec);
+}
+
+template<class File>
+void
+bucket_cache<File>::
+close(noff_t dat_file_size, error_code& ec)
+{
+    write_header(dat_file_size, true, ec);
+    if(ec)
+        return;
+    f_.sync(ec);
+    if(ec)
+        return;
+    f_.close();
+}
+
+template<class File>
+bool
+bucket_cache<File>::
+read(nbuck_t n, void* buf, error_code& ec)
+{
+    buffer b{slot_header_size + block_size_};
+    f_.read(offset(n), b.get(), b.size(), ec);
+    if(ec == error::short_read)
+    {
+        ec = {};
+        return false;
+    }
+    if(ec)
+        return false;
+    istream is{b.get(), b.size()};
+    std::uint64_t index;
+    std::uint64_t hash;
+    detail::read<std::uint64_t>(is, index);
+    detail::read<std::uint64_t>(is, hash);
+    auto const p = is.data(block_size_);
+    if(index != n || hash != checksum(n, p))
+        return false;
+    std::memcpy(buf, p, block_size_);
+    return true;
+}
+
+template<class File>
+void
+bucket_cache<File>::
+write(nbuck_t n, void const* buf, error_code& ec)
+{
+    buffer b{slot_header_size + block_size_};
+    ostream os{b.get(), b.size()};
+    detail::write<std::uint64_t>(os, n);
+    detail::write<std::uint64_t>(os, checksum(n, buf));
+    detail::write(os, buf, block_size_);
+    f_.write(offset(n), b.get(), b.size(), ec);
+}
+
+template<class File>
+void
+bucket_cache<File>::
+write_header(noff_t dat_file_size,
+    bool clean, error_code& ec)
+{
+    std::array<std::uint8_t, header_size> buf;
+    buf.fill(0);
+    ostream os(buf);
+    detail::write(os, "nudb.l2c", 8);
+    detail::write<std::uint16_t>(os, version);
+    detail::write<std::uint64_t>(os, uid_);
+    detail::write<std::uint16_t>(os, block_size_);
+    detail::write<std::uint64_t>(os, slots_);
+    detail::write<std::uint64_t>(os, dat_file_size);
+    detail::write<std::uint8_t>(os, clean ? 1u : 0u);
+    f_.write(0, buf.data(), buf.size(), ec);
+}
+
+} // detail
+} // nudb
+
+#endif
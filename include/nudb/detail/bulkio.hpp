@@ -14,6 +14,8 @@
 #include <nudb/error.hpp>
 #include <algorithm>
 #include <cstddef>
+#include <functional>
+#include <utility>
 
 namespace nudb {
 namespace detail {
@@ -114,10 +116,12 @@ class bulk_writer
     buffer buf_;
     noff_t offset_;      // current position
     std::size_t used_;   // bytes written to buf
+    std::function<void(std::size_t)> throttle_;
 
 public:
     bulk_writer(File& f, noff_t offset,
-        std::size_t buffer_size);
+        std::size_t buffer_size,
+            std::function<void(std::size_t)> throttle = nullptr);
 
     ostream
     prepare(std::size_t needed, error_code& ec);
@@ -145,11 +149,13 @@ public:
 
 template<class File>
 bulk_writer<File>::
-bulk_writer(File& f,
-        noff_t offset, std::size_t buffer_size)
+bulk_writer(File& f, noff_t offset,
+        std::size_t buffer_size,
+            std::function<void(std::size_t)> throttle)
     : f_(f)
     , offset_(offset)
     , used_(0)
+    , throttle_(std::move(throttle))
 
 {
     buf_.reserve(buffer_size);
@@ -184,6 +190,10 @@ flush(error_code& ec)
         auto const used = used_;
         offset_ += used_;
         used_ = 0;
+        // Called before each write, for
+        // example to limit the I/O rate.
+        if(throttle_)
+            throttle_(used);
         f_.write(offset, buf_.get(), used, ec);
         if(ec)
             return;
@@ -111,6 +111,12 @@ public:
         return map_.empty();
     }
 
+    std::size_t
+    size() const
+    {
+        return map_.size();
+    }
+
     void
     clear();
 
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_DETAIL_FILE_HINTS_HPP
+#define NUDB_DETAIL_FILE_HINTS_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/type_traits.hpp>
+#include <cstddef>
+
+namespace nudb {
+namespace detail {
+
+// Optional File members are called when present,
+// otherwise the hint is silently ignored.
+
+template<class File>
+auto
+prefetch(File& f, noff_t offset,
+    std::size_t bytes, error_code& ec, int) ->
+        decltype(f.prefetch(offset, bytes, ec))
+{
+    return f.prefetch(offset, bytes, ec);
+}
+
+template<class File>
+void
+prefetch(File&, noff_t, std::size_t, error_code&, long)
+{
+}
+
+// Hint that a range of the file will be read soon
+template<class File>
+void
+prefetch(File& f, noff_t offset,
+    std::size_t bytes, error_code& ec)
+{
+    prefetch(f, offset, bytes, ec, 0);
+}
+
+template<class File>
+auto
+allocate(File& f, noff_t offset,
+    noff_t bytes, error_code& ec, int) ->
+        decltype(f.allocate(offset, bytes, ec))
+{
+    return f.allocate(offset, bytes, ec);
+}
+
+template<class File>
+void
+allocate(File&, noff_t, noff_t, error_code&, long)
+{
+}
+
+// Hint that a range of the file will be written soon
+template<class File>
+void
+allocate(File& f, noff_t offset,
+    noff_t bytes, error_code& ec)
+{
+    allocate(f, offset, bytes, ec, 0);
+}
+
+} // detail
+} // nudb
+
+#endif
@@ -125,6 +125,42 @@ struct log_file_header
     noff_t dat_file_size;
 };
 
+/*  Reusable log file
+
+    A reusable log file is kept between commits instead of
+    being truncated. Records left from earlier commits are
+    recognized by their sequence number or checksum.
+
+    Header
+        (log_file_header)       Type is "nudb.lgr"
+        Sequence        8 bytes Sequence of the commit
+
+    Log Record
+        Sequence        8 bytes
+        Index           8 bytes Bucket index
+        Size            2 bytes Size of bucket
+        Bucket          Size bytes
+        Checksum        8 bytes Hash of the preceding fields
+
+    A DataFileSize of zero in the header means that no
+    commit is in progress.
+*/
+struct reusable_log_header
+{
+    static std::size_t constexpr size =
+        log_file_header::size +
+        8;      // Sequence
+
+    static std::size_t constexpr record_overhead =
+        8 +     // Sequence
+        8 +     // Index
+        2 +     // Size
+        8;      // Checksum
+
+    log_file_header lh;
+    std::uint64_t sequence;
+};
+
 // Type used to store hashes in buckets.
 // This can be smaller than the output
 // of the hash function.
@@ -462,6 +498,34 @@ write(File& f, log_file_header const& lh, error_code& ec)
     f.write(0, buf.data(), buf.size(), ec);
 }
 
+// Read reusable log file header from file
+template<class File>
+void
+read(File& f, reusable_log_header& h, error_code& ec)
+{
+    std::array<std::uint8_t, reusable_log_header::size> buf;
+    f.read(0, buf.data(), buf.size(), ec);
+    if(ec)
+        return;
+    istream is{buf};
+    read(is, h.lh);
+    read<std::uint64_t>(is, h.sequence);
+}
+
+// Write reusable log file header to file
+template<class File>
+void
+write(File& f, reusable_log_header const& h, error_code& ec)
+{
+    std::array<std::uint8_t, reusable_log_header::size> buf;
+    ostream os{buf};
+    auto const type = os.data(0);
+    write(os, h.lh);
+    std::memcpy(type, "nudb.lgr", 8);
+    write<std::uint64_t>(os, h.sequence);
+    f.write(0, buf.data(), buf.size(), ec);
+}
+
 // Verify contents of data file header
 template<class = void>
 void
@@ -556,6 +620,22 @@ verify(log_file_header const& lh, error_code& ec)
     }
 }
 
+// Verify contents of reusable log file header
+template<class Hasher>
+void
+verify(reusable_log_header const& h, error_code& ec)
+{
+    std::string const type{h.lh.type, 8};
+    if(type != "nudb.lgr")
+    {
+        ec = error::not_log_file;
+        return;
+    }
+    auto lh = h.lh;
+    std::memcpy(lh.type, "nudb.log", 8);
+    verify<Hasher>(lh, ec);
+}
+
 // Make sure key file and value file headers match
 template<class Hasher>
 void
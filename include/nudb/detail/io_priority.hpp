@@ -0,0 +1,40 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_DETAIL_IO_PRIORITY_HPP
+#define NUDB_DETAIL_IO_PRIORITY_HPP
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace nudb {
+namespace detail {
+
+// Give I/O from the calling thread the lowest
+// best-effort priority, where supported.
+//
+inline
+void
+lower_io_priority()
+{
+#if defined(__linux__) && defined(SYS_ioprio_set)
+    int const who_process = 1;  // IOPRIO_WHO_PROCESS
+    int const class_be = 2;     // IOPRIO_CLASS_BE
+    int const class_shift = 13; // IOPRIO_CLASS_SHIFT
+    // A process id of zero selects the calling
+    // thread. Failure leaves the priority unchanged.
+    ::syscall(SYS_ioprio_set, who_process, 0,
+        (class_be << class_shift) | 7);
+#endif
+}
+
+} // detail
+} // nudb
+
+#endif
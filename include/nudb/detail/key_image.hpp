@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_DETAIL_KEY_IMAGE_HPP
+#define NUDB_DETAIL_KEY_IMAGE_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/type_traits.hpp>
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace nudb {
+namespace detail {
+
+// Holds a copy of every bucket in the key file.
+// Blocks are allocated in fixed size chunks so
+// that growing never moves existing buckets.
+template<class = void>
+class key_image_t
+{
+    enum
+    {
+        // Approximate size of each chunk
+        chunk_size = 1024 * 1024
+    };
+
+    using chunk = std::unique_ptr<std::uint8_t[]>;
+
+    nsize_t block_size_;
+    nbuck_t per_chunk_;     // blocks per chunk
+    nbuck_t buckets_ = 0;   // number of buckets held
+    std::vector<chunk> chunks_;
+
+public:
+    key_image_t(key_image_t&&) = default;
+    key_image_t& operator=(key_image_t&&) = default;
+
+    explicit
+    key_image_t(nsize_t block_size);
+
+    // Returns the number of buckets held
+    nbuck_t
+    buckets() const
+    {
+        return buckets_;
+    }
+
+    // Returns the number of bytes allocated
+    std::size_t
+    size() const
+    {
+        return chunks_.size() * per_chunk_ * block_size_;
+    }
+
+    // Returns the block for bucket n
+    std::uint8_t*
+    at(nbuck_t n)
+    {
+        BOOST_ASSERT(n < buckets_);
+        return chunks_[n / per_chunk_].get() +
+            (n % per_chunk_) * block_size_;
+    }
+
+    // Add zeroed buckets until there are `buckets`
+    void
+    grow(nbuck_t buckets);
+
+    // Read the buckets from the key file
+    template<class File>
+    void
+    load(File& f, nbuck_t buckets, error_code& ec);
+};
+
+template<class _>
+key_image_t<_>::
+key_image_t(nsize_t block_size)
+    : block_size_(block_size)
+    , per_chunk_(std::max<nbuck_t>(
+        1, chunk_size / block_size))
+{
+}
+
+template<class _>
+void
+key_image_t<_>::
+grow(nbuck_t buckets)
+{
+    while(chunks_.size() * per_chunk_ < buckets)
+    {
+        auto const size = per_chunk_ * block_size_;
+        chunk c{new std::uint8_t[size]};
+        std::memset(c.get(), 0, size);
+        chunks_.emplace_back(std::move(c));
+    }
+    buckets_ = std::max(buckets_, buckets);
+}
+
+template<class _>
+template<class File>
+void
+key_image_t<_>::
+load(File& f, nbuck_t buckets, error_code& ec)
+{
+    grow(buckets);
+    for(nbuck_t n = 0; n < buckets; n += per_chunk_)
+    {
+        auto const count = std::min(per_chunk_, buckets - n);
+        // Bucket 0 follows the key file header
+        f.read(static_cast<noff_t>(n + 1) * block_size_,
+            at(n), count * block_size_, ec);
+        if(ec)
+            return;
+    }
+}
+
+using key_image = key_image_t<>;
+
+} // detail
+} // nudb
+
+#endif
@@ -43,6 +43,9 @@ public:
     using iterator =
         typename map_type::iterator;
 
+    using const_iterator =
+        typename map_type::const_iterator;
+
     pool_t(pool_t const&) = delete;
     pool_t& operator=(pool_t const&) = delete;
 
@@ -62,6 +65,18 @@ public:
         return map_.end();
     }
 
+    const_iterator
+    begin() const
+    {
+        return map_.begin();
+    }
+
+    const_iterator
+    end() const
+    {
+        return map_.end();
+    }
+
     bool
     empty() const
     {
@@ -75,7 +90,8 @@ public:
         return map_.size();
     }
 
-    // Returns the sum of data sizes in the pool
+    // Returns the sum of data sizes in the pool,
+    // not including staged values
     std::size_t
     data_size() const
     {
@@ -97,6 +113,23 @@ public:
     insert(nhash_t h, void const* key,
         void const* buffer, nsize_t size);
 
+    // Allocate space for a value without inserting it.
+    // The key is copied, the caller fills in the data.
+    // @param h The hash of the key
+    value_type
+    prepare(nhash_t h, void const* key, nsize_t size);
+
+    // Copy the key of a value whose data is held
+    // elsewhere, at the offset `stage`.
+    // @param h The hash of the key
+    value_type
+    prepare_staged(nhash_t h, void const* key,
+        nsize_t size, noff_t stage);
+
+    // Insert a value returned by prepare or prepare_staged
+    void
+    insert(value_type const& v);
+
     template<class U>
     friend
     void
@@ -109,13 +142,14 @@ struct pool_t<_>::value_type
     nhash_t hash;
     nsize_t size;
     void const* key;
-    void const* data;
+    void* data;         // nullptr if staged
+    noff_t stage = 0;   // offset of staged data
 
     value_type(value_type const&) = default;
     value_type& operator=(value_type const&) = default;
 
     value_type(nhash_t hash_, nsize_t size_,
-            void const* key_, void const* data_)
+            void const* key_, void* data_)
         : hash(hash_)
         , size(size_)
         , key(key_)
@@ -208,19 +242,52 @@ void
 pool_t<_>::
 insert(nhash_t h,
     void const* key, void const* data, nsize_t size)
+{
+    auto const v = prepare(h, key, size);
+    std::memcpy(v.data, data, size);
+    insert(v);
+}
+
+template<class _>
+auto
+pool_t<_>::
+prepare(nhash_t h, void const* key, nsize_t size) ->
+    value_type
 {
     auto const k = arena_.alloc(key_size_);
     auto const d = arena_.alloc(size);
     std::memcpy(k, key, key_size_);
-    std::memcpy(d, data, size);
+    return value_type{h, size, k, d};
+}
+
+template<class _>
+auto
+pool_t<_>::
+prepare_staged(nhash_t h, void const* key,
+    nsize_t size, noff_t stage) ->
+        value_type
+{
+    auto const k = arena_.alloc(key_size_);
+    std::memcpy(k, key, key_size_);
+    value_type v{h, size, k, nullptr};
+    v.stage = stage;
+    return v;
+}
+
+template<class _>
+void
+pool_t<_>::
+insert(value_type const& v)
+{
     auto const result = map_.emplace(
         std::piecewise_construct,
-            std::make_tuple(h, size, k, d),
+            std::make_tuple(v),
                 std::make_tuple(0));
    (void)result.second;
     // Must not already exist!
     BOOST_ASSERT(result.second);
-    data_size_ += size;
+    if(v.data)
+        data_size_ += v.size;
 }
 
 template<class _>
@@ -0,0 +1,226 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_DETAIL_RECENT_CACHE_HPP
+#define NUDB_DETAIL_RECENT_CACHE_HPP
+
+#include <nudb/type_traits.hpp>
+#include <boost/assert.hpp>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace nudb {
+namespace detail {
+
+// Holds copies of recently committed key/value pairs,
+// looked up by the hash of the key. Entries are
+// discarded oldest first. The size counts every
+// allocation made for an entry, so that the memory
+// used can be bounded.
+template<class = void>
+class recent_cache_t
+{
+    struct entry
+    {
+        nhash_t hash;
+        nsize_t size;
+        std::unique_ptr<std::uint8_t[]> p; // key then value
+    };
+
+    using list_type = std::list<entry>;
+
+    using map_type = std::unordered_multimap<
+        nhash_t, typename list_type::iterator>;
+
+    nsize_t key_size_;
+    std::size_t bytes_ = 0;
+    list_type list_;            // oldest first
+    map_type map_;
+
+public:
+    // Copies of values, made before they are
+    // added to the cache in a single step.
+    class batch
+    {
+        friend class recent_cache_t;
+
+        nsize_t key_size_;
+        std::size_t bytes_ = 0;
+        list_type list_;
+
+    public:
+        explicit
+        batch(nsize_t key_size)
+            : key_size_(key_size)
+        {
+        }
+
+        // Returns the number of bytes charged
+        std::size_t
+        size() const
+        {
+            return bytes_;
+        }
+
+        // Add a copy of a key and value
+        void
+        insert(nhash_t h, void const* key,
+            void const* data, nsize_t size);
+    };
+
+    recent_cache_t(recent_cache_t&&) = default;
+    recent_cache_t& operator=(recent_cache_t&&) = default;
+
+    explicit
+    recent_cache_t(nsize_t key_size)
+        : key_size_(key_size)
+    {
+    }
+
+    // Returns the bytes charged for one entry
+    static
+    std::size_t
+    charge(nsize_t key_size, nsize_t size)
+    {
+        // The list node, the map node, and the
+        // bookkeeping of three allocations.
+        return key_size + size + sizeof(entry) +
+            sizeof(typename map_type::value_type) +
+                8 * sizeof(void*);
+    }
+
+    bool
+    empty() const
+    {
+        return list_.empty();
+    }
+
+    // Returns the number of bytes charged,
+    // including the map's bucket array
+    std::size_t
+    size() const
+    {
+        if(list_.empty())
+            return 0;
+        return bytes_ + map_.bucket_count() * sizeof(void*);
+    }
+
+    // Add the entries in b, which is left empty
+    void
+    insert(batch& b);
+
+    // Discard the oldest entries until the
+    // size is no larger than limit.
+    void
+    trim(std::size_t limit);
+
+    void
+    clear();
+
+    // Returns the value for key, or nullptr
+    std::uint8_t const*
+    find(nhash_t h, void const* key, nsize_t& size) const;
+};
+
+template<class _>
+void
+recent_cache_t<_>::batch::
+insert(nhash_t h, void const* key,
+    void const* data, nsize_t size)
+{
+    entry e;
+    e.hash = h;
+    e.size = size;
+    e.p.reset(new std::uint8_t[key_size_ + size]);
+    std::memcpy(e.p.get(), key, key_size_);
+    std::memcpy(e.p.get() + key_size_, data, size);
+    list_.push_back(std::move(e));
+    bytes_ += charge(key_size_, size);
+}
+
+template<class _>
+void
+recent_cache_t<_>::
+insert(batch& b)
+{
+    BOOST_ASSERT(b.key_size_ == key_size_);
+    if(b.list_.empty())
+        return;
+    auto it = b.list_.begin();
+    list_.splice(list_.end(), b.list_);
+    for(; it != list_.end(); ++it)
+        map_.emplace(it->hash, it);
+    bytes_ += b.bytes_;
+    b.bytes_ = 0;
+}
+
+template<class _>
+void
+recent_cache_t<_>::
+trim(std::size_t limit)
+{
+    while(! list_.empty() && size() > limit)
+    {
+        auto const it = list_.begin();
+        auto const range = map_.equal_range(it->hash);
+        for(auto i = range.first; i != range.second; ++i)
+        {
+            if(i->second == it)
+            {
+                map_.erase(i);
+                break;
+            }
+        }
+        bytes_ -= charge(key_size_, it->size);
+        list_.erase(it);
+    }
+    if(list_.empty())
+    {
+        // Release the bucket array too
+        map_type{}.swap(map_);
+        BOOST_ASSERT(bytes_ == 0);
+    }
+}
+
+template<class _>
+void
+recent_cache_t<_>::
+clear()
+{
+    list_.clear();
+    map_type{}.swap(map_);
+    bytes_ = 0;
+}
+
+template<class _>
+std::uint8_t const*
+recent_cache_t<_>::
+find(nhash_t h, void const* key, nsize_t& size) const
+{
+    auto const range = map_.equal_range(h);
+    for(auto i = range.first; i != range.second; ++i)
+    {
+        auto const& e = *i->second;
+        if(std::memcmp(e.p.get(), key, key_size_) == 0)
+        {
+            size = e.size;
+            return e.p.get() + key_size_;
+        }
+    }
+    return nullptr;
+}
+
+using recent_cache = recent_cache_t<>;
+
+} // detail
+} // nudb
+
+#endif
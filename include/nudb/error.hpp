@@ -173,7 +173,13 @@ enum class error
     size_mismatch,
 
     /// duplicate value
-    duplicate_value
+    duplicate_value,
+
+    /// not a trace file
+    not_trace_file,
+
+    /// invalid trace record
+    invalid_trace_record
 };
 
 /// Returns the error category used for database error codes.
@@ -10,14 +10,22 @@
 
 #include <nudb/concepts.hpp>
 #include <nudb/recover.hpp>
+#include <nudb/warm.hpp>
+#include <nudb/detail/file_hints.hpp>
+#include <nudb/detail/xxhash.hpp>
 #include <boost/assert.hpp>
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <type_traits>
+#include <vector>
 
 namespace nudb {
 
-template<class Hasher, class File>
-basic_store<Hasher, File>::state::
+template<class Hasher, class File, class Policy>
+basic_store<Hasher, File, Policy>::state::
 state(File&& df_, File&& kf_, File&& lf_,
+    File&& sf0_, File&& sf1_, File&& bc_,
     path_type const& dp_, path_type const& kp_,
         path_type const& lp_,
             detail::key_file_header const& kh_,
@@ -33,14 +41,20 @@ state(File&& df_, File&& kf_, File&& lf_,
     , p1(kh_.key_size, arenaBlockSize)
     , c0(kh_.key_size, kh_.block_size)
     , c1(kh_.key_size, kh_.block_size)
+    , sf0(std::move(sf0_), lp_ + ".s0")
+    , sf1(std::move(sf1_), lp_ + ".s1")
     , kh(kh_)
+    , stage_thresh(arenaBlockSize)
+    , recent(kh_.key_size)
+    , ki(kh_.block_size)
+    , bc(std::move(bc_))
 {
 }
 
 //------------------------------------------------------------------------------
 
-template<class Hasher, class File>
-basic_store<Hasher, File>::
+template<class Hasher, class File, class Policy>
+basic_store<Hasher, File, Policy>::
 ~basic_store()
 {
     error_code ec;
@@ -51,64 +65,171 @@ basic_store<Hasher, File>::
     close(ec);
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 path_type const&
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 dat_path() const
 {
     BOOST_ASSERT(is_open());
     return s_->dp;
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 path_type const&
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 key_path() const
 {
     BOOST_ASSERT(is_open());
     return s_->kp;
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 path_type const&
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 log_path() const
 {
     BOOST_ASSERT(is_open());
     return s_->lp;
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 std::uint64_t
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 appnum() const
 {
     BOOST_ASSERT(is_open());
     return s_->kh.appnum;
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 std::size_t
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 key_size() const
 {
     BOOST_ASSERT(is_open());
     return s_->kh.key_size;
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 std::size_t
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 block_size() const
 {
     BOOST_ASSERT(is_open());
     return s_->kh.block_size;
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+recent_limit(std::size_t bytes)
+{
+    unique_lock_type m{m_};
+    recent_limit_ = bytes;
+    if(s_)
+        s_->recent.trim(bytes);
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+resident(bool enable)
+{
+    BOOST_ASSERT(! is_open());
+    resident_ = enable;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+bucket_cache(path_type const& path, std::uint64_t bytes)
+{
+    BOOST_ASSERT(! is_open());
+    bucket_cache_path_ = path;
+    bucket_cache_size_ = bytes;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+executor(commit_executor& ex, std::string const& device)
+{
+    BOOST_ASSERT(! is_open());
+    BOOST_ASSERT(Policy::background);
+    ex_ = &ex;
+    device_ = device;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+commit_rate(rate_limiter* r)
+{
+    BOOST_ASSERT(! is_open());
+    limiter_ = r;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+trace(trace_writer* w)
+{
+    BOOST_ASSERT(! is_open());
+    tracer_ = w;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+read_priority(std::chrono::microseconds max_wait)
+{
+    BOOST_ASSERT(! is_open());
+    read_priority_ = max_wait;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+reusable_log(std::uint64_t bytes)
+{
+    BOOST_ASSERT(! is_open());
+    log_reserve_ = bytes;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+preallocate(std::uint64_t dat_bytes,
+    std::uint64_t key_bytes)
+{
+    BOOST_ASSERT(! is_open());
+    dat_extent_ = dat_bytes;
+    key_extent_ = key_bytes;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+parallel_sync(bool value)
+{
+    BOOST_ASSERT(! is_open());
+    parallel_sync_ = value;
+}
+
+template<class Hasher, class File, class Policy>
+std::size_t
+basic_store<Hasher, File, Policy>::
+resident_size() const
+{
+    BOOST_ASSERT(is_open());
+    shared_lock_type m{m_};
+    return s_->ki.size();
+}
+
+template<class Hasher, class File, class Policy>
 template<class... Args>
 void
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 open(
     path_type const& dat_path,
     path_type const& key_path,
@@ -123,6 +244,7 @@ open(
     BOOST_ASSERT(! is_open());
     ec_ = {};
     ecb_.store(false);
+    bc_failed_ = false;
     recover<Hasher, File>(
         dat_path, key_path, log_path, ec, args...);
     if(ec)
@@ -130,13 +252,32 @@ open(
     File df(args...);
     File kf(args...);
     File lf(args...);
+    File sf0(args...);
+    File sf1(args...);
+    File bc(args...);
     df.open(file_mode::append, dat_path, ec);
     if(ec)
         return;
     kf.open(file_mode::write, key_path, ec);
     if(ec)
         return;
-    lf.create(file_mode::append, log_path, ec);
+    if(log_reserve_ > 0)
+    {
+        lf.open(file_mode::write, log_path, ec);
+        if(ec == errc::no_such_file_or_directory)
+        {
+            ec = {};
+            lf.create(file_mode::write, log_path, ec);
+        }
+    }
+    else
+    {
+        // recover has finished with any reusable
+        // log left from an earlier open.
+        error_code ec2;
+        File::erase(log_path, ec2);
+        lf.create(file_mode::append, log_path, ec);
+    }
     if(ec)
         return;
     // VFALCO TODO Erase empty log file if this
@@ -158,14 +299,50 @@ open(
     verify<Hasher>(dh, kh, ec);
     if(ec)
         return;
+    if(tracer_ && tracer_->key_size() != kh.key_size)
+    {
+        ec = error::key_size_mismatch;
+        return;
+    }
+    if(log_reserve_ > 0)
+    {
+        init_log(lf, kh, ec);
+        if(ec)
+            return;
+    }
     boost::optional<state> s;
     s.emplace(std::move(df), std::move(kf), std::move(lf),
-        dat_path, key_path, log_path, kh, arenaBlockSize);
+        std::move(sf0), std::move(sf1), std::move(bc),
+            dat_path, key_path, log_path, kh, arenaBlockSize);
+    if(resident_)
+    {
+        s->ki.load(s->kf, kh.buckets, ec);
+        if(ec)
+            return;
+    }
+    else if(! bucket_cache_path_.empty())
+    {
+        auto const size = s->df.size(ec);
+        if(ec)
+            return;
+        s->bc.open(bucket_cache_path_, kh.uid, kh.salt,
+            kh.block_size, bucket_cache_size_, size, ec);
+        if(ec)
+            return;
+    }
+    // Staged values left by a crash were never committed
+    {
+        error_code ec2;
+        File::erase(s->sf0.path, ec2);
+        File::erase(s->sf1.path, ec2);
+    }
     thresh_ = std::max<std::size_t>(65536UL,
         kh.load_factor * kh.capacity);
     frac_ = thresh_ / 2;
     buckets_ = kh.buckets;
     modulus_ = ceil_pow2(kh.buckets);
+    dat_allocated_ = 0;
+    key_allocated_ = 0;
     // VFALCO TODO This could be better
     if(buckets_ < 1)
     {
@@ -176,19 +353,46 @@ open(
     logWriteSize_ = 32 * nudb::block_size(log_path);
     s_.emplace(std::move(*s));
     open_ = true;
-    thread_ = std::thread(&basic_store::run, this);
+    if(ex_)
+    {
+        released_ = false;
+        ex_id_ = ex_->attach(
+            [this](bool idle)
+            {
+                work(idle);
+            }, device_);
+    }
+    else if(Policy::background)
+    {
+        thread_ = std::thread(&basic_store::run, this);
+    }
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 void
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 close(error_code& ec)
 {
     if(open_)
     {
+        BOOST_ASSERT(! pending_);
         open_ = false;
-        cond_.notify_all();
-        thread_.join();
+        warm_stop_.store(true);
+        if(ex_)
+            ex_->detach(ex_id_);
+        if(Policy::background && ! ex_)
+        {
+            cond_.notify_all();
+            thread_.join();
+        }
+        else if(! ecb_)
+        {
+            do_commit(ec_);
+            if(ec_)
+                ecb_.store(true);
+        }
+        if(warm_thread_.joinable())
+            warm_thread_.join();
         if(ecb_)
         {
             ec = ec_;
@@ -196,16 +400,37 @@ close(error_code& ec)
         }
         s_->lf.close();
         state s{std::move(*s_)};
-        File::erase(s.lp, ec_);
+        // A reusable log is left with no commit
+        if(log_reserve_ == 0)
+            File::erase(s.lp, ec_);
         if(ec_)
             ec = ec_;
+        if(s.bc.is_open())
+        {
+            // Errors only cost the cache contents
+            error_code ec2;
+            auto const size = s.df.size(ec2);
+            if(! ec2 && ! bc_failed_)
+                s.bc.close(size, ec2);
+            if(s.bc.is_open())
+                s.bc.abandon();
+        }
+        for(auto sf : {&s.sf0, &s.sf1})
+        {
+            if(! sf->f.is_open())
+                continue;
+            sf->f.close();
+            File::erase(sf->path, ec_);
+            if(ec_)
+                ec = ec_;
+        }
     }
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 template<class Callback>
 void
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 fetch(
     void const* key,
     Callback && callback,
@@ -220,41 +445,138 @@ fetch(
     }
     auto const h =
         hash(key, s_->kh.key_size, s_->hasher);
+    if(! tracer_)
+        return do_fetch(h, key, callback, ec);
+    nsize_t found = 0;
+    do_fetch(h, key,
+        [&](void const* data, std::size_t size)
+        {
+            found = static_cast<nsize_t>(size);
+            callback(data, size);
+        }, ec);
+    tracer_->fetch(h, key, found);
+}
+
+template<class Hasher, class File, class Policy>
+template<class Callback>
+void
+basic_store<Hasher, File, Policy>::
+do_fetch(
+    detail::nhash_t h,
+    void const* key,
+    Callback && callback,
+    error_code& ec)
+{
+    using namespace detail;
     shared_lock_type m{m_};
     {
+        auto sf = &s_->sf1;
         auto iter = s_->p1.find(key);
         if(iter == s_->p1.end())
         {
+            sf = &s_->sf0;
             iter = s_->p0.find(key);
             if(iter == s_->p0.end())
                 goto cont;
         }
+        if(! iter->first.data)
+        {
+            // Staged value
+            buffer buf{iter->first.size};
+            sf->f.read(iter->first.stage,
+                buf.get(), iter->first.size, ec);
+            if(ec)
+                return;
+            callback(buf.get(), iter->first.size);
+            return;
+        }
         callback(iter->first.data, iter->first.size);
         return;
     }
 cont:
+    {
+        nsize_t size;
+        auto const data = s_->recent.find(h, key, size);
+        if(data)
+        {
+            callback(data, size);
+            return;
+        }
+    }
+    // Commit writes wait while this is nonzero
+    struct reader
+    {
+        basic_store* s;
+
+        ~reader()
+        {
+            if(s && --s->readers_ == 0)
+            {
+                std::lock_guard<std::mutex> l{s->readers_m_};
+                s->readers_cv_.notify_all();
+            }
+        }
+    };
+    reader r{nullptr};
+    if(read_priority_.count() > 0)
+    {
+        r.s = this;
+        ++readers_;
+    }
     auto const n = bucket_index(h, buckets_, modulus_);
+    buffer buf{s_->kh.block_size};
     auto const iter = s_->c1.find(n);
     if(iter != s_->c1.end())
-        return fetch(h, key, iter->second, callback, ec);
-    genlock<gentex> g{g_};
-    m.unlock();
-    buffer buf{s_->kh.block_size};
-    // b constructs from uninitialized buf
-    bucket b{s_->kh.block_size, buf.get()};
-    b.read(s_->kf, (n + 1) * b.block_size(), ec);
+    {
+        // Copy the bucket so the data file is read
+        // without holding m_, which would keep a
+        // commit waiting while fetches are steady.
+        ostream os{buf.get(), s_->kh.block_size};
+        iter->second.write(os);
+        m.unlock();
+        return fetch(h, key, bucket{s_->kh.block_size,
+            buf.get()}, callback, ec);
+    }
+    auto const b = read_bucket(n, buf.get(), m, ec);
     if(ec)
         return;
     fetch(h, key, b, callback, ec);
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
+template<class Progress>
 void
-basic_store<Hasher, File>::
-insert(
-    void const* key,
-    void const* data,
-    nsize_t size,
+basic_store<Hasher, File, Policy>::
+warm(std::size_t bufferSize, Progress&& progress)
+{
+    static_assert(is_Progress<Progress>::value,
+        "Progress requirements not met");
+    BOOST_ASSERT(is_open());
+    BOOST_ASSERT(! warm_thread_.joinable());
+    warm_stop_.store(false);
+    warm_thread_ = std::thread(
+        [this, bufferSize](typename
+            std::decay<Progress>::type progress)
+        {
+            error_code ec;
+            auto const size = s_->kf.size(ec);
+            if(ec)
+                return;
+            detail::warm(s_->kf, size, bufferSize, progress,
+                [this]
+                {
+                    return warm_stop_.load();
+                }, ec);
+        }, std::forward<Progress>(progress));
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+prefetch(
+    void const* const* keys,
+    std::size_t n,
+    bool values,
     error_code& ec)
 {
     using namespace detail;
@@ -264,85 +586,300 @@ insert(
         ec = ec_;
         return;
     }
-    // Data Record
-    BOOST_ASSERT(size > 0);                     // zero disallowed
-    BOOST_ASSERT(size <= field<uint32_t>::max); // too large
-    auto const h =
-        hash(key, s_->kh.key_size, s_->hasher);
-    std::lock_guard<std::mutex> u{u_};
+    buffer buf;
+    for(std::size_t i = 0; i < n; ++i)
     {
+        auto const key = keys[i];
+        auto const h =
+            hash(key, s_->kh.key_size, s_->hasher);
         shared_lock_type m{m_};
         if(s_->p1.find(key) != s_->p1.end() ||
            s_->p0.find(key) != s_->p0.end())
+            continue;
+        nsize_t size;
+        if(s_->recent.find(h, key, size))
+            continue;
+        auto const bn = bucket_index(h, buckets_, modulus_);
+        if(s_->c1.find(bn) != s_->c1.end())
+            continue;
+        if(! values)
         {
-            ec = error::key_exists;
-            return;
-        }
-        auto const n = bucket_index(h, buckets_, modulus_);
-        auto const iter = s_->c1.find(n);
-        if(iter != s_->c1.end())
-        {
-            auto const found = exists(
-                h, key, &m, iter->second, ec);
+            if(resident_)
+                continue;
+            m.unlock();
+            auto const offset =
+                static_cast<noff_t>(bn + 1) * s_->kh.block_size;
+            detail::prefetch(s_->kf,
+                offset, s_->kh.block_size, ec);
             if(ec)
                 return;
-            if(found)
-            {
-                ec = error::key_exists;
-                return;
-            }
-            // m is now unlocked
+            continue;
         }
-        else
+        buf.reserve(s_->kh.block_size);
+        auto const b = read_bucket(bn, buf.get(), m, ec);
+        if(ec)
+            return;
+        for(auto j = b.lower_bound(h); j < b.size(); ++j)
         {
-            // VFALCO Audit for concurrency
-            genlock<gentex> g{g_};
-            m.unlock();
-            buffer buf;
-            buf.reserve(s_->kh.block_size);
-            bucket b{s_->kh.block_size, buf.get()};
-            b.read(s_->kf,
-                   static_cast<noff_t>(n + 1) * s_->kh.block_size, ec);
+            auto const item = b[j];
+            if(item.hash != h)
+                break;
+            detail::prefetch(s_->df, item.offset,
+                value_size(item.size, s_->kh.key_size), ec);
             if(ec)
                 return;
-            auto const found = exists(h, key, nullptr, b, ec);
+        }
+        if(b.spill())
+        {
+            detail::prefetch(s_->df, b.spill(),
+                bucket_size(s_->kh.capacity), ec);
             if(ec)
                 return;
-            if(found)
-            {
-                ec = error::key_exists;
-                return;
-            }
         }
     }
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+insert(
+    void const* key,
+    void const* data,
+    nsize_t size,
+    error_code& ec)
+{
+    using namespace detail;
+    BOOST_ASSERT(is_open());
+    if(ecb_)
+    {
+        ec = ec_;
+        return;
+    }
+    // Data Record
+    BOOST_ASSERT(size > 0);                     // zero disallowed
+    BOOST_ASSERT(size <= field<uint32_t>::max); // too large
+    auto const h =
+        hash(key, s_->kh.key_size, s_->hasher);
+    std::lock_guard<mutex_type> u{u_};
+    auto const found = exists(h, key, ec);
+    if(ec)
+        return;
+    if(found)
+    {
+        ec = error::key_exists;
+        return;
+    }
     // Perform insert
     unique_lock_type m{m_};
     s_->p1.insert(h, key, data, size);
-    // Did we go over the commit limit?
-    if(commit_limit_ > 0 &&
-        s_->p1.data_size() >= commit_limit_)
+    after_insert(m);
+    if(tracer_)
+        tracer_->insert(h, key, size);
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+insert(
+    write_batch const& batch,
+    error_code& ec)
+{
+    using namespace detail;
+    BOOST_ASSERT(is_open());
+    BOOST_ASSERT(batch.key_size() == s_->kh.key_size);
+    if(ecb_)
+    {
+        ec = ec_;
+        return;
+    }
+    if(batch.empty())
+        return;
+    std::vector<nhash_t> hashes;
+    hashes.reserve(batch.size());
+    for(auto const& e : batch.pool_)
+        hashes.push_back(hash(
+            e.first.key, s_->kh.key_size, s_->hasher));
+    std::lock_guard<mutex_type> u{u_};
+    auto h = hashes.begin();
+    for(auto const& e : batch.pool_)
+    {
+        auto const found = exists(*h++, e.first.key, ec);
+        if(ec)
+            return;
+        if(found)
+        {
+            ec = error::key_exists;
+            return;
+        }
+    }
+    // Insert everything under one lock so
+    // the commit thread sees all or none.
+    unique_lock_type m{m_};
+    h = hashes.begin();
+    for(auto const& e : batch.pool_)
+        s_->p1.insert(*h++,
+            e.first.key, e.first.data, e.first.size);
+    after_insert(m);
+    if(tracer_)
+    {
+        h = hashes.begin();
+        for(auto const& e : batch.pool_)
+            tracer_->insert(*h++, e.first.key, e.first.size);
+    }
+}
+
+template<class Hasher, class File, class Policy>
+void*
+basic_store<Hasher, File, Policy>::
+insert_prepare(
+    void const* key,
+    nsize_t size,
+    error_code& ec)
+{
+    if(! begin_insert(key, size, false, ec))
+        return nullptr;
+    return pending_->data;
+}
+
+template<class Hasher, class File, class Policy>
+template<class Reader>
+void
+basic_store<Hasher, File, Policy>::
+insert(
+    void const* key,
+    nsize_t size,
+    Reader&& reader,
+    error_code& ec)
+{
+    using namespace detail;
+    if(! begin_insert(key, size,
+            size > s_->stage_thresh, ec))
+        return;
+    if(pending_->data)
+    {
+        reader(pending_->data, size, ec);
+        if(ec)
+            return insert_cancel();
+        return insert_commit(ec);
+    }
+    // Copy the value to the stage file in pieces
+    auto& sf = s_->sf1;
+    if(! sf.f.is_open())
+    {
+        sf.f.create(file_mode::write, sf.path, ec);
+        if(ec)
+            return insert_cancel();
+    }
+    buffer buf{std::min<std::size_t>(size, dataWriteSize_)};
+    for(std::size_t n = 0; n < size;)
+    {
+        auto const amount = std::min<std::size_t>(
+            size - n, buf.size());
+        reader(buf.get(), amount, ec);
+        if(ec)
+            return insert_cancel();
+        sf.f.write(pending_->stage + n,
+            buf.get(), amount, ec);
+        if(ec)
+            return insert_cancel();
+        n += amount;
+    }
+    insert_commit(ec);
+}
+
+template<class Hasher, class File, class Policy>
+bool
+basic_store<Hasher, File, Policy>::
+begin_insert(
+    void const* key,
+    nsize_t size,
+    bool stage,
+    error_code& ec)
+{
+    using namespace detail;
+    BOOST_ASSERT(is_open());
+    if(ecb_)
+    {
+        ec = ec_;
+        return false;
+    }
+    // Data Record
+    BOOST_ASSERT(size > 0);                     // zero disallowed
+    BOOST_ASSERT(size <= field<uint32_t>::max); // too large
+    BOOST_ASSERT(pending_thread_.load() !=
+        std::this_thread::get_id());
+    auto const h =
+        hash(key, s_->kh.key_size, s_->hasher);
+    std::unique_lock<mutex_type> u{u_};
+    auto const found = exists(h, key, ec);
+    if(ec)
+        return false;
+    if(found)
+    {
+        ec = error::key_exists;
+        return false;
+    }
+    {
+        unique_lock_type m{m_};
+        if(stage)
+            pending_.emplace(s_->p1.prepare_staged(
+                h, key, size, s_->sf1.size));
+        else
+            pending_.emplace(s_->p1.prepare(h, key, size));
+    }
+    // Keep inserts serialized until the value is published
+    pending_lock_ = std::move(u);
+    pending_thread_ = std::this_thread::get_id();
+    return true;
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+insert_commit(error_code& ec)
+{
+    BOOST_ASSERT(pending_);
+    BOOST_ASSERT(pending_thread_.load() ==
+        std::this_thread::get_id());
+    pending_thread_ = std::thread::id{};
+    auto const u = std::move(pending_lock_);
+    if(ecb_)
     {
-        // Yes, start a new commit
-        cond_.notify_all();
-        // Wait for pool to shrink
-        cond_limit_.wait(m,
-            [this]()
-            {
-                return s_->p1.data_size() < commit_limit_;
-            });
+        ec = ec_;
+        insert_cancel();
+        return;
     }
-    auto const notify = s_->p1.data_size() >= s_->pool_thresh;
-    m.unlock();
-    if(notify)
-        cond_.notify_all();
+    unique_lock_type m{m_};
+    s_->p1.insert(*pending_);
+    if(! pending_->data)
+        s_->sf1.size += pending_->size;
+    if(tracer_)
+        tracer_->insert(pending_->hash,
+            pending_->key, pending_->size);
+    pending_ = boost::none;
+    cond_pending_.notify_all();
+    after_insert(m);
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+insert_cancel()
+{
+    BOOST_ASSERT(pending_);
+    pending_thread_ = std::thread::id{};
+    auto const u = std::move(pending_lock_);
+    unique_lock_type m{m_};
+    pending_ = boost::none;
+    cond_pending_.notify_all();
 }
 
 // Fetch key in loaded bucket b or its spills.
 //
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 template<class Callback>
 void
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 fetch(
     detail::nhash_t h,
     void const* key,
@@ -394,9 +931,9 @@ fetch(
 // Returns `true` if the key exists
 // lock is unlocked after the first bucket processed
 //
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 bool
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 exists(
     detail::nhash_t h,
     void const* key,
@@ -437,14 +974,155 @@ exists(
     return false;
 }
 
+// Returns `true` if the key exists in the
+// pools, the cache, or the key file.
+// Caller must hold u_
+//
+template<class Hasher, class File, class Policy>
+bool
+basic_store<Hasher, File, Policy>::
+exists(
+    detail::nhash_t h,
+    void const* key,
+    error_code& ec)
+{
+    using namespace detail;
+    shared_lock_type m{m_};
+    if(s_->p1.find(key) != s_->p1.end() ||
+       s_->p0.find(key) != s_->p0.end())
+        return true;
+    nsize_t size;
+    if(s_->recent.find(h, key, size))
+        return true;
+    auto const n = bucket_index(h, buckets_, modulus_);
+    auto const iter = s_->c1.find(n);
+    if(iter != s_->c1.end())
+        // m is unlocked after the first bucket
+        return exists(h, key, &m, iter->second, ec);
+    buffer buf;
+    buf.reserve(s_->kh.block_size);
+    auto const b = read_bucket(n, buf.get(), m, ec);
+    if(ec)
+        return false;
+    return exists(h, key, nullptr, b, ec);
+}
+
+// Read bucket n into buf for a caller holding
+// m_ shared, which is released before returning.
+//
+template<class Hasher, class File, class Policy>
+detail::bucket
+basic_store<Hasher, File, Policy>::
+read_bucket(
+    nbuck_t n,
+    void* buf,
+    shared_lock_type& m,
+    error_code& ec)
+{
+    using namespace detail;
+    if(resident_)
+    {
+        // Commit only changes buckets which
+        // are in c1, so the copy is consistent.
+        std::memcpy(buf, s_->ki.at(n), s_->kh.block_size);
+        m.unlock();
+        return bucket{s_->kh.block_size, buf};
+    }
+    // VFALCO Audit for concurrency
+    genlock<gentex_type> g{g_};
+    m.unlock();
+    if(use_bc())
+    {
+        auto const hit = s_->bc.read(n, buf, ec);
+        bc_error(ec);
+        if(hit)
+            return bucket{s_->kh.block_size, buf};
+    }
+    bucket b{s_->kh.block_size, buf};
+    b.read(s_->kf,
+           static_cast<noff_t>(n + 1) * s_->kh.block_size, ec);
+    if(ec)
+        return b;
+    // Commit cannot change this bucket while
+    // we hold g, so the copy is not stale.
+    if(use_bc())
+    {
+        s_->bc.write(n, buf, ec);
+        bc_error(ec);
+    }
+    return b;
+}
+
+// Returns the memory used by keys and values in p
+//
+template<class Hasher, class File, class Policy>
+std::size_t
+basic_store<Hasher, File, Policy>::
+pool_bytes(detail::pool const& p) const
+{
+    return p.data_size() + p.size() * s_->kh.key_size;
+}
+
+// Allocate whole extents of a file of the given
+// size, so that writes up to end need no new storage.
+//
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+reserve(File& f, noff_t size, noff_t end,
+    std::uint64_t extent, noff_t& allocated)
+{
+    if(extent == 0 || end <= allocated)
+        return;
+    auto const offset = std::max(size, allocated);
+    allocated = ((end + extent - 1) / extent) * extent;
+    // This is only a hint. Any real shortage
+    // of space is reported by the writes.
+    error_code ec;
+    detail::allocate(f, offset, allocated - offset, ec);
+}
+
+// Called with m_ held after a value is added to p1
+//
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+after_insert(unique_lock_type& m)
+{
+    // Without a commit thread the pool
+    // grows until the caller commits.
+    if(! Policy::background)
+    {
+        m.unlock();
+        return;
+    }
+    // Did we go over the commit limit?
+    if(commit_limit_ > 0 &&
+        s_->p1.data_size() >= commit_limit_)
+    {
+        // Yes, start a new commit
+        wake();
+        // Wait for pool to shrink
+        cond_limit_.wait(m,
+            [this]()
+            {
+                return s_->p1.data_size() < commit_limit_;
+            });
+    }
+    auto const notify = s_->p1.data_size() >= s_->pool_thresh;
+    m.unlock();
+    if(notify)
+        wake();
+}
+
 //  Split the bucket in b1 to b2
 //  b1 must be loaded
 //  tmp is used as a temporary buffer
 //  splits are written but not the new buckets
 //
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 void
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 split(
     detail::bucket& b1,
     detail::bucket& b2,
@@ -523,9 +1201,9 @@ split(
     }
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 detail::bucket
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 load(
     nbuck_t n,
     detail::cache& c1,
@@ -540,6 +1218,24 @@ load(
     iter = c0.find(n);
     if(iter != c0.end())
         return c1.insert(n, iter->second)->second;
+    if(resident_)
+    {
+        std::memcpy(buf, s_->ki.at(n), s_->kh.block_size);
+        bucket tmp{s_->kh.block_size, buf};
+        c0.insert(n, tmp);
+        return c1.insert(n, tmp)->second;
+    }
+    if(use_bc())
+    {
+        auto const hit = s_->bc.read(n, buf, ec);
+        bc_error(ec);
+        if(hit)
+        {
+            bucket tmp{s_->kh.block_size, buf};
+            c0.insert(n, tmp);
+            return c1.insert(n, tmp)->second;
+        }
+    }
     bucket tmp{s_->kh.block_size, buf};
     tmp.read(s_->kf,
              static_cast<noff_t>(n + 1) * s_->kh.block_size, ec);
@@ -549,15 +1245,56 @@ load(
     return c1.insert(n, tmp)->second;
 }
 
-template<class Hasher, class File>
+template<class Hasher, class File, class Policy>
 void
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 commit(error_code& ec)
+{
+    BOOST_ASSERT(is_open());
+    // Waiting for our own insert would never end
+    BOOST_ASSERT(pending_thread_.load() !=
+        std::this_thread::get_id());
+    std::lock_guard<mutex_type> c{cm_};
+    if(ecb_)
+    {
+        ec = ec_;
+        return;
+    }
+    do_commit(ec);
+    if(ec)
+    {
+        ec_ = ec;
+        ecb_.store(true);
+        return;
+    }
+    if(tracer_)
+        tracer_->commit();
+}
+
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+do_commit(error_code& ec)
 {
     using namespace detail;
     buffer buf1{s_->kh.block_size};
     buffer buf2{s_->kh.block_size};
     bucket tmp{s_->kh.block_size, buf1.get()};
+    // Syncs the data file during the rest of
+    // the commit, joined on every return path.
+    error_code ecd;
+    std::thread sync_df;
+    struct joiner
+    {
+        std::thread& t;
+
+        ~joiner()
+        {
+            if(t.joinable())
+                t.join();
+        }
+    };
+    joiner j{sync_df};
     // Empty cache put in place temporarily
     // so we can reuse the memory from s_->c1
     cache c1;
@@ -565,30 +1302,36 @@ commit(error_code& ec)
         unique_lock_type m{m_};
         if(s_->p1.empty())
             return;
+        // Don't swap the pools out from
+        // under an insert in progress.
+        cond_pending_.wait(m,
+            [this]()
+            {
+                return ! pending_;
+            });
         if(s_->p1.data_size() >= commit_limit_)
             cond_limit_.notify_all();
         swap(s_->c1, c1);
         swap(s_->p0, s_->p1);
+        std::swap(s_->sf0, s_->sf1);
         s_->pool_thresh = std::max(
             s_->pool_thresh, s_->p0.data_size());
         m.unlock();
     }
+    read_wait_left_ = 64 * read_priority_;
     // Prepare rollback information
-    log_file_header lh;
-    lh.version = currentVersion;            // Version
-    lh.uid = s_->kh.uid;                    // UID
-    lh.appnum = s_->kh.appnum;              // Appnum
-    lh.key_size = s_->kh.key_size;          // Key Size
-    lh.salt = s_->kh.salt;                  // Salt
-    lh.pepper = pepper<Hasher>(lh.salt);    // Pepper
-    lh.block_size = s_->kh.block_size;      // Block Size
+    auto lh = make_log_header(s_->kh);
     lh.key_file_size = s_->kf.size(ec);     // Key File Size
     if(ec)
         return;
     lh.dat_file_size = s_->df.size(ec);     // Data File Size
     if(ec)
         return;
-    write(s_->lf, lh, ec);
+    if(log_reserve_ > 0)
+        write(s_->lf, reusable_log_header{
+            lh, log_sequence_}, ec);
+    else
+        write(s_->lf, lh, ec);
     if(ec)
         return;
     // Checkpoint
@@ -603,7 +1346,14 @@ commit(error_code& ec)
         auto const size = s_->df.size(ec);
         if(ec)
             return;
-        bulk_writer<File> w{s_->df, size, dataWriteSize_};
+        reserve(s_->df, size, size + pool_bytes(s_->p0) +
+            s_->p0.size() * field<uint48_t>::size,
+                dat_extent_, dat_allocated_);
+        bulk_writer<File> w{s_->df, size, dataWriteSize_,
+            [this](std::size_t bytes)
+            {
+                before_write(bytes);
+            }};
         // Write inserted data to the data file
         for(auto& e : s_->p0)
         {
@@ -612,13 +1362,32 @@ commit(error_code& ec)
             // of this object in memory
             e.second = w.offset();
             auto os = w.prepare(value_size(
-                e.first.size, s_->kh.key_size), ec);
+                e.first.data ? e.first.size : 0,
+                    s_->kh.key_size), ec);
             if(ec)
                 return;
             // Data Record
             write<uint48_t>(os, e.first.size);          // Size
             write(os, e.first.key, s_->kh.key_size);    // Key
-            write(os, e.first.data, e.first.size);      // Data
+            if(e.first.data)
+            {
+                write(os, e.first.data, e.first.size);  // Data
+                continue;
+            }
+            // Copy staged data in pieces
+            for(std::size_t n = 0; n < e.first.size;)
+            {
+                auto const amount = std::min<std::size_t>(
+                    e.first.size - n, dataWriteSize_);
+                auto ds = w.prepare(amount, ec);
+                if(ec)
+                    return;
+                s_->sf0.f.read(e.first.stage + n,
+                    ds.data(amount), amount, ec);
+                if(ec)
+                    return;
+                n += amount;
+            }
         }
         // Do inserts, splits, and build view
         // of original and modified buckets
@@ -660,25 +1429,82 @@ commit(error_code& ec)
         if(ec)
             return;
     }
+    // The data file is complete. Recovery only needs it
+    // durable before the log file is truncated, so its
+    // sync can overlap writing the log and key files.
+    if(parallel_sync_)
+        sync_df = std::thread(
+            [this, &ecd]
+            {
+                s_->df.sync(ecd);
+            });
+    // Copy the committed values for fetch. Only this
+    // thread changes p0, so no lock is needed yet.
+    recent_cache::batch recent{s_->kh.key_size};
+    auto const limit = recent_limit_.load();
+    for(auto const& e : s_->p0)
+    {
+        if(recent.size() >= limit)
+            break;
+        if(e.first.data)
+            recent.insert(e.first.hash, e.first.key,
+                e.first.data, e.first.size);
+    }
     // Give readers a view of the new buckets.
     // This might be slightly better than the old
     // view since there could be fewer spills.
     {
         unique_lock_type m{m_};
         swap(c1, s_->c1);
+        s_->recent.insert(recent);
+        s_->recent.trim(recent_limit_);
         s_->p0.clear();
+        if(resident_)
+            s_->ki.grow(buckets);
         buckets_ = buckets;
         modulus_ = modulus;
         g_.start();
     }
+    // Staged values are in the data file now
+    if(s_->sf0.size > 0)
+    {
+        s_->sf0.f.trunc(0, ec);
+        if(ec)
+            return;
+        s_->sf0.size = 0;
+    }
     // Write clean buckets to log file
     {
-        auto const size = s_->lf.size(ec);
+        // A reusable log overwrites old records
+        auto const size = log_reserve_ > 0 ?
+            reusable_log_header::size : s_->lf.size(ec);
         if(ec)
             return;
-        bulk_writer<File> w{s_->lf, size, logWriteSize_};
+        bulk_writer<File> w{s_->lf, size, logWriteSize_,
+            [this](std::size_t bytes)
+            {
+                before_write(bytes);
+            }};
         for(auto const e : s_->c0)
         {
+            if(log_reserve_ > 0)
+            {
+                auto const n = e.second.actual_size();
+                auto os = w.prepare(
+                    reusable_log_header::record_overhead +
+                        n, ec);
+                if(ec)
+                    return;
+                // Log Record
+                auto const p = os.data(0);
+                write<std::uint64_t>(os, log_sequence_);// Sequence
+                write<std::uint64_t>(os, e.first);      // Index
+                write<std::uint16_t>(os, n);            // Size
+                e.second.write(os);                     // Bucket
+                write<std::uint64_t>(os, XXH64(p,       // Checksum
+                    os.size(), log_sequence_));
+                continue;
+            }
             // Log Record
             auto os = w.prepare(
                 field<std::uint64_t>::size +    // Index
@@ -699,23 +1525,85 @@ commit(error_code& ec)
     }
     g_.finish();
     // Write new buckets to key file
+    reserve(s_->kf, lh.key_file_size,
+        (static_cast<noff_t>(buckets) + 1) *
+            s_->kh.block_size, key_extent_, key_allocated_);
+    // Buckets are written one at a time, but the
+    // writes wait for fetches once per slice.
+    auto const slice = std::max<std::size_t>(
+        1, dataWriteSize_ / s_->kh.block_size);
+    auto remain = s_->c1.size();
+    std::size_t n = 0;
     for(auto const e : s_->c1)
     {
+        if(n == 0)
+        {
+            n = std::min(slice, remain);
+            before_write(n * s_->kh.block_size);
+        }
+        --n;
+        --remain;
         e.second.write(s_->kf,
            (e.first + 1) * s_->kh.block_size, ec);
         if(ec)
             return;
+        if(resident_)
+        {
+            // Readers use c1 for this bucket
+            // until it is cleared below.
+            auto const p = s_->ki.at(e.first);
+            auto const size = e.second.actual_size();
+            ostream os{p, size};
+            e.second.write(os);
+            std::memset(p + size, 0, s_->kh.block_size - size);
+        }
+        else if(use_bc())
+        {
+            // Write through to the cache
+            ostream os{buf1.get(), s_->kh.block_size};
+            e.second.write(os);
+            std::memset(buf1.get() + e.second.actual_size(), 0,
+                s_->kh.block_size - e.second.actual_size());
+            s_->bc.write(e.first, buf1.get(), ec);
+            bc_error(ec);
+        }
     }
     // Finalize the commit
-    s_->df.sync(ec);
-    if(ec)
-        return;
-    s_->kf.sync(ec);
-    if(ec)
-        return;
-    s_->lf.trunc(0, ec);
-    if(ec)
-        return;
+    if(parallel_sync_)
+    {
+        s_->kf.sync(ec);
+        sync_df.join();
+        if(ec)
+            return;
+        ec = ecd;
+        if(ec)
+            return;
+    }
+    else
+    {
+        s_->df.sync(ec);
+        if(ec)
+            return;
+        s_->kf.sync(ec);
+        if(ec)
+            return;
+    }
+    if(log_reserve_ > 0)
+    {
+        // Mark the log as having no commit,
+        // without changing the file size.
+        lh.dat_file_size = 0;
+        write(s_->lf, reusable_log_header{
+            lh, ++log_sequence_}, ec);
+        if(ec)
+            return;
+    }
+    else
+    {
+        s_->lf.trunc(0, ec);
+        if(ec)
+            return;
+    }
     s_->lf.sync(ec);
     if(ec)
         return;
@@ -729,11 +1617,192 @@ commit(error_code& ec)
     }
 }
 
-template<class Hasher, class File>
+// Returns a log file header without file sizes
+//
+template<class Hasher, class File, class Policy>
+detail::log_file_header
+basic_store<Hasher, File, Policy>::
+make_log_header(detail::key_file_header const& kh)
+{
+    using namespace detail;
+    log_file_header lh;
+    lh.version = currentVersion;            // Version
+    lh.uid = kh.uid;                        // UID
+    lh.appnum = kh.appnum;                  // Appnum
+    lh.key_size = kh.key_size;              // Key Size
+    lh.salt = kh.salt;                      // Salt
+    lh.pepper = pepper<Hasher>(lh.salt);    // Pepper
+    lh.block_size = kh.block_size;          // Block Size
+    lh.key_file_size = 0;                   // Key File Size
+    lh.dat_file_size = 0;                   // Data File Size
+    return lh;
+}
+
+// Prepare a reusable log file after recovery
+//
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+init_log(File& lf, detail::key_file_header const& kh,
+    error_code& ec)
+{
+    using namespace detail;
+    auto size = lf.size(ec);
+    if(ec)
+        return;
+    log_sequence_ = 0;
+    if(size > 0)
+    {
+        reusable_log_header h;
+        read(lf, h, ec);
+        if(ec)
+            return;
+        verify<Hasher>(h, ec);
+        if(! ec && h.lh.uid == kh.uid)
+        {
+            log_sequence_ = h.sequence;
+        }
+        else
+        {
+            // Records from another database could
+            // have any sequence, so discard them.
+            ec = {};
+            lf.trunc(0, ec);
+            if(ec)
+                return;
+            size = 0;
+        }
+    }
+    // Write the header first, so that recover
+    // never sees a file without one.
+    write(lf, reusable_log_header{
+        make_log_header(kh), log_sequence_}, ec);
+    if(ec)
+        return;
+    size = std::max<noff_t>(size, reusable_log_header::size);
+    // Allocate the file now so commits
+    // do not change its size.
+    if(size < log_reserve_)
+    {
+        buffer buf{64 * 1024};
+        std::memset(buf.get(), 0, buf.size());
+        while(size < log_reserve_)
+        {
+            auto const n = static_cast<std::size_t>(
+                std::min<std::uint64_t>(buf.size(),
+                    log_reserve_ - size));
+            lf.write(size, buf.get(), n, ec);
+            if(ec)
+                return;
+            size += n;
+        }
+    }
+    lf.sync(ec);
+}
+
+// Request a commit
+//
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+wake()
+{
+    if(ex_)
+        ex_->notify(ex_id_);
+    else
+        cond_.notify_all();
+}
+
+// Called before each write made by a commit
+//
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+before_write(std::size_t bytes)
+{
+    if(limiter_)
+        limiter_->request(bytes);
+    if(read_priority_.count() == 0 ||
+            read_wait_left_.count() <= 0 ||
+                readers_.load() == 0)
+        return;
+    // Let waiting fetches reach the device first
+    using clock_type = std::chrono::steady_clock;
+    auto const start = clock_type::now();
+    auto const until = start + std::min<clock_type::duration>(
+        read_priority_, read_wait_left_);
+    {
+        std::unique_lock<std::mutex> l{readers_m_};
+        readers_cv_.wait_until(l, until,
+            [this]
+            {
+                return readers_.load() == 0;
+            });
+    }
+    read_wait_left_ -= clock_type::now() - start;
+}
+
+// Reclaim memory while idle, returns `true`
+// when there is nothing left to reclaim.
+//
+template<class Hasher, class File, class Policy>
+bool
+basic_store<Hasher, File, Policy>::
+shrink()
+{
+    unique_lock_type m{m_};
+    s_->pool_thresh =
+        std::max<std::size_t>(
+            1, s_->pool_thresh / 2);
+    s_->p1.shrink_to_fit();
+    s_->p0.shrink_to_fit();
+    s_->c1.shrink_to_fit();
+    s_->c0.shrink_to_fit();
+    return s_->pool_thresh == 1;
+}
+
+// Called by the executor, which
+// never calls it concurrently.
+//
+template<class Hasher, class File, class Policy>
+void
+basic_store<Hasher, File, Policy>::
+work(bool idle)
+{
+    if(ecb_)
+        return;
+    bool busy;
+    {
+        shared_lock_type m{m_};
+        busy = ! s_->p1.empty();
+    }
+    {
+        std::lock_guard<mutex_type> c{cm_};
+        do_commit(ec_);
+    }
+    if(ec_)
+    {
+        ecb_.store(true);
+        return;
+    }
+    if(! idle)
+        return;
+    // Idle databases are skipped once their
+    // memory has been released, so that many
+    // databases may share an executor cheaply.
+    if(busy)
+        released_ = false;
+    if(! released_)
+        released_ = shrink();
+}
+
+template<class Hasher, class File, class Policy>
 void
-basic_store<Hasher, File>::
+basic_store<Hasher, File, Policy>::
 run()
 {
+    if(read_priority_.count() > 0)
+        detail::lower_io_priority();
     auto const pred =
         [this]()
         {
@@ -755,7 +1824,10 @@ run()
             if(! open_)
                 break;
             m.unlock();
-            commit(ec_);
+            {
+                std::lock_guard<mutex_type> c{cm_};
+                do_commit(ec_);
+            }
             if(ec_)
             {
                 ecb_.store(true);
@@ -764,20 +1836,11 @@ run()
             // Reclaim some memory if
             // we get a spare moment.
             if(timeout)
-            {
-                m.lock();
-                s_->pool_thresh =
-                    std::max<std::size_t>(
-                        1, s_->pool_thresh / 2);
-                s_->p1.shrink_to_fit();
-                s_->p0.shrink_to_fit();
-                s_->c1.shrink_to_fit();
-                s_->c0.shrink_to_fit();
-                m.unlock();
-            }
+                shrink();
         }
     }
-    commit(ec_);
+    std::lock_guard<mutex_type> c{cm_};
+    do_commit(ec_);
     if(ec_)
     {
         ecb_.store(true);
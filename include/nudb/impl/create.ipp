@@ -140,9 +140,9 @@ create(
         return;
     }
 fail:
-    erase_file(dat_path);
-    erase_file(key_path);
-    erase_file(log_path);
+    erase_file<File>(dat_path);
+    erase_file<File>(key_path);
+    erase_file<File>(log_path);
 }
 
 } // nudb
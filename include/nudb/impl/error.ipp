@@ -149,6 +149,12 @@ nudb_category()
             case error::duplicate_value:
                 return "duplicate value";
 
+            case error::not_trace_file:
+                return "not a trace file";
+
+            case error::invalid_trace_record:
+                return "invalid trace record";
+
             default:
                 return "nudb error";
             }
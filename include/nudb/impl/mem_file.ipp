@@ -0,0 +1,259 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_IMPL_MEM_FILE_IPP
+#define NUDB_IMPL_MEM_FILE_IPP
+
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace nudb {
+
+namespace detail {
+
+template<class _>
+std::shared_ptr<mem_file_data>
+mem_file_system_t<_>::
+create(path_type const& path, error_code& ec)
+{
+    std::lock_guard<std::mutex> lock{m_};
+    auto& data = files_[path];
+    if(data)
+    {
+        ec = error_code{errc::file_exists, generic_category()};
+        return nullptr;
+    }
+    data = std::make_shared<mem_file_data>();
+    return data;
+}
+
+template<class _>
+std::shared_ptr<mem_file_data>
+mem_file_system_t<_>::
+open(path_type const& path, error_code& ec)
+{
+    std::lock_guard<std::mutex> lock{m_};
+    auto const it = files_.find(path);
+    if(it == files_.end())
+    {
+        ec = error_code{errc::no_such_file_or_directory,
+            generic_category()};
+        return nullptr;
+    }
+    return it->second;
+}
+
+template<class _>
+void
+mem_file_system_t<_>::
+erase(path_type const& path, error_code& ec)
+{
+    std::lock_guard<std::mutex> lock{m_};
+    if(files_.erase(path) == 0)
+        ec = error_code{errc::no_such_file_or_directory,
+            generic_category()};
+}
+
+} // detail
+
+inline
+mem_file::
+mem_file(mem_file&& other)
+    : data_(std::move(other.data_))
+    , writable_(other.writable_)
+{
+    other.writable_ = false;
+}
+
+inline
+mem_file&
+mem_file::
+operator=(mem_file&& other)
+{
+    if(&other == this)
+        return *this;
+    data_ = std::move(other.data_);
+    writable_ = other.writable_;
+    other.writable_ = false;
+    return *this;
+}
+
+inline
+void
+mem_file::
+close()
+{
+    data_.reset();
+    writable_ = false;
+}
+
+inline
+void
+mem_file::
+create(file_mode mode, path_type const& path, error_code& ec)
+{
+    BOOST_ASSERT(! is_open());
+    data_ = detail::mem_file_system::instance().create(path, ec);
+    if(ec)
+        return;
+    writable_ = writable(mode);
+}
+
+inline
+void
+mem_file::
+open(file_mode mode, path_type const& path, error_code& ec)
+{
+    BOOST_ASSERT(! is_open());
+    data_ = detail::mem_file_system::instance().open(path, ec);
+    if(ec)
+        return;
+    writable_ = writable(mode);
+}
+
+inline
+void
+mem_file::
+erase(path_type const& path, error_code& ec)
+{
+    detail::mem_file_system::instance().erase(path, ec);
+}
+
+inline
+std::uint64_t
+mem_file::
+size(error_code&) const
+{
+    BOOST_ASSERT(is_open());
+    boost::shared_lock<boost::shared_mutex> lock{data_->m};
+    return data_->size;
+}
+
+inline
+void
+mem_file::
+read(std::uint64_t offset,
+     void* buffer, std::size_t bytes, error_code& ec)
+{
+    using detail::mem_file_data;
+    BOOST_ASSERT(is_open());
+    boost::shared_lock<boost::shared_mutex> lock{data_->m};
+    auto const& d = *data_;
+    if(offset >= d.size || bytes > d.size - offset)
+    {
+        ec = error::short_read;
+        return;
+    }
+    auto p = static_cast<std::uint8_t*>(buffer);
+    while(bytes > 0)
+    {
+        auto const i = static_cast<std::size_t>(
+            offset / mem_file_data::chunk_size);
+        auto const pos = static_cast<std::size_t>(
+            offset % mem_file_data::chunk_size);
+        auto const amount = std::min<std::size_t>(
+            bytes, mem_file_data::chunk_size - pos);
+        if(i < d.chunks.size() && d.chunks[i])
+            std::memcpy(p, d.chunks[i].get() + pos, amount);
+        else
+            std::memset(p, 0, amount);
+        offset += amount;
+        bytes -= amount;
+        p += amount;
+    }
+}
+
+inline
+void
+mem_file::
+write(std::uint64_t offset,
+      void const* buffer, std::size_t bytes, error_code& ec)
+{
+    using detail::mem_file_data;
+    BOOST_ASSERT(is_open());
+    if(! writable_)
+    {
+        ec = error_code{errc::bad_file_descriptor,
+            generic_category()};
+        return;
+    }
+    boost::unique_lock<boost::shared_mutex> lock{data_->m};
+    auto& d = *data_;
+    auto const end = offset + bytes;
+    auto const count = static_cast<std::size_t>(
+        (end + mem_file_data::chunk_size - 1) /
+            mem_file_data::chunk_size);
+    if(d.chunks.size() < count)
+        d.chunks.resize(count);
+    auto p = static_cast<std::uint8_t const*>(buffer);
+    while(bytes > 0)
+    {
+        auto const i = static_cast<std::size_t>(
+            offset / mem_file_data::chunk_size);
+        auto const pos = static_cast<std::size_t>(
+            offset % mem_file_data::chunk_size);
+        auto const amount = std::min<std::size_t>(
+            bytes, mem_file_data::chunk_size - pos);
+        auto& chunk = d.chunks[i];
+        if(! chunk)
+            chunk.reset(new std::uint8_t[
+                mem_file_data::chunk_size]());
+        std::memcpy(chunk.get() + pos, p, amount);
+        offset += amount;
+        bytes -= amount;
+        p += amount;
+    }
+    if(end > d.size)
+        d.size = end;
+}
+
+inline
+void
+mem_file::
+sync(error_code&)
+{
+    BOOST_ASSERT(is_open());
+}
+
+inline
+void
+mem_file::
+trunc(std::uint64_t length, error_code& ec)
+{
+    using detail::mem_file_data;
+    BOOST_ASSERT(is_open());
+    if(! writable_)
+    {
+        ec = error_code{errc::bad_file_descriptor,
+            generic_category()};
+        return;
+    }
+    boost::unique_lock<boost::shared_mutex> lock{data_->m};
+    auto& d = *data_;
+    if(length < d.size)
+    {
+        // Release the storage past the end, and clear
+        // the rest of the last chunk so the file reads
+        // as zero if it is extended again.
+        auto const i = static_cast<std::size_t>(
+            length / mem_file_data::chunk_size);
+        auto const pos = static_cast<std::size_t>(
+            length % mem_file_data::chunk_size);
+        auto const count = i + (pos > 0 ? 1 : 0);
+        if(d.chunks.size() > count)
+            d.chunks.resize(count);
+        if(pos > 0 && i < d.chunks.size() && d.chunks[i])
+            std::memset(d.chunks[i].get() + pos, 0,
+                mem_file_data::chunk_size - pos);
+    }
+    d.size = length;
+}
+
+} // nudb
+
+#endif
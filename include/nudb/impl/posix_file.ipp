@@ -209,6 +209,49 @@ trunc(std::uint64_t length, error_code& ec)
     }
 }
 
+inline
+void
+posix_file::
+prefetch(std::uint64_t offset,
+    std::size_t bytes, error_code& ec)
+{
+#ifdef __APPLE__
+    radvisory ra;
+    ra.ra_offset = static_cast<off_t>(offset);
+    ra.ra_count = static_cast<int>(bytes);
+    if(::fcntl(fd_, F_RDADVISE, &ra) == -1)
+        return last_err(ec);
+#else
+    auto const ev = ::posix_fadvise(fd_,
+        offset, bytes, POSIX_FADV_WILLNEED);
+    if(ev != 0)
+        return err(ev, ec);
+#endif
+}
+
+inline
+void
+posix_file::
+allocate(std::uint64_t offset,
+    std::uint64_t bytes, error_code& ec)
+{
+#ifdef __linux__
+    if(::fallocate(fd_, FALLOC_FL_KEEP_SIZE,
+        static_cast<off_t>(offset),
+            static_cast<off_t>(bytes)) == -1)
+    {
+        if(errno == EOPNOTSUPP || errno == ENOSYS)
+            return;
+        return last_err(ec);
+    }
+#else
+    // posix_fallocate would change the file size
+    (void)offset;
+    (void)bytes;
+    (void)ec;
+#endif
+}
+
 inline
 std::pair<int, int>
 posix_file::
@@ -14,6 +14,7 @@
 #include <nudb/detail/bucket.hpp>
 #include <nudb/detail/bulkio.hpp>
 #include <nudb/detail/format.hpp>
+#include <nudb/detail/xxhash.hpp>
 #include <boost/assert.hpp>
 #include <algorithm>
 #include <cstddef>
@@ -21,6 +22,146 @@
 
 namespace nudb {
 
+namespace detail {
+
+// Recover using a reusable log file. The file
+// is kept, and marked as having no commit.
+//
+template<
+    class Hasher,
+    class File,
+    class... Args>
+void
+recover_reusable(
+    File& df,
+    File& kf,
+    dat_file_header const& dh,
+    noff_t dataFileSize,
+    path_type const& log_path,
+    error_code& ec,
+    Args&&... args)
+{
+    // Opened for writing at any offset
+    File lf{args...};
+    lf.open(file_mode::write, log_path, ec);
+    if(ec)
+        return;
+    auto const logFileSize = lf.size(ec);
+    if(ec)
+        return;
+    reusable_log_header h;
+    read(lf, h, ec);
+    if(ec)
+        return;
+    verify<Hasher>(h, ec);
+    if(ec)
+        return;
+    if(h.lh.dat_file_size == 0)
+        return;
+    key_file_header kh;
+    read(kf, kh, ec);
+    if(ec)
+        return;
+    verify<Hasher>(kh, ec);
+    if(ec)
+        return;
+    verify<Hasher>(dh, kh, ec);
+    if(ec)
+        return;
+    {
+        auto lh = h.lh;
+        std::memcpy(lh.type, "nudb.log", 8);
+        verify<Hasher>(kh, lh, ec);
+        if(ec)
+            return;
+    }
+    {
+        auto const readSize = 1024 * kh.block_size;
+        auto const bucketSize = bucket_size(kh.capacity);
+        // Bytes covered by the checksum
+        auto const prefix =
+            field<std::uint64_t>::size +        // Sequence
+            field<std::uint64_t>::size +        // Index
+            field<std::uint16_t>::size;         // Size
+        buffer rec{prefix + kh.block_size};
+        buffer buf{kh.block_size};
+        bulk_reader<File> r{lf,
+            reusable_log_header::size, logFileSize, readSize};
+        // The commit's records end at the first one
+        // with another sequence or a bad checksum.
+        for(;;)
+        {
+            auto is = r.prepare(prefix, ec);
+            if(ec == error::short_read)
+            {
+                ec = {};
+                break;
+            }
+            if(ec)
+                return;
+            std::memcpy(rec.get(), is.data(0), prefix);
+            std::uint64_t seq;
+            std::uint64_t n;
+            nsize_t size;
+            read<std::uint64_t>(is, seq);           // Sequence
+            read<std::uint64_t>(is, n);             // Index
+            read<std::uint16_t>(is, size);          // Size
+            if(seq != h.sequence || size > kh.block_size)
+                break;
+            is = r.prepare(size +
+                field<std::uint64_t>::size, ec);    // Checksum
+            if(ec == error::short_read)
+            {
+                ec = {};
+                break;
+            }
+            if(ec)
+                return;
+            std::memcpy(rec.get() + prefix, is.data(size), size);
+            std::uint64_t hash;
+            read<std::uint64_t>(is, hash);
+            if(hash != XXH64(rec.get(), prefix + size, seq))
+                break;
+            std::memcpy(buf.get(), rec.get() + prefix, size);
+            std::memset(buf.get() + size, 0, kh.block_size - size);
+            bucket b{kh.block_size, buf.get()};
+            if(b.spill() && b.spill() + bucketSize > dataFileSize)
+            {
+                ec = error::invalid_log_spill;
+                return;
+            }
+            if(n > kh.buckets)
+            {
+                ec = error::invalid_log_index;
+                return;
+            }
+            b.write(kf, static_cast<noff_t>(n + 1) * kh.block_size, ec);
+            if(ec)
+                return;
+        }
+    }
+    df.trunc(h.lh.dat_file_size, ec);
+    if(ec)
+        return;
+    df.sync(ec);
+    if(ec)
+        return;
+    kf.trunc(h.lh.key_file_size, ec);
+    if(ec)
+        return;
+    kf.sync(ec);
+    if(ec)
+        return;
+    h.lh.dat_file_size = 0;
+    ++h.sequence;
+    write(lf, h, ec);
+    if(ec)
+        return;
+    lf.sync(ec);
+}
+
+} // detail
+
 template<
     class Hasher,
     class File,
@@ -65,7 +206,7 @@ recover(
     if(keyFileSize <= key_file_header::size)
     {
         kf.close();
-        erase_file(log_path, ec);
+        erase_file<File>(log_path, ec);
         if(ec)
             return;
         File::erase(key_path, ec);
@@ -99,6 +240,13 @@ recover(
     }
     if(ec)
         return;
+    if(std::string{lh.type, 8} == "nudb.lgr")
+    {
+        lf.close();
+        recover_reusable<Hasher>(df, kf, dh,
+            dataFileSize, log_path, ec, args...);
+        return;
+    }
     verify<Hasher>(lh, ec);
     if(ec)
         return;
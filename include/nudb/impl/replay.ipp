@@ -0,0 +1,414 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_IMPL_REPLAY_IPP
+#define NUDB_IMPL_REPLAY_IPP
+
+#include <nudb/type_traits.hpp>
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace nudb {
+
+namespace detail {
+
+// Records copied from a trace, for one thread
+struct replay_batch
+{
+    struct item
+    {
+        trace_op op;
+        std::uint64_t time;
+        nsize_t size;
+        std::size_t key;    // offset in keys
+    };
+
+    std::vector<item> items;
+    std::vector<std::uint8_t> keys;
+
+    void
+    add(trace_record const& r, nsize_t key_size)
+    {
+        auto const offset = keys.size();
+        if(r.key)
+        {
+            auto const p =
+                static_cast<std::uint8_t const*>(r.key);
+            keys.insert(keys.end(), p, p + key_size);
+        }
+        items.push_back({r.op, r.time, r.size, offset});
+    }
+};
+
+// Hands batches to one thread, holding
+// a limited number so memory is bounded.
+class replay_queue
+{
+    static std::size_t constexpr limit = 16;
+
+    std::mutex m_;
+    std::condition_variable cond_;
+    std::deque<replay_batch> q_;
+    bool done_ = false;
+
+public:
+    void
+    push(replay_batch&& b)
+    {
+        std::unique_lock<std::mutex> lock{m_};
+        cond_.wait(lock,
+            [&]
+            {
+                return q_.size() < limit;
+            });
+        q_.push_back(std::move(b));
+        cond_.notify_all();
+    }
+
+    // Called when no more batches will be pushed
+    void
+    finish()
+    {
+        std::lock_guard<std::mutex> lock{m_};
+        done_ = true;
+        cond_.notify_all();
+    }
+
+    // Returns `false` when finished and empty
+    bool
+    pop(replay_batch& b)
+    {
+        std::unique_lock<std::mutex> lock{m_};
+        cond_.wait(lock,
+            [&]
+            {
+                return ! q_.empty() || done_;
+            });
+        if(q_.empty())
+            return false;
+        b = std::move(q_.front());
+        q_.pop_front();
+        cond_.notify_all();
+        return true;
+    }
+};
+
+// Issues operations from one thread
+template<class Store, class Handler>
+class replay_player
+{
+    using clock_type = std::chrono::steady_clock;
+
+    Store& db_;
+    Handler& handler_;
+    std::size_t thread_;
+    double speed_;
+    std::uint64_t first_;
+    clock_type::time_point start_;
+    std::vector<std::uint8_t> value_;
+
+public:
+    replay_info info;
+    error_code ec;
+
+    replay_player(Store& db, Handler& handler,
+            std::size_t thread, double speed,
+                std::uint64_t first, clock_type::time_point start)
+        : db_(db)
+        , handler_(handler)
+        , thread_(thread)
+        , speed_(speed)
+        , first_(first)
+        , start_(start)
+    {
+    }
+
+    // Once an error occurs, the remaining
+    // records are ignored.
+    void
+    play(trace_op op, std::uint64_t time,
+        void const* key, nsize_t size);
+};
+
+template<class Store, class Handler>
+void
+replay_player<Store, Handler>::
+play(trace_op op, std::uint64_t time,
+    void const* key, nsize_t size)
+{
+    if(ec)
+        return;
+    if(speed_ > 0)
+    {
+        auto const due = start_ + std::chrono::duration_cast<
+            clock_type::duration>(std::chrono::duration<
+                double, std::micro>{(time - std::min(time, first_)) / speed_});
+        auto const now = clock_type::now();
+        if(now < due)
+            std::this_thread::sleep_until(due);
+        else if(now - due > info.max_lag)
+            info.max_lag = now - due;
+    }
+    auto const start = clock_type::now();
+    switch(op)
+    {
+    case trace_op::fetch:
+    {
+        nsize_t found = 0;
+        db_.fetch(key,
+            [&](void const*, std::size_t n)
+            {
+                found = static_cast<nsize_t>(n);
+            }, ec);
+        ++info.fetches;
+        if(ec == error::key_not_found)
+        {
+            ec = {};
+            ++info.fetch_misses;
+        }
+        if(! ec && found != size)
+            ++info.mismatches;
+        break;
+    }
+    case trace_op::insert:
+        if(value_.size() < size)
+            value_.resize(size);
+        db_.insert(key, value_.data(), size, ec);
+        ++info.inserts;
+        if(ec == error::key_exists)
+        {
+            ec = {};
+            ++info.duplicates;
+        }
+        break;
+    case trace_op::commit:
+        db_.commit(ec);
+        ++info.commits;
+        break;
+    }
+    if(ec)
+        return;
+    ++info.records;
+    handler_(thread_, op, clock_type::now() - start);
+}
+
+inline
+void
+add(replay_info& to, replay_info const& from)
+{
+    to.records += from.records;
+    to.fetches += from.fetches;
+    to.fetch_misses += from.fetch_misses;
+    to.mismatches += from.mismatches;
+    to.inserts += from.inserts;
+    to.duplicates += from.duplicates;
+    to.commits += from.commits;
+    to.max_lag = std::max(to.max_lag, from.max_lag);
+}
+
+// Insert a value for each key found by a fetch
+// before the trace inserts it, then commit.
+template<class Store>
+void
+replay_preload(
+    Store& db,
+    trace_reader& tr,
+    replay_info& info,
+    error_code& ec)
+{
+    // Bounds the memory used by the single_thread policy
+    std::uint64_t const commitInterval = 65536;
+
+    std::unordered_set<std::string> seen;
+    std::vector<std::uint8_t> value;
+    trace_record r;
+    std::uint64_t pending = 0;
+    while(tr.next(r, ec))
+    {
+        if(r.op == trace_op::commit)
+            continue;
+        std::string key{static_cast<char const*>(
+            r.key), tr.key_size()};
+        if(r.op == trace_op::insert)
+        {
+            seen.insert(std::move(key));
+            continue;
+        }
+        if(r.size == 0 || ! seen.insert(std::move(key)).second)
+            continue;
+        if(value.size() < r.size)
+            value.resize(r.size);
+        db.insert(r.key, value.data(), r.size, ec);
+        if(ec == error::key_exists)
+        {
+            ec = {};
+            continue;
+        }
+        if(ec)
+            return;
+        ++info.preloaded;
+        if(++pending >= commitInterval)
+        {
+            db.commit(ec);
+            if(ec)
+                return;
+            pending = 0;
+        }
+    }
+    if(ec)
+        return;
+    db.commit(ec);
+}
+
+} // detail
+
+template<class Store, class Handler>
+void
+replay(
+    Store& db,
+    path_type const& path,
+    replay_options const& options,
+    replay_info& info,
+    Handler&& handler,
+    error_code& ec)
+{
+    using namespace detail;
+    using clock_type = std::chrono::steady_clock;
+    using player_type = replay_player<Store,
+        typename std::remove_reference<Handler>::type>;
+    BOOST_ASSERT(db.is_open());
+    info = {};
+    trace_reader tr;
+    tr.open(path, ec);
+    if(ec)
+        return;
+    if(tr.key_size() != db.key_size())
+    {
+        ec = error::key_size_mismatch;
+        return;
+    }
+    if(options.preload)
+    {
+        replay_preload(db, tr, info, ec);
+        if(ec)
+            return;
+        tr.close();
+        tr.open(path, ec);
+        if(ec)
+            return;
+    }
+    trace_record r;
+    if(! tr.next(r, ec))
+        return;
+    auto const first = r.time;
+    auto last = first;
+    auto const threads =
+        std::max<std::size_t>(options.threads, 1);
+    auto const start = clock_type::now();
+    if(threads == 1)
+    {
+        // Play on the calling thread
+        player_type p{db, handler, 0,
+            options.speed, first, start};
+        do
+        {
+            p.play(r.op, r.time, r.key, r.size);
+            last = r.time;
+        }
+        while(! p.ec && tr.next(r, ec));
+        if(p.ec)
+            ec = p.ec;
+        add(info, p.info);
+    }
+    else
+    {
+        std::vector<std::unique_ptr<player_type>> players;
+        std::unique_ptr<replay_queue[]> queues{
+            new replay_queue[threads]};
+        std::vector<replay_batch> batches(threads);
+        std::vector<std::thread> workers;
+        for(std::size_t i = 0; i < threads; ++i)
+        {
+            players.emplace_back(new player_type{db,
+                handler, i, options.speed, first, start});
+            auto const p = players.back().get();
+            auto const q = &queues[i];
+            workers.emplace_back(
+                [p, q]
+                {
+                    replay_batch b;
+                    while(q->pop(b))
+                        for(auto const& e : b.items)
+                            p->play(e.op, e.time,
+                                e.op == trace_op::commit ?
+                                    nullptr : &b.keys[e.key],
+                                e.size);
+                });
+        }
+        // A thread which fails keeps draining its
+        // queue, so the loop below cannot block.
+        do
+        {
+            auto const i = r.op == trace_op::commit ?
+                0 : static_cast<std::size_t>(r.hash % threads);
+            auto& b = batches[i];
+            b.add(r, tr.key_size());
+            if(b.items.size() >= 256)
+            {
+                queues[i].push(std::move(b));
+                b = {};
+            }
+            last = r.time;
+        }
+        while(tr.next(r, ec));
+        for(std::size_t i = 0; i < threads; ++i)
+        {
+            if(! batches[i].items.empty())
+                queues[i].push(std::move(batches[i]));
+            queues[i].finish();
+        }
+        for(auto& t : workers)
+            t.join();
+        for(auto const& p : players)
+        {
+            if(p->ec && ! ec)
+                ec = p->ec;
+            add(info, p->info);
+        }
+    }
+    info.elapsed = clock_type::now() - start;
+    info.duration = std::chrono::microseconds(last - first);
+}
+
+template<class Store>
+void
+replay(
+    Store& db,
+    path_type const& path,
+    replay_options const& options,
+    replay_info& info,
+    error_code& ec)
+{
+    replay(db, path, options, info,
+        [](std::size_t, trace_op,
+            std::chrono::steady_clock::duration)
+        {
+        }, ec);
+}
+
+} // nudb
+
+#endif
@@ -18,6 +18,7 @@
 #include <cstddef>
 #include <limits>
 #include <string>
+#include <utility>
 
 namespace nudb {
 
@@ -538,6 +539,25 @@ verify(
     std::size_t bufferSize,
     Progress&& progress,
     error_code& ec)
+{
+    verify<Hasher, native_file>(info, dat_path, key_path,
+        bufferSize, std::forward<Progress>(progress), ec);
+}
+
+template<
+    class Hasher,
+    class File,
+    class Progress,
+    class... Args>
+void
+verify(
+    verify_info& info,
+    path_type const& dat_path,
+    path_type const& key_path,
+    std::size_t bufferSize,
+    Progress&& progress,
+    error_code& ec,
+    Args&&... args)
 {
     static_assert(is_Hasher<Hasher>::value,
         "Hasher requirements not met");
@@ -545,12 +565,11 @@ verify(
         "Progress requirements not met");
     info = {};
     using namespace detail;
-    using File = native_file;
-    File df;
+    File df{args...};
     df.open(file_mode::scan, dat_path, ec);
     if(ec)
         return;
-    File kf;
+    File kf{args...};
     kf.open (file_mode::read, key_path, ec);
     if(ec)
         return;
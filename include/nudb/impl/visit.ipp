@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <string>
+#include <utility>
 
 namespace nudb {
 
@@ -29,14 +30,30 @@ visit(
     Callback&& callback,
     Progress&& progress,
     error_code& ec)
+{
+    visit<native_file>(path, std::forward<Callback>(callback),
+        std::forward<Progress>(progress), ec);
+}
+
+template<
+    class File,
+    class Callback,
+    class Progress,
+    class... Args>
+void
+visit(
+    path_type const& path,
+    Callback&& callback,
+    Progress&& progress,
+    error_code& ec,
+    Args&&... args)
 {
     // VFALCO Need concept check for Callback
     static_assert(is_Progress<Progress>::value,
         "Progress requirements not met");
     using namespace detail;
-    using File = native_file;
     auto const readSize = 1024 * block_size(path);
-    File df;
+    File df{args...};
     df.open(file_mode::scan, path, ec);
     if(ec)
         return;
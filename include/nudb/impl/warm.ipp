@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_IMPL_WARM_IPP
+#define NUDB_IMPL_WARM_IPP
+
+#include <nudb/concepts.hpp>
+#include <nudb/type_traits.hpp>
+#include <nudb/detail/buffer.hpp>
+#include <algorithm>
+
+namespace nudb {
+
+namespace detail {
+
+// Read the first `size` bytes of the file sequentially,
+// returning early if stop() returns `true`.
+template<class File, class Progress, class Stop>
+void
+warm(
+    File& f,
+    noff_t size,
+    std::size_t bufferSize,
+    Progress&& progress,
+    Stop&& stop,
+    error_code& ec)
+{
+    buffer buf{std::max<std::size_t>(bufferSize, 1)};
+    progress(0, size);
+    for(noff_t offset = 0; offset < size;)
+    {
+        if(stop())
+            return;
+        auto const amount = static_cast<std::size_t>(
+            std::min<noff_t>(size - offset, buf.size()));
+        f.read(offset, buf.get(), amount, ec);
+        if(ec)
+            return;
+        offset += amount;
+        progress(offset, size);
+    }
+}
+
+} // detail
+
+template<
+    class File,
+    class Progress,
+    class... Args
+>
+void
+warm(
+    path_type const& path,
+    std::size_t bufferSize,
+    Progress&& progress,
+    error_code& ec,
+    Args&&... args)
+{
+    static_assert(is_Progress<Progress>::value,
+        "Progress requirements not met");
+    File f(args...);
+    f.open(file_mode::scan, path, ec);
+    if(ec)
+        return;
+    auto const size = f.size(ec);
+    if(ec)
+        return;
+    detail::warm(f, size, bufferSize, progress,
+        []
+        {
+            return false;
+        }, ec);
+}
+
+} // nudb
+
+#endif
@@ -0,0 +1,252 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_MEM_FILE_HPP
+#define NUDB_MEM_FILE_HPP
+
+#include <nudb/file.hpp>
+#include <nudb/error.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nudb {
+
+namespace detail {
+
+// The contents of one file in memory. Storage is
+// allocated in fixed size chunks as it is written,
+// and chunks which were never written read as zero.
+struct mem_file_data
+{
+    static std::size_t constexpr chunk_size = 65536;
+
+    mutable boost::shared_mutex m;
+    std::uint64_t size = 0;
+    std::vector<std::unique_ptr<std::uint8_t[]>> chunks;
+};
+
+// The namespace shared by every mem_file in the process
+template<class = void>
+class mem_file_system_t
+{
+    std::mutex m_;
+    std::map<path_type,
+        std::shared_ptr<mem_file_data>> files_;
+
+public:
+    static
+    mem_file_system_t&
+    instance()
+    {
+        static mem_file_system_t fs;
+        return fs;
+    }
+
+    std::shared_ptr<mem_file_data>
+    create(path_type const& path, error_code& ec);
+
+    std::shared_ptr<mem_file_data>
+    open(path_type const& path, error_code& ec);
+
+    void
+    erase(path_type const& path, error_code& ec);
+};
+
+using mem_file_system = mem_file_system_t<>;
+
+} // detail
+
+/** A file held in memory.
+
+    This type meets the requirements of @b File. Files are
+    kept in a namespace shared by every instance in the
+    process, so a file created by one `mem_file` may be opened
+    by another using the same path, until it is erased. The
+    paths are only names, and need not refer to anything on
+    disk. Storage is allocated as a file is written, and
+    contents do not outlive the process.
+
+    This allows a database to be created, opened, verified,
+    visited, or rekeyed without any system calls, for use as
+    an ephemeral cache or to measure the cost of operations
+    without the storage device:
+
+    @code
+    basic_store<xxhasher, mem_file> db;
+    @endcode
+
+    Open instances of the same file may be used concurrently.
+    An erased file remains readable through instances which
+    already have it open, until they are closed.
+*/
+class mem_file
+{
+    std::shared_ptr<detail::mem_file_data> data_;
+    bool writable_ = false;
+
+public:
+    mem_file() = default;
+    mem_file(mem_file const&) = delete;
+    mem_file& operator=(mem_file const&) = delete;
+
+    /** Move constructor.
+
+        @note The state of the moved-from object is as if default constructed.
+    */
+    mem_file(mem_file&& other);
+
+    /** Move assignment.
+
+        @note The state of the moved-from object is as if default constructed.
+    */
+    mem_file&
+    operator=(mem_file&& other);
+
+    /// Returns `true` if the file is open.
+    bool
+    is_open() const
+    {
+        return data_ != nullptr;
+    }
+
+    /// Close the file if it is open.
+    void
+    close();
+
+    /** Create a new file.
+
+        After the file is created, it is opened as if by open(mode, path, ec).
+
+        Preconditions:
+            The file must not already exist, or errc::file_exists is returned.
+
+        @param mode The open mode.
+
+        @param path The path of the file to create.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    create(file_mode mode, path_type const& path, error_code& ec);
+
+    /** Open a file.
+
+        @param mode The open mode.
+
+        @param path The path of the file to open.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    open(file_mode mode, path_type const& path, error_code& ec);
+
+    /** Remove a file from the namespace.
+
+        If the file does not exist, errc::no_such_file_or_directory
+        is returned.
+
+        @param path The path of the file to remove.
+
+        @param ec Set to the error, if any occurred.
+    */
+    static
+    void
+    erase(path_type const& path, error_code& ec);
+
+    /** Return the size of the file.
+
+        Preconditions:
+            The file must be open.
+
+        @param ec Set to the error, if any occurred.
+
+        @return The size of the file, in bytes.
+    */
+    std::uint64_t
+    size(error_code& ec) const;
+
+    /** Read data from a location in the file.
+
+        Preconditions:
+            The file must be open.
+
+        @param offset The position in the file to read from,
+        expressed as a byte offset from the beginning.
+
+        @param buffer The location to store the data.
+
+        @param bytes The number of bytes to read.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    read(std::uint64_t offset,
+        void* buffer, std::size_t bytes, error_code& ec);
+
+    /** Write data to a location in the file.
+
+        Preconditions:
+            The file must be open with a write mode.
+
+        @param offset The position in the file to write from,
+        expressed as a byte offset from the beginning.
+
+        @param buffer The data the write.
+
+        @param bytes The number of bytes to write.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    write(std::uint64_t offset,
+        void const* buffer, std::size_t bytes, error_code& ec);
+
+    /** Perform a low level file synchronization.
+
+        This does nothing, as there is no storage to
+        synchronize with.
+
+        Preconditions:
+            The file must be open with a write mode.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    sync(error_code& ec);
+
+    /** Truncate the file at a specific size.
+
+        Preconditions:
+            The file must be open with a write mode.
+
+        @param length The new file size.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    trunc(std::uint64_t length, error_code& ec);
+
+private:
+    static
+    bool
+    writable(file_mode mode)
+    {
+        return mode == file_mode::append ||
+            mode == file_mode::write;
+    }
+};
+
+} // nudb
+
+#include <nudb/impl/mem_file.ipp>
+
+#endif
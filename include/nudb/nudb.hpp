@@ -8,20 +8,28 @@
 #ifndef NUDB_HPP
 #define NUDB_HPP
 
+#include <nudb/commit_executor.hpp>
 #include <nudb/concepts.hpp>
 #include <nudb/create.hpp>
 #include <nudb/error.hpp>
 #include <nudb/file.hpp>
+#include <nudb/mem_file.hpp>
 #include <nudb/posix_file.hpp>
 #include <nudb/progress.hpp>
+#include <nudb/rate_limiter.hpp>
 #include <nudb/recover.hpp>
 #include <nudb/rekey.hpp>
+#include <nudb/replay.hpp>
 #include <nudb/store.hpp>
+#include <nudb/thread_policy.hpp>
+#include <nudb/trace.hpp>
 #include <nudb/type_traits.hpp>
 #include <nudb/verify.hpp>
 #include <nudb/version.hpp>
 #include <nudb/visit.hpp>
+#include <nudb/warm.hpp>
 #include <nudb/win32_file.hpp>
+#include <nudb/write_batch.hpp>
 #include <nudb/xxhasher.hpp>
 
 #endif
@@ -183,6 +183,47 @@ public:
     void
     trunc(std::uint64_t length, error_code& ec);
 
+    /** Hint that a range of the file will be read soon.
+
+        This starts reading the range into the
+        operating system cache without waiting.
+
+        Preconditions:
+            The file must be open.
+
+        @param offset The position in the file to read from,
+        expressed as a byte offset from the beginning.
+
+        @param bytes The number of bytes which will be read.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    prefetch(std::uint64_t offset,
+        std::size_t bytes, error_code& ec);
+
+    /** Allocate storage for a range of the file.
+
+        Disk space is reserved for the range without changing
+        the size of the file, so that later writes extending
+        the file fill contiguous extents. Where the operating
+        system or file system does not support this, the
+        call does nothing.
+
+        Preconditions:
+            The file must be open with a write mode.
+
+        @param offset The position in the file of the range,
+        expressed as a byte offset from the beginning.
+
+        @param bytes The number of bytes in the range.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    allocate(std::uint64_t offset,
+        std::uint64_t bytes, error_code& ec);
+
 private:
     static
     void
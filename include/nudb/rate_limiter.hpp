@@ -0,0 +1,300 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_RATE_LIMITER_HPP
+#define NUDB_RATE_LIMITER_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/file.hpp>
+#include <nudb/detail/file_hints.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace nudb {
+
+/** A token bucket limiting the rate of file I/O.
+
+    Each call to @ref request takes tokens for the number of
+    bytes about to be read or written, blocking the calling
+    thread when the tokens are exhausted. Tokens accumulate
+    at the configured rate, up to the burst size. A single
+    limiter may be shared by several files or operations, so
+    that their combined I/O stays within the budget.
+
+    Thread safety:
+        Safe to use from multiple threads.
+*/
+template<class = void>
+class rate_limiter_t
+{
+    using clock_type = std::chrono::steady_clock;
+
+    std::mutex m_;
+    std::uint64_t rate_;
+    std::uint64_t burst_;
+    double tokens_;
+    clock_type::time_point last_;
+
+public:
+    /// Copy constructor (disallowed)
+    rate_limiter_t(rate_limiter_t const&) = delete;
+
+    /// Copy assignment (disallowed)
+    rate_limiter_t& operator=(rate_limiter_t const&) = delete;
+
+    /** Constructor.
+
+        @param rate The number of bytes per second allowed,
+        or zero for no limit.
+
+        @param burst The largest number of bytes which may
+        be taken at once without waiting. If this is zero,
+        one second's worth of bytes is used.
+    */
+    explicit
+    rate_limiter_t(std::uint64_t rate,
+        std::uint64_t burst = 0);
+
+    /// Returns the number of bytes per second allowed
+    std::uint64_t
+    rate();
+
+    /** Change the number of bytes per second allowed.
+
+        @param rate The new rate, or zero for no limit.
+    */
+    void
+    rate(std::uint64_t rate);
+
+    /** Take tokens for bytes about to be transferred.
+
+        If not enough tokens are available, this function
+        blocks until they have accumulated. Requests larger
+        than the burst size are allowed, and delay later
+        requests accordingly.
+
+        @param bytes The number of bytes.
+    */
+    void
+    request(std::size_t bytes);
+
+private:
+    void
+    refill(clock_type::time_point now);
+};
+
+template<class _>
+rate_limiter_t<_>::
+rate_limiter_t(std::uint64_t rate, std::uint64_t burst)
+    : rate_(rate)
+    , burst_(burst)
+    , tokens_(static_cast<double>(burst > 0 ? burst : rate))
+    , last_(clock_type::now())
+{
+}
+
+template<class _>
+std::uint64_t
+rate_limiter_t<_>::
+rate()
+{
+    std::lock_guard<std::mutex> lock{m_};
+    return rate_;
+}
+
+template<class _>
+void
+rate_limiter_t<_>::
+rate(std::uint64_t rate)
+{
+    std::lock_guard<std::mutex> lock{m_};
+    refill(clock_type::now());
+    rate_ = rate;
+}
+
+template<class _>
+void
+rate_limiter_t<_>::
+request(std::size_t bytes)
+{
+    std::chrono::duration<double> wait;
+    {
+        std::lock_guard<std::mutex> lock{m_};
+        if(rate_ == 0)
+            return;
+        refill(clock_type::now());
+        // The balance may go negative, so that
+        // later requests wait to repay the debt.
+        tokens_ -= bytes;
+        if(tokens_ >= 0)
+            return;
+        wait = std::chrono::duration<double>{
+            -tokens_ / rate_};
+    }
+    std::this_thread::sleep_for(wait);
+}
+
+// Called with m_ held
+template<class _>
+void
+rate_limiter_t<_>::
+refill(clock_type::time_point now)
+{
+    std::chrono::duration<double> const elapsed = now - last_;
+    last_ = now;
+    auto const burst = burst_ > 0 ? burst_ : rate_;
+    tokens_ = std::min<double>(static_cast<double>(burst),
+        tokens_ + elapsed.count() * rate_);
+}
+
+using rate_limiter = rate_limiter_t<>;
+
+//------------------------------------------------------------------------------
+
+/** A File wrapper whose reads and writes are rate limited.
+
+    This meets the requirements of @b File. Before each read
+    or write, tokens for the size of the transfer are taken
+    from a @ref rate_limiter, which may block. Other
+    operations are passed through to the wrapped file.
+
+    Functions which accept a File type and constructor
+    arguments, such as @ref rekey and @ref verify, may be
+    given this type and a limiter to run with a bounded
+    I/O budget.
+
+    @tparam File The type of file to wrap.
+*/
+template<class File>
+class rate_limited_file
+{
+    rate_limiter* r_ = nullptr;
+    File f_;
+
+public:
+    /// Default constructor, with no limit
+    rate_limited_file() = default;
+
+    /// Move constructor
+    rate_limited_file(rate_limited_file&&) = default;
+
+    /// Move assignment
+    rate_limited_file& operator=(rate_limited_file&&) = default;
+
+    /** Constructor.
+
+        @param r The limiter to take tokens from. The limiter
+        must remain valid for the lifetime of the object.
+
+        @param args Optional arguments passed to the
+        constructor of the wrapped file.
+    */
+    template<class... Args>
+    explicit
+    rate_limited_file(rate_limiter& r, Args&&... args)
+        : r_(&r)
+        , f_(std::forward<Args>(args)...)
+    {
+    }
+
+    /// Returns the wrapped file
+    File&
+    file()
+    {
+        return f_;
+    }
+
+    bool
+    is_open() const
+    {
+        return f_.is_open();
+    }
+
+    void
+    close()
+    {
+        f_.close();
+    }
+
+    void
+    create(file_mode mode, path_type const& path, error_code& ec)
+    {
+        f_.create(mode, path, ec);
+    }
+
+    void
+    open(file_mode mode, path_type const& path, error_code& ec)
+    {
+        f_.open(mode, path, ec);
+    }
+
+    static
+    void
+    erase(path_type const& path, error_code& ec)
+    {
+        File::erase(path, ec);
+    }
+
+    std::uint64_t
+    size(error_code& ec) const
+    {
+        return f_.size(ec);
+    }
+
+    void
+    read(std::uint64_t offset,
+        void* buffer, std::size_t bytes, error_code& ec)
+    {
+        if(r_)
+            r_->request(bytes);
+        f_.read(offset, buffer, bytes, ec);
+    }
+
+    void
+    write(std::uint64_t offset,
+        void const* buffer, std::size_t bytes, error_code& ec)
+    {
+        if(r_)
+            r_->request(bytes);
+        f_.write(offset, buffer, bytes, ec);
+    }
+
+    void
+    sync(error_code& ec)
+    {
+        f_.sync(ec);
+    }
+
+    void
+    trunc(std::uint64_t length, error_code& ec)
+    {
+        f_.trunc(length, ec);
+    }
+
+    void
+    prefetch(std::uint64_t offset,
+        std::size_t bytes, error_code& ec)
+    {
+        detail::prefetch(f_, offset, bytes, ec);
+    }
+
+    void
+    allocate(std::uint64_t offset,
+        std::uint64_t bytes, error_code& ec)
+    {
+        detail::allocate(f_, offset, bytes, ec);
+    }
+};
+
+} // nudb
+
+#endif
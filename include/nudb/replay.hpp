@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_REPLAY_HPP
+#define NUDB_REPLAY_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/file.hpp>
+#include <nudb/trace.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace nudb {
+
+/// Settings for @ref replay.
+struct replay_options
+{
+    /** How fast to play the trace.
+
+        A value of 1 issues each operation at the time it was
+        recorded relative to the first, 2 at twice that rate,
+        and so on. Zero issues operations as fast as possible.
+    */
+    double speed = 0;
+
+    /** The number of threads issuing operations.
+
+        Records are given to threads by the hash of their key,
+        so operations on the same key keep their order. Commits
+        are issued by the first thread. More than one thread
+        requires a store with the @ref multi_thread policy.
+    */
+    std::size_t threads = 1;
+
+    /** `true` to insert the values found by the trace first.
+
+        Before playing the trace, a value of the recorded size
+        is inserted for each key which a fetch found before the
+        trace inserted it, and the database is committed. This
+        lets a trace taken from an existing database be played
+        against a new one with the same fetch results.
+    */
+    bool preload = false;
+};
+
+/// Describes the result of @ref replay.
+struct replay_info
+{
+    std::uint64_t records = 0;          // Records played
+    std::uint64_t fetches = 0;          // Fetches issued
+    std::uint64_t fetch_misses = 0;     // Fetches which found no value
+    std::uint64_t mismatches = 0;       // Fetches whose result differed from the trace
+    std::uint64_t inserts = 0;          // Inserts issued
+    std::uint64_t duplicates = 0;       // Inserts of keys which already existed
+    std::uint64_t commits = 0;          // Commits issued
+    std::uint64_t preloaded = 0;        // Values inserted before playing
+
+    // Time between the first and last records of the trace
+    std::chrono::duration<double> duration{0};
+
+    // Time taken to play the trace, excluding any preload
+    std::chrono::duration<double> elapsed{0};
+
+    // Longest time an operation started after it was due
+    std::chrono::duration<double> max_lag{0};
+};
+
+/** Play back the operations recorded in a trace.
+
+    This function reads a trace written by @ref trace_writer
+    and issues each fetch, insert, and commit against an open
+    database. Inserted values have the recorded sizes, with
+    unspecified contents. Fetches which find no value and
+    inserts of keys which already exist are counted, and are
+    not errors.
+
+    Preconditions:
+        The database must be open, with the key size of the
+        trace.
+
+    @param db The database to use.
+
+    @param path The path to the trace file.
+
+    @param options The settings to use.
+
+    @param info Set to the result.
+
+    @param handler A function which will be called after each
+    operation, from the thread which issued it. The equivalent
+    signature must be:
+    @code
+    void handler(
+        std::size_t thread,         // The index of the thread
+        trace_op op,                // The operation
+        std::chrono::steady_clock::duration latency
+    );
+    @endcode
+
+    @param ec Set to the error, if any occurred.
+*/
+template<class Store, class Handler>
+void
+replay(
+    Store& db,
+    path_type const& path,
+    replay_options const& options,
+    replay_info& info,
+    Handler&& handler,
+    error_code& ec);
+
+/** Play back the operations recorded in a trace.
+
+    Equivalent to the overload taking a handler, with a
+    handler which does nothing.
+*/
+template<class Store>
+void
+replay(
+    Store& db,
+    path_type const& path,
+    replay_options const& options,
+    replay_info& info,
+    error_code& ec);
+
+} // nudb
+
+#include <nudb/impl/replay.ipp>
+
+#endif
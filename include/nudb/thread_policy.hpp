@@ -0,0 +1,128 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_THREAD_POLICY_HPP
+#define NUDB_THREAD_POLICY_HPP
+
+#include <nudb/detail/gentex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <cstddef>
+#include <mutex>
+
+namespace nudb {
+
+namespace detail {
+
+// Meets the requirements of SharedLockable, and does nothing
+struct null_mutex
+{
+    void
+    lock()
+    {
+    }
+
+    bool
+    try_lock()
+    {
+        return true;
+    }
+
+    void
+    unlock()
+    {
+    }
+
+    void
+    lock_shared()
+    {
+    }
+
+    bool
+    try_lock_shared()
+    {
+        return true;
+    }
+
+    void
+    unlock_shared()
+    {
+    }
+};
+
+// Meets the requirements of GenerationLockable, and does nothing
+struct null_gentex
+{
+    void
+    start()
+    {
+    }
+
+    void
+    finish()
+    {
+    }
+
+    std::size_t
+    lock_gen()
+    {
+        return 0;
+    }
+
+    void
+    unlock_gen(std::size_t)
+    {
+    }
+};
+
+} // detail
+
+/** Thread policy for a store shared between threads.
+
+    Inserted data is committed by a background thread, and
+    all member functions may be called concurrently as
+    documented. This is the default.
+*/
+struct multi_thread
+{
+    /// `true` if a background thread commits inserted data
+    static bool constexpr background = true;
+
+    /// Serializes inserts
+    using mutex_type = std::mutex;
+
+    /// Protects the store's buffers and caches
+    using shared_mutex_type = boost::shared_mutex;
+
+    /// Orders readers of the key file with commits
+    using gentex_type = detail::gentex;
+};
+
+/** Thread policy for a store used by one thread.
+
+    No background thread is created and no locks are taken.
+    Inserted data accumulates in memory until the caller
+    invokes `commit`, or until the database is closed. All
+    member functions must be called from the same thread.
+*/
+struct single_thread
+{
+    /// `true` if a background thread commits inserted data
+    static bool constexpr background = false;
+
+    /// Serializes inserts
+    using mutex_type = detail::null_mutex;
+
+    /// Protects the store's buffers and caches
+    using shared_mutex_type = detail::null_mutex;
+
+    /// Orders readers of the key file with commits
+    using gentex_type = detail::null_gentex;
+};
+
+} // nudb
+
+#endif
@@ -0,0 +1,547 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_TRACE_HPP
+#define NUDB_TRACE_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/file.hpp>
+#include <nudb/native_file.hpp>
+#include <nudb/type_traits.hpp>
+#include <nudb/detail/bulkio.hpp>
+#include <nudb/detail/field.hpp>
+#include <nudb/detail/stream.hpp>
+#include <boost/assert.hpp>
+#include <boost/optional.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+namespace nudb {
+
+/// The operations recorded in a trace.
+enum class trace_op : std::uint8_t
+{
+    /// A fetch. The size is that of the value found, or zero.
+    fetch = 1,
+
+    /// A successful insert. The size is that of the value.
+    insert = 2,
+
+    /// A call to @ref basic_store::commit
+    commit = 3
+};
+
+/** An operation read from a trace.
+
+    The key points to memory owned by the @ref trace_reader,
+    which remains valid until the next record is read.
+*/
+struct trace_record
+{
+    /// The operation
+    trace_op op;
+
+    /// Microseconds from the creation of the trace until the operation finished
+    std::uint64_t time;
+
+    /** The hash of the key, using the salt of the recording database.
+
+        This is the 48-bit hash kept in buckets, taken from the
+        high bits of the 64-bit hash function output. Replay uses
+        it only to spread keys across threads.
+    */
+    detail::nhash_t hash;
+
+    /// The size of the value, or zero
+    nsize_t size;
+
+    /// The key, or `nullptr` for a commit
+    void const* key;
+};
+
+namespace detail {
+
+static std::uint16_t constexpr traceVersion = 1;
+
+// Trace file header
+//
+//  Type                8 bytes         "nudb.trc"
+//  Version             2 bytes
+//  KeySize             2 bytes
+//  Start               8 bytes         Microseconds since the epoch
+//
+//  Reserved            12 bytes
+//
+//  Total               32 bytes
+//
+// Each record follows, in the order the operations finished:
+//
+//  Op                  1 byte          trace_op
+//  Time                6 bytes         Microseconds since the header
+//
+// and for fetch and insert only:
+//
+//  Hash                6 bytes         As kept in buckets
+//  Size                4 bytes         Zero for a fetch which failed
+//  Key                 KeySize bytes
+//
+struct trace_file_header
+{
+    static std::size_t constexpr size = 32;
+
+    char type[8];
+    std::size_t version;
+    nsize_t key_size;
+    std::uint64_t start;
+};
+
+inline
+std::size_t
+trace_record_size(trace_op op, nsize_t key_size)
+{
+    if(op == trace_op::commit)
+        return 1 + field<uint48_t>::size;
+    return 1 + 2 * field<uint48_t>::size +
+        field<std::uint32_t>::size + key_size;
+}
+
+} // detail
+
+//------------------------------------------------------------------------------
+
+/** Records database operations to a trace file.
+
+    A writer given to @ref basic_store::trace receives every
+    fetch, successful insert, and explicit commit made on the
+    database, each stamped with the time it finished. The
+    trace may be read with @ref trace_reader, or played back
+    against another database with @ref replay, to reproduce
+    a production workload when tuning or benchmarking.
+
+    Records are buffered in memory and written in large
+    pieces. If a write fails, recording stops, and the error
+    is returned by @ref close. Operations on the database are
+    never failed because of the trace.
+
+    Thread safety:
+        The functions which record operations are safe to
+        call from multiple threads.
+*/
+template<class = void>
+class trace_writer_t
+{
+    using clock_type = std::chrono::steady_clock;
+
+    std::mutex m_;
+    native_file f_;
+    boost::optional<detail::bulk_writer<native_file>> w_;
+    nsize_t key_size_ = 0;
+    clock_type::time_point start_;
+    std::uint64_t records_ = 0;
+    error_code ec_;
+
+public:
+    /// Default constructor
+    trace_writer_t() = default;
+
+    /// Copy constructor (disallowed)
+    trace_writer_t(trace_writer_t const&) = delete;
+
+    /// Copy assignment (disallowed)
+    trace_writer_t& operator=(trace_writer_t const&) = delete;
+
+    /** Destroy the writer.
+
+        Buffered records are written and the file is closed,
+        ignoring errors. To receive errors, call @ref close
+        first.
+    */
+    ~trace_writer_t();
+
+    /// Returns `true` if the trace file is open.
+    bool
+    is_open() const
+    {
+        return f_.is_open();
+    }
+
+    /// Returns the size of the keys recorded.
+    nsize_t
+    key_size() const
+    {
+        return key_size_;
+    }
+
+    /// Returns the number of records written so far.
+    std::uint64_t
+    records();
+
+    /** Create a new trace file.
+
+        Preconditions:
+            The writer must not be open.
+
+        @param path The path to the file, which must not exist.
+
+        @param key_size The key size of the database to trace.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    create(path_type const& path,
+        nsize_t key_size, error_code& ec);
+
+    /** Write buffered records and close the trace file.
+
+        Preconditions:
+            The writer must be open, and no database may
+            still be recording to it.
+
+        @param ec Set to the first error encountered while
+        recording or closing, if any.
+    */
+    void
+    close(error_code& ec);
+
+    /** Record a fetch.
+
+        @param h The hash of the key, as kept in buckets.
+
+        @param key The key.
+
+        @param size The size of the value found, or zero.
+    */
+    void
+    fetch(detail::nhash_t h, void const* key, nsize_t size)
+    {
+        append(trace_op::fetch, h, key, size);
+    }
+
+    /** Record an insert.
+
+        @param h The hash of the key, as kept in buckets.
+
+        @param key The key.
+
+        @param size The size of the value.
+    */
+    void
+    insert(detail::nhash_t h, void const* key, nsize_t size)
+    {
+        append(trace_op::insert, h, key, size);
+    }
+
+    /// Record a commit.
+    void
+    commit()
+    {
+        append(trace_op::commit, 0, nullptr, 0);
+    }
+
+private:
+    void
+    append(trace_op op, detail::nhash_t h,
+        void const* key, nsize_t size);
+};
+
+template<class _>
+trace_writer_t<_>::
+~trace_writer_t()
+{
+    if(is_open())
+    {
+        error_code ec;
+        close(ec);
+    }
+}
+
+template<class _>
+std::uint64_t
+trace_writer_t<_>::
+records()
+{
+    std::lock_guard<std::mutex> lock{m_};
+    return records_;
+}
+
+template<class _>
+void
+trace_writer_t<_>::
+create(path_type const& path,
+    nsize_t key_size, error_code& ec)
+{
+    using namespace detail;
+    BOOST_ASSERT(! is_open());
+    BOOST_ASSERT(key_size > 0);
+    f_.create(file_mode::append, path, ec);
+    if(ec)
+        return;
+    key_size_ = key_size;
+    records_ = 0;
+    ec_ = {};
+    start_ = clock_type::now();
+    w_.emplace(f_, 0, 64 * 1024);
+    auto os = w_->prepare(trace_file_header::size, ec);
+    if(ec)
+        return;
+    write(os, "nudb.trc", 8);
+    write<std::uint16_t>(os, traceVersion);
+    write<std::uint16_t>(os, key_size);
+    write<std::uint64_t>(os,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    std::uint8_t reserved[12];
+    std::memset(reserved, 0, sizeof(reserved));
+    write(os, reserved, sizeof(reserved));
+}
+
+template<class _>
+void
+trace_writer_t<_>::
+close(error_code& ec)
+{
+    BOOST_ASSERT(is_open());
+    std::lock_guard<std::mutex> lock{m_};
+    if(! ec_)
+        w_->flush(ec_);
+    w_ = boost::none;
+    f_.close();
+    ec = ec_;
+}
+
+template<class _>
+void
+trace_writer_t<_>::
+append(trace_op op, detail::nhash_t h,
+    void const* key, nsize_t size)
+{
+    using namespace detail;
+    std::lock_guard<std::mutex> lock{m_};
+    if(ec_ || ! w_)
+        return;
+    // Stamped under the lock, so that
+    // times increase through the file.
+    auto const time = std::chrono::duration_cast<
+        std::chrono::microseconds>(clock_type::now() - start_).count();
+    auto os = w_->prepare(
+        trace_record_size(op, key_size_), ec_);
+    if(ec_)
+        return;
+    write<std::uint8_t>(os, static_cast<std::uint8_t>(op));
+    write<uint48_t>(os, static_cast<std::uint64_t>(time));
+    if(op != trace_op::commit)
+    {
+        write<uint48_t>(os, h);
+        write<std::uint32_t>(os, size);
+        write(os, key, key_size_);
+    }
+    ++records_;
+}
+
+using trace_writer = trace_writer_t<>;
+
+//------------------------------------------------------------------------------
+
+/** Reads the records of a trace file in order.
+
+    A record cut short at the end of the file, as left by
+    a process which stopped while recording, ends the trace.
+*/
+template<class = void>
+class trace_reader_t
+{
+    native_file f_;
+    boost::optional<detail::bulk_reader<native_file>> r_;
+    nsize_t key_size_ = 0;
+    std::uint64_t start_ = 0;
+
+public:
+    /// Default constructor
+    trace_reader_t() = default;
+
+    /// Copy constructor (disallowed)
+    trace_reader_t(trace_reader_t const&) = delete;
+
+    /// Copy assignment (disallowed)
+    trace_reader_t& operator=(trace_reader_t const&) = delete;
+
+    /// Returns `true` if the trace file is open.
+    bool
+    is_open() const
+    {
+        return f_.is_open();
+    }
+
+    /// Returns the size of the keys in the trace.
+    nsize_t
+    key_size() const
+    {
+        return key_size_;
+    }
+
+    /// Returns the time the trace was created, in microseconds since the epoch.
+    std::uint64_t
+    start() const
+    {
+        return start_;
+    }
+
+    /** Open a trace file and read its header.
+
+        Preconditions:
+            The reader must not be open.
+
+        @param path The path to the file.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    open(path_type const& path, error_code& ec);
+
+    /** Read the next record.
+
+        Preconditions:
+            The reader must be open.
+
+        @param r Set to the record read.
+
+        @param ec Set to the error, if any occurred.
+
+        @return `true` if a record was read, or `false` at
+        the end of the trace or if an error occurred.
+    */
+    bool
+    next(trace_record& r, error_code& ec);
+
+    /// Close the trace file.
+    void
+    close();
+};
+
+template<class _>
+void
+trace_reader_t<_>::
+open(path_type const& path, error_code& ec)
+{
+    using namespace detail;
+    BOOST_ASSERT(! is_open());
+    native_file f;
+    f.open(file_mode::scan, path, ec);
+    if(ec)
+        return;
+    auto const size = f.size(ec);
+    if(ec)
+        return;
+    if(size < trace_file_header::size)
+    {
+        ec = error::not_trace_file;
+        return;
+    }
+    trace_file_header th;
+    {
+        std::uint8_t buf[trace_file_header::size];
+        f.read(0, buf, sizeof(buf), ec);
+        if(ec)
+            return;
+        istream is{buf, sizeof(buf)};
+        read(is, th.type, sizeof(th.type));
+        read<std::uint16_t>(is, th.version);
+        read<std::uint16_t>(is, th.key_size);
+        read<std::uint64_t>(is, th.start);
+    }
+    if(std::memcmp(th.type, "nudb.trc", 8) != 0)
+    {
+        ec = error::not_trace_file;
+        return;
+    }
+    if(th.version != traceVersion)
+    {
+        ec = error::different_version;
+        return;
+    }
+    if(th.key_size < 1)
+    {
+        ec = error::invalid_key_size;
+        return;
+    }
+    f_ = std::move(f);
+    key_size_ = th.key_size;
+    start_ = th.start;
+    r_.emplace(f_, static_cast<noff_t>(
+        trace_file_header::size), size, 64 * 1024);
+}
+
+template<class _>
+bool
+trace_reader_t<_>::
+next(trace_record& r, error_code& ec)
+{
+    using namespace detail;
+    BOOST_ASSERT(is_open());
+    if(r_->eof())
+        return false;
+    std::uint8_t op;
+    {
+        auto is = r_->prepare(1, ec);
+        if(ec)
+            return false;
+        read<std::uint8_t>(is, op);
+    }
+    r.op = static_cast<trace_op>(op);
+    if(r.op != trace_op::fetch &&
+        r.op != trace_op::insert &&
+        r.op != trace_op::commit)
+    {
+        ec = error::invalid_trace_record;
+        return false;
+    }
+    auto is = r_->prepare(
+        trace_record_size(r.op, key_size_) - 1, ec);
+    if(ec == error::short_read)
+    {
+        // Partial record at the end
+        ec = {};
+        return false;
+    }
+    if(ec)
+        return false;
+    read<uint48_t>(is, r.time);
+    if(r.op == trace_op::commit)
+    {
+        r.hash = 0;
+        r.size = 0;
+        r.key = nullptr;
+        return true;
+    }
+    read<uint48_t>(is, r.hash);
+    read<std::uint32_t>(is, r.size);
+    if(r.op == trace_op::insert && r.size == 0)
+    {
+        ec = error::invalid_trace_record;
+        return false;
+    }
+    r.key = is.data(key_size_);
+    return true;
+}
+
+template<class _>
+void
+trace_reader_t<_>::
+close()
+{
+    r_ = boost::none;
+    f_.close();
+}
+
+using trace_reader = trace_reader_t<>;
+
+} // nudb
+
+#endif
@@ -136,6 +136,31 @@ verify(
     Progress&& progress,
     error_code& ec);
 
+/** Verify consistency of the key and data files.
+
+    This function is the same as the one above, except that
+    the files are opened using the specified @b File type.
+
+    @tparam File The type of file to use. This type must meet
+    the requirements of @b File.
+
+    @param args Optional arguments passed to @b File constructors.
+*/
+template<
+    class Hasher,
+    class File,
+    class Progress,
+    class... Args>
+void
+verify(
+    verify_info& info,
+    path_type const& dat_path,
+    path_type const& key_path,
+    std::size_t bufferSize,
+    Progress&& progress,
+    error_code& ec,
+    Args&&... args);
+
 } // nudb
 
 #include <nudb/impl/verify.ipp>
@@ -56,6 +56,29 @@ visit(
     Progress&& progress,
     error_code& ec);
 
+/** Visit each key/data pair in a data file.
+
+    This function is the same as the one above, except that
+    the data file is opened using the specified @b File type.
+
+    @tparam File The type of file to use. This type must meet
+    the requirements of @b File.
+
+    @param args Optional arguments passed to @b File constructors.
+*/
+template<
+    class File,
+    class Callback,
+    class Progress,
+    class... Args>
+void
+visit(
+    path_type const& path,
+    Callback&& callback,
+    Progress&& progress,
+    error_code& ec,
+    Args&&... args);
+
 } // nudb
 
 #include <nudb/impl/visit.ipp>
@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_WARM_HPP
+#define NUDB_WARM_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/file.hpp>
+#include <cstddef>
+
+namespace nudb {
+
+/** Load a file into the operating system cache.
+
+    This function reads the entire file sequentially using
+    large reads, discarding the data. It is typically used
+    on the key file after a restart, so that fetches do not
+    each have to wait for a random read from the disk while
+    the cache slowly fills.
+
+    @param path The path to the file.
+
+    @param bufferSize The number of bytes to read at a time.
+
+    @param progress A function which will be called periodically
+    as the algorithm proceeds. The equivalent signature of the
+    progress function must be:
+    @code
+    void progress(
+        std::uint64_t amount,   // Amount of work done so far
+        std::uint64_t total     // Total amount of work to do
+    );
+    @endcode
+
+    @param ec Set to the error, if any occurred.
+
+    @param args Optional arguments passed to @b File constructors.
+*/
+template<
+    class File,
+    class Progress,
+    class... Args
+>
+void
+warm(
+    path_type const& path,
+    std::size_t bufferSize,
+    Progress&& progress,
+    error_code& ec,
+    Args&&... args);
+
+} // nudb
+
+#include <nudb/impl/warm.ipp>
+
+#endif
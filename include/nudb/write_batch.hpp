@@ -0,0 +1,128 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef NUDB_WRITE_BATCH_HPP
+#define NUDB_WRITE_BATCH_HPP
+
+#include <nudb/error.hpp>
+#include <nudb/type_traits.hpp>
+#include <nudb/detail/pool.hpp>
+#include <boost/assert.hpp>
+#include <cstddef>
+
+namespace nudb {
+
+template<class Hasher, class File, class Policy>
+class basic_store;
+
+/** A set of key/value pairs inserted together.
+
+    Values added to a batch are copied into memory owned by
+    the batch. When the batch is inserted into a database,
+    all of its values become visible to fetch at the same
+    time and are written by the same commit, so after a
+    crash the recovery process either keeps all of them
+    or none of them.
+
+    Thread safety:
+        Distinct objects may be used concurrently.
+        A shared object requires external synchronization.
+*/
+class write_batch
+{
+    template<class, class, class>
+    friend class basic_store;
+
+    detail::pool pool_;
+    std::size_t key_size_;
+
+public:
+    /// Copy constructor (disallowed)
+    write_batch(write_batch const&) = delete;
+
+    /// Copy assignment (disallowed)
+    write_batch& operator=(write_batch const&) = delete;
+
+    /** Constructor.
+
+        @param key_size The size of keys, which must match
+        the key size of the database the batch is inserted into.
+
+        @param alloc_size The size of each block of memory
+        allocated to hold keys and values.
+    */
+    explicit
+    write_batch(std::size_t key_size,
+            std::size_t alloc_size = 64 * 1024)
+        : pool_(static_cast<nsize_t>(key_size), alloc_size)
+        , key_size_(key_size)
+    {
+    }
+
+    /// Returns the size of keys in the batch
+    std::size_t
+    key_size() const
+    {
+        return key_size_;
+    }
+
+    /// Returns the number of values in the batch
+    std::size_t
+    size() const
+    {
+        return pool_.size();
+    }
+
+    /// Returns `true` if the batch has no values
+    bool
+    empty() const
+    {
+        return pool_.empty();
+    }
+
+    /// Remove all values from the batch
+    void
+    clear()
+    {
+        pool_.clear();
+    }
+
+    /** Add a value to the batch.
+
+        If the key was already added to this batch, `ec` is
+        set to @ref error::key_exists. Keys already in the
+        database are detected when the batch is inserted.
+
+        @param key A buffer holding the key. The size of the
+        buffer should be at least @ref key_size.
+
+        @param data A buffer holding the value.
+
+        @param bytes The size of the value data. This value must
+        be greater than 0 and no more than 0xffffffff.
+
+        @param ec Set to the error, if any occurred.
+    */
+    void
+    insert(void const* key, void const* data,
+        nsize_t bytes, error_code& ec)
+    {
+        BOOST_ASSERT(bytes > 0);
+        if(pool_.find(key) != pool_.end())
+        {
+            ec = error::key_exists;
+            return;
+        }
+        // The hash is computed when the batch is
+        // inserted, since it depends on the database.
+        pool_.insert(0, key, data, bytes);
+    }
+};
+
+} // nudb
+
+#endif
@@ -8,15 +8,23 @@
 // Test that header file is self-contained
 #include <nudb/basic_store.hpp>
 
+#include <nudb/test/slow_file.hpp>
 #include <nudb/test/test_store.hpp>
 #include <nudb/detail/arena.hpp>
 #include <nudb/detail/cache.hpp>
 #include <nudb/detail/pool.hpp>
+#include <nudb/detail/recent_cache.hpp>
 #include <nudb/progress.hpp>
 #include <nudb/verify.hpp>
 #include <beast/unit_test/suite.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <limits>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
 namespace nudb {
 
@@ -37,10 +45,79 @@ static_assert(!std::is_copy_assignable      <pool>{}, "");
 static_assert( std::is_move_constructible   <pool>{}, "");
 static_assert(!std::is_move_assignable      <pool>{}, "");
 
+static_assert(!std::is_copy_constructible   <recent_cache>{}, "");
+static_assert(!std::is_copy_assignable      <recent_cache>{}, "");
+static_assert( std::is_move_constructible   <recent_cache>{}, "");
+static_assert( std::is_move_assignable      <recent_cache>{}, "");
+
 } // detail
 
 namespace test {
 
+// Fails reads and writes of bucket cache files while
+// the flag given on construction is set.
+class cache_fail_file : public native_file
+{
+    std::atomic<bool>* fail_ = nullptr;
+    bool cache_ = false;
+
+public:
+    explicit
+    cache_fail_file(std::atomic<bool>* fail)
+        : fail_(fail)
+    {
+    }
+
+    void
+    create(file_mode mode, path_type const& path, error_code& ec)
+    {
+        cache_ = is_cache(path);
+        native_file::create(mode, path, ec);
+    }
+
+    void
+    open(file_mode mode, path_type const& path, error_code& ec)
+    {
+        cache_ = is_cache(path);
+        native_file::open(mode, path, ec);
+    }
+
+    void
+    read(std::uint64_t offset,
+        void* buffer, std::size_t bytes, error_code& ec)
+    {
+        if(failing())
+            ec = error_code{errc::io_error, generic_category()};
+        else
+            native_file::read(offset, buffer, bytes, ec);
+    }
+
+    void
+    write(std::uint64_t offset,
+        void const* buffer, std::size_t bytes, error_code& ec)
+    {
+        if(failing())
+            ec = error_code{errc::io_error, generic_category()};
+        else
+            native_file::write(offset, buffer, bytes, ec);
+    }
+
+private:
+    static
+    bool
+    is_cache(path_type const& path)
+    {
+        return path.size() > 4 &&
+            path.compare(path.size() - 4, 4, ".l2c") == 0;
+    }
+
+    bool
+    failing() const
+    {
+        return cache_ && fail_ && *fail_;
+    }
+};
+
 class basic_store_test : public beast::unit_test::suite
 {
 public:
@@ -195,11 +272,1036 @@ public:
         }
     }
 
+    // Inserts values in place then fetches them
+    void
+    test_insert_prepare()
+    {
+        testcase("insert_prepare");
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            auto const p = ts.db.insert_prepare(
+                item.key, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            std::memcpy(p, item.data, item.size);
+            if(n % 10 == 0)
+            {
+                // Not visible until committed
+                ts.db.fetch(item.key,
+                    [](void const*, std::size_t)
+                    {
+                    }, ec);
+                BEAST_EXPECTS(ec == error::key_not_found,
+                    ec.message());
+                ec = {};
+                ts.db.insert_cancel();
+                continue;
+            }
+            ts.db.insert_commit(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.fetch(item.key,
+                [&](void const* data, std::size_t size)
+                {
+                    if(! BEAST_EXPECT(size == item.size))
+                        return;
+                    BEAST_EXPECT(
+                        std::memcmp(data, item.data, size) == 0);
+                }, ec);
+            if(n % 10 == 0)
+            {
+                BEAST_EXPECTS(ec == error::key_not_found,
+                    ec.message());
+                ec = {};
+                continue;
+            }
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        // Duplicate
+        auto const item = ts[1];
+        auto const p = ts.db.insert_prepare(
+            item.key, item.size, ec);
+        BEAST_EXPECT(p == nullptr);
+        BEAST_EXPECTS(ec == error::key_exists, ec.message());
+        ec = {};
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N - N / 10);
+    }
+
+    // Inserts values in pieces, some of them staged
+    void
+    test_insert_stream()
+    {
+        testcase("insert stream");
+        std::size_t const N = 200;
+        std::size_t const arenaBlockSize = 4096;
+        auto const value_size =
+            [](std::size_t n) -> nsize_t
+            {
+                return static_cast<nsize_t>(
+                    n % 2 ? 20000 + n : 100 + n);
+            };
+        auto const check =
+            [&](std::size_t n, void const* data, std::size_t size)
+            {
+                if(! BEAST_EXPECT(size == value_size(n)))
+                    return;
+                auto const p =
+                    reinterpret_cast<std::uint8_t const*>(data);
+                for(std::size_t i = 0; i < size; ++i)
+                    if(! BEAST_EXPECT(p[i] ==
+                            static_cast<std::uint8_t>(n * 31 + i)))
+                        return;
+            };
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.db.open(ts.dp, ts.kp, ts.lp, arenaBlockSize, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            std::size_t i = 0;
+            ts.db.insert(ts[n].key, value_size(n),
+                [&](void* buffer, std::size_t size, error_code&)
+                {
+                    auto p =
+                        reinterpret_cast<std::uint8_t*>(buffer);
+                    for(auto const end = i + size; i < end; ++i)
+                        *p++ = static_cast<std::uint8_t>(n * 31 + i);
+                }, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(i == value_size(n));
+        }
+        // Reader errors abandon the insert
+        ts.db.insert(ts[N].key, 50000,
+            [&](void*, std::size_t, error_code& ev)
+            {
+                ev = error::short_read;
+            }, ec);
+        BEAST_EXPECTS(ec == error::short_read, ec.message());
+        ec = {};
+        // Duplicates are detected before reading
+        std::size_t calls = 0;
+        ts.db.insert(ts[1].key, 50000,
+            [&](void*, std::size_t, error_code&)
+            {
+                ++calls;
+            }, ec);
+        BEAST_EXPECTS(ec == error::key_exists, ec.message());
+        BEAST_EXPECT(calls == 0);
+        ec = {};
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            ts.db.fetch(ts[n].key,
+                [&](void const* data, std::size_t size)
+                {
+                    check(n, data, size);
+                }, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        {
+            native_file f;
+            f.open(file_mode::read, ts.lp + ".s1", ec);
+            BEAST_EXPECT(ec);
+            ec = {};
+        }
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n <= N; ++n)
+        {
+            ts.db.fetch(ts[n].key,
+                [&](void const* data, std::size_t size)
+                {
+                    check(n, data, size);
+                }, ec);
+            if(n == N)
+            {
+                BEAST_EXPECTS(ec == error::key_not_found,
+                    ec.message());
+                ec = {};
+                continue;
+            }
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        BEAST_EXPECTS(! ec, ec.message());
+    }
+
+    // Bounds the memory held by the recently committed cache
+    void
+    test_recent_cache()
+    {
+        testcase("recent cache");
+        using detail::recent_cache;
+        nsize_t const keySize = 8;
+        std::size_t const N = 1000;
+        std::uint8_t data[100] = {};
+        auto const key =
+            [](std::uint64_t i)
+            {
+                std::array<std::uint8_t, keySize> k;
+                std::memcpy(k.data(), &i, keySize);
+                return k;
+            };
+        recent_cache rc{keySize};
+        BEAST_EXPECT(rc.empty());
+        {
+            recent_cache::batch b{keySize};
+            for(std::size_t i = 0; i < N; ++i)
+            {
+                // Every key shares a hash with another
+                data[0] = static_cast<std::uint8_t>(i);
+                b.insert(i / 2, key(i).data(), data, sizeof(data));
+            }
+            BEAST_EXPECT(b.size() ==
+                N * recent_cache::charge(keySize, sizeof(data)));
+            rc.insert(b);
+            BEAST_EXPECT(b.size() == 0);
+        }
+        BEAST_EXPECT(rc.size() >=
+            N * recent_cache::charge(keySize, sizeof(data)));
+        for(std::size_t i = 0; i < N; ++i)
+        {
+            nsize_t size = 0;
+            auto const p = rc.find(i / 2, key(i).data(), size);
+            if(! BEAST_EXPECT(p))
+                return;
+            BEAST_EXPECT(size == sizeof(data));
+            BEAST_EXPECT(p[0] == static_cast<std::uint8_t>(i));
+        }
+        nsize_t size;
+        BEAST_EXPECT(! rc.find(0, key(1000).data(), size));
+        BEAST_EXPECT(! rc.find(1, key(0).data(), size));
+
+        // The oldest entries are discarded first
+        std::size_t const limit = 64 * 1024;
+        rc.trim(limit);
+        BEAST_EXPECT(rc.size() <= limit);
+        BEAST_EXPECT(! rc.empty());
+        BEAST_EXPECT(! rc.find(0, key(0).data(), size));
+        BEAST_EXPECT(rc.find((N - 1) / 2, key(N - 1).data(), size));
+        rc.trim(0);
+        BEAST_EXPECT(rc.empty());
+        BEAST_EXPECT(rc.size() == 0);
+    }
+
+    // Fetches values while commits move them
+    // through the recently committed cache
+    void
+    test_recent()
+    {
+        testcase("recent");
+        std::size_t const N = 5000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(ts.db.recent_limit() == 0);
+        ts.db.recent_limit(256 * 1024);
+        BEAST_EXPECT(ts.db.recent_limit() == 256 * 1024);
+        auto const fetch =
+            [&](std::size_t n)
+            {
+                auto const item = ts[n];
+                ts.db.fetch(item.key,
+                    [&](void const* data, std::size_t size)
+                    {
+                        if(! BEAST_EXPECT(size == item.size))
+                            return;
+                        BEAST_EXPECT(
+                            std::memcmp(data, item.data, size) == 0);
+                    }, ec);
+                return BEAST_EXPECTS(! ec, ec.message());
+            };
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            if(! fetch(n) || ! fetch(n / 2))
+                return;
+            if(n == N / 2)
+                ts.db.recent_limit(1024);
+        }
+        for(std::size_t n = 0; n < N; ++n)
+            if(! fetch(n))
+                return;
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+    }
+
+    // Inserts and commits without a background thread
+    void
+    test_single_thread()
+    {
+        testcase("single_thread");
+        std::size_t const N = 2000;
+        error_code ec;
+        basic_test_store<native_file, single_thread> ts{
+            8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        auto const fetch =
+            [&](std::size_t n)
+            {
+                auto const item = ts[n];
+                ts.db.fetch(item.key,
+                    [&](void const* data, std::size_t size)
+                    {
+                        if(! BEAST_EXPECT(size == item.size))
+                            return;
+                        BEAST_EXPECT(
+                            std::memcmp(data, item.data, size) == 0);
+                    }, ec);
+                return BEAST_EXPECTS(! ec, ec.message());
+            };
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            if(! fetch(n))
+                return;
+            if(n % 500 == 499)
+            {
+                ts.db.commit(ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+                // Committed data is on disk
+                native_file f;
+                f.open(file_mode::read, ts.dp, ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+                BEAST_EXPECT(f.size(ec) >
+                    detail::dat_file_header::size);
+            }
+        }
+        for(std::size_t n = 0; n < N; ++n)
+            if(! fetch(n))
+                return;
+        // Insert some more, committed by close
+        for(std::size_t n = N; n < N + 100; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N + 100);
+    }
+
+    // Commits explicitly with the background thread running
+    void
+    test_commit()
+    {
+        testcase("commit");
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            if(n % 100 == 99)
+            {
+                ts.db.commit(ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+            }
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+    }
+
+    // Fetches run while commits yield to them
+    void
+    test_read_priority()
+    {
+        testcase("read priority");
+        std::size_t const N = 2000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.db.read_priority(std::chrono::milliseconds{1});
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // The generator is not thread safe,
+        // so make a copy of the keys first.
+        std::vector<std::vector<std::uint8_t>> keys;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            keys.emplace_back(item.key, item.key + ts.keySize);
+        }
+        std::atomic<std::size_t> inserted{0};
+        std::atomic<bool> stop{false};
+        std::size_t fetched = 0;
+        std::thread t{
+            [&]
+            {
+                while(! stop)
+                {
+                    auto const count = inserted.load();
+                    if(count == 0)
+                        continue;
+                    error_code ec2;
+                    ts.db.fetch(keys[fetched % count].data(),
+                        [](void const*, std::size_t)
+                        {
+                        }, ec2);
+                    if(ec2)
+                        break;
+                    ++fetched;
+                }
+            }};
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                break;
+            inserted = n + 1;
+            if(n % 500 == 499)
+            {
+                ts.db.commit(ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    break;
+            }
+        }
+        stop = true;
+        t.join();
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+    }
+
+    // Commits finish in bounded time while fetches never stop
+    void
+    test_read_priority_limit()
+    {
+        testcase("read priority limit");
+        using clock_type = std::chrono::steady_clock;
+        std::size_t const N = 2000;
+        std::chrono::milliseconds const wait{10};
+        error_code ec;
+        test_store ts{8, 256, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // Resident buckets keep the commit from reading
+        // the files, so only fetches are slowed down.
+        slow_file_delays delays;
+        delays.read = delay_distribution{"fixed:2000"};
+        basic_store<xxhasher, slow_file<native_file>> db;
+        db.resident(true);
+        db.read_priority(wait);
+        db.open(ts.dp, ts.kp, ts.lp,
+            16 * 1024 * 1024, ec, delays);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        std::vector<std::vector<std::uint8_t>> keys;
+        for(std::size_t n = 0; n < 2 * N; ++n)
+        {
+            auto const item = ts[n];
+            keys.emplace_back(item.key, item.key + ts.keySize);
+            db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            if(n == N - 1)
+            {
+                db.commit(ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+            }
+        }
+        // Several threads keep a fetch waiting on the
+        // device for nearly the whole commit.
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> threads;
+        for(std::size_t i = 0; i < 4; ++i)
+            threads.emplace_back(
+                [&, i]
+                {
+                    for(auto n = i; ! stop; n = (n + 7) % N)
+                    {
+                        error_code ec2;
+                        db.fetch(keys[n].data(),
+                            [](void const*, std::size_t)
+                            {
+                            }, ec2);
+                        if(ec2)
+                            break;
+                    }
+                });
+        auto const start = clock_type::now();
+        db.commit(ec);
+        auto const elapsed = clock_type::now() - start;
+        stop = true;
+        for(auto& t : threads)
+            t.join();
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // Without the limit, every one of the hundreds
+        // of key file buckets could wait in turn.
+        BEAST_EXPECTS(elapsed < 64 * wait + std::chrono::seconds{2},
+            std::to_string(std::chrono::duration_cast<
+                std::chrono::milliseconds>(elapsed).count()) + "ms");
+        db.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == 2 * N);
+    }
+
+    // Commits with and without a concurrent data file sync
+    void
+    test_parallel_sync(bool parallel)
+    {
+        testcase << "parallel sync " << parallel;
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.db.parallel_sync(parallel);
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            if(n % 100 == 99)
+            {
+                ts.db.commit(ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+            }
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+    }
+
+    // Keeps the log file across commits and opens
+    void
+    test_reusable_log()
+    {
+        testcase("reusable log");
+        std::size_t const N = 1000;
+        std::uint64_t const logSize = 256 * 1024;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        auto const log_size =
+            [&]() -> std::uint64_t
+            {
+                native_file f;
+                f.open(file_mode::read, ts.lp, ec);
+                if(ec)
+                    return 0;
+                return f.size(ec);
+            };
+        for(std::size_t pass = 0; pass < 2; ++pass)
+        {
+            ts.db.reusable_log(logSize);
+            ts.open(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(log_size() == logSize);
+            for(std::size_t n = pass * N; n < (pass + 1) * N; ++n)
+            {
+                auto const item = ts[n];
+                ts.db.insert(item.key, item.data, item.size, ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+                if(n % 200 == 199)
+                {
+                    ts.db.commit(ec);
+                    if(! BEAST_EXPECTS(! ec, ec.message()))
+                        return;
+                    BEAST_EXPECT(log_size() == logSize);
+                }
+            }
+            ts.close(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(log_size() == logSize);
+        }
+        // Opening normally removes the reusable log
+        ts.db.reusable_log(0);
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        log_size();
+        BEAST_EXPECTS(ec == errc::no_such_file_or_directory,
+            ec.message());
+        ec = {};
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == 2 * N);
+    }
+
+    // Allocates storage ahead of the data and key files
+    void
+    test_preallocate()
+    {
+        testcase("preallocate");
+        std::size_t const N = 1000;
+        std::uint64_t const datExtent = 1024 * 1024;
+        std::uint64_t const keyExtent = 64 * 1024;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.db.preallocate(datExtent, keyExtent);
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            if(n % 200 == 199)
+            {
+                ts.db.commit(ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+            }
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+        // File sizes are not changed by the allocation
+        BEAST_EXPECT(info.key_file_size ==
+            (info.buckets + 1) * info.block_size);
+        BEAST_EXPECT(info.dat_file_size < datExtent);
+#if defined(__linux__)
+        // The storage is allocated past the end, if the
+        // file system in use allocates storage at all.
+        auto const allocated =
+            [](path_type const& path)
+            {
+                struct stat st;
+                if(::stat(path.c_str(), &st) != 0)
+                    return std::uint64_t{0};
+                return static_cast<std::uint64_t>(
+                    st.st_blocks) * 512;
+            };
+        auto const probe = ts.dp + ".probe";
+        {
+            native_file f;
+            f.create(file_mode::write, probe, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            detail::allocate(f, 0, keyExtent, ec);
+        }
+        auto const supported = ! ec && allocated(probe) >= keyExtent;
+        erase_file<native_file>(probe);
+        if(supported)
+            BEAST_EXPECT(allocated(ts.dp) >= datExtent);
+#endif
+    }
+
+    // Hints keys before fetching them
+    void
+    test_prefetch()
+    {
+        testcase("prefetch");
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        std::vector<std::vector<std::uint8_t>> keys;
+        std::vector<void const*> ptrs;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            auto const p =
+                reinterpret_cast<std::uint8_t const*>(item.key);
+            keys.emplace_back(p, p + ts.keySize);
+        }
+        for(auto const& key : keys)
+            ptrs.push_back(key.data());
+        // Keys in the pools or missing are ignored
+        ts.db.prefetch(ptrs.data(), ptrs.size(), false, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(auto const values : {false, true})
+        {
+            ts.db.prefetch(ptrs.data(), ptrs.size(), values, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.fetch(item.key,
+                [&](void const* data, std::size_t size)
+                {
+                    if(! BEAST_EXPECT(size == item.size))
+                        return;
+                    BEAST_EXPECT(
+                        std::memcmp(data, item.data, size) == 0);
+                }, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        BEAST_EXPECTS(! ec, ec.message());
+    }
+
+    // Holds the key file in memory
+    void
+    test_resident()
+    {
+        testcase("resident");
+        std::size_t const N = 5000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(! ts.db.resident());
+        ts.db.resident(true);
+        BEAST_EXPECT(ts.db.resident());
+        auto const check =
+            [&](std::size_t n)
+            {
+                auto const item = ts[n];
+                ts.db.fetch(item.key,
+                    [&](void const* data, std::size_t size)
+                    {
+                        if(! BEAST_EXPECT(size == item.size))
+                            return;
+                        BEAST_EXPECT(
+                            std::memcmp(data, item.data, size) == 0);
+                    }, ec);
+                return BEAST_EXPECTS(! ec, ec.message());
+            };
+        for(int pass = 0; pass < 2; ++pass)
+        {
+            ts.open(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(ts.db.resident_size() > 0);
+            for(std::size_t n = 0; n < N; ++n)
+            {
+                auto const i = pass * N + n;
+                auto const item = ts[i];
+                ts.db.insert(item.key, item.data, item.size, ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+                if(! check(i / 2))
+                    return;
+            }
+            for(std::size_t n = 0; n < (pass + 1) * N; ++n)
+                if(! check(n))
+                    return;
+            native_file f;
+            f.open(file_mode::read, ts.kp, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            auto const size = f.size(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(ts.db.resident_size() + ts.blockSize >= size);
+            ts.close(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == 2 * N);
+    }
+
+    // Uses a second level bucket cache file
+    void
+    test_bucket_cache()
+    {
+        testcase("bucket cache");
+        std::size_t const N = 2000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        auto const cp = ts.kp + ".l2c";
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        auto const check =
+            [&](std::size_t n)
+            {
+                auto const item = ts[n];
+                ts.db.fetch(item.key,
+                    [&](void const* data, std::size_t size)
+                    {
+                        if(! BEAST_EXPECT(size == item.size))
+                            return;
+                        BEAST_EXPECT(
+                            std::memcmp(data, item.data, size) == 0);
+                    }, ec);
+                return BEAST_EXPECTS(! ec, ec.message());
+            };
+        // Each pass reopens, optionally without the
+        // cache, so it must detect the changed files.
+        std::size_t count = 0;
+        for(auto const use : {true, true, false, true})
+        {
+            ts.db.bucket_cache(use ? cp : path_type{}, 64 * 4096);
+            ts.open(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            for(std::size_t n = 0; n < count; ++n)
+                if(! check(n))
+                    return;
+            for(std::size_t n = 0; n < N; ++n)
+            {
+                auto const item = ts[count + n];
+                ts.db.insert(item.key, item.data, item.size, ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+                if(! check((count + n) / 2))
+                    return;
+            }
+            count += N;
+            for(std::size_t n = 0; n < count; ++n)
+                if(! check(n))
+                    return;
+            ts.close(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == count);
+    }
+
+    // Errors on the bucket cache file are not
+    // returned by fetch, insert, or commit.
+    void
+    test_bucket_cache_errors()
+    {
+        testcase("bucket cache errors");
+        std::size_t const N = 2000;
+        error_code ec;
+        std::atomic<bool> fail{false};
+        basic_test_store<cache_fail_file> ts{8, 4096, 0.5f, &fail};
+        auto const cp = ts.kp + ".l2c";
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        auto const fetch_all =
+            [&](std::size_t count)
+            {
+                for(std::size_t n = 0; n < count; ++n)
+                {
+                    auto const item = ts[n];
+                    ts.db.fetch(item.key,
+                        [&](void const* data, std::size_t size)
+                        {
+                            BEAST_EXPECT(size == item.size &&
+                                std::memcmp(data, item.data, size) == 0);
+                        }, ec);
+                    if(! BEAST_EXPECTS(! ec, ec.message()))
+                        return false;
+                }
+                return true;
+            };
+        auto const insert =
+            [&](std::size_t first, std::size_t count)
+            {
+                for(std::size_t n = first; n < first + count; ++n)
+                {
+                    auto const item = ts[n];
+                    ts.db.insert(item.key, item.data, item.size, ec);
+                    if(! BEAST_EXPECTS(! ec, ec.message()))
+                        return false;
+                }
+                ts.db.commit(ec);
+                return BEAST_EXPECTS(! ec, ec.message());
+            };
+        ts.db.bucket_cache(cp, 64 * 4096);
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        if(! insert(0, N) || ! fetch_all(N))
+            return;
+        fail = true;
+        if(! insert(N, N) || ! fetch_all(2 * N))
+            return;
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // The cache was not closed cleanly, so
+        // its stale contents are discarded.
+        fail = false;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        if(! fetch_all(2 * N))
+            return;
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == 2 * N);
+    }
+
     void
     run() override
     {
         test_members();
         test_insert_fetch();
+        test_insert_prepare();
+        test_insert_stream();
+        test_recent_cache();
+        test_recent();
+        test_single_thread();
+        test_commit();
+        test_read_priority();
+        test_read_priority_limit();
+        test_parallel_sync(false);
+        test_parallel_sync(true);
+        test_reusable_log();
+        test_preallocate();
+        test_prefetch();
+        test_resident();
+        test_bucket_cache();
+        test_bucket_cache_errors();
     }
 };
 
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/commit_executor.hpp>
+
+#include <nudb/test/test_store.hpp>
+#include <nudb/progress.hpp>
+#include <nudb/verify.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nudb {
+
+static_assert(!std::is_copy_constructible   <commit_executor>{}, "");
+static_assert(!std::is_copy_assignable      <commit_executor>{}, "");
+
+namespace test {
+
+class commit_executor_test : public beast::unit_test::suite
+{
+public:
+    // Many stores sharing a few threads
+    void
+    test_stores(std::size_t threads, std::size_t per_device)
+    {
+        testcase << "threads=" << threads <<
+            ", per_device=" << per_device;
+        std::size_t const M = 8;
+        std::size_t const N = 500;
+        error_code ec;
+        commit_executor ex{threads, per_device,
+            std::chrono::milliseconds{50}};
+        BEAST_EXPECT(ex.threads() == threads);
+        BEAST_EXPECT(ex.per_device() == per_device);
+        std::vector<std::unique_ptr<test_store>> v;
+        for(std::size_t i = 0; i < M; ++i)
+        {
+            v.emplace_back(new test_store{8, 4096, 0.5f});
+            auto& ts = *v.back();
+            ts.create(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            ts.db.executor(ex, i % 2 ? "a" : "b");
+            ts.open(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            for(auto& p : v)
+            {
+                auto const item = (*p)[n];
+                p->db.insert(item.key, item.data, item.size, ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+            }
+        }
+        // Let the periodic commits run
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds{200});
+        for(auto& p : v)
+        {
+            for(std::size_t n = 0; n < N; ++n)
+            {
+                auto const item = (*p)[n];
+                p->db.fetch(item.key,
+                    [&](void const* data, std::size_t size)
+                    {
+                        if(! BEAST_EXPECT(size == item.size))
+                            return;
+                        BEAST_EXPECT(
+                            std::memcmp(data, item.data, size) == 0);
+                    }, ec);
+                if(! BEAST_EXPECTS(! ec, ec.message()))
+                    return;
+            }
+            p->close(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            verify_info info;
+            verify<xxhasher>(info, p->dp, p->kp,
+                0, no_progress{}, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(info.value_count == N);
+        }
+    }
+
+    void
+    run() override
+    {
+        test_stores(1, 1);
+        test_stores(3, 1);
+        test_stores(4, 2);
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(commit_executor, test, nudb);
+
+} // test
+} // nudb
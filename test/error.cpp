@@ -72,6 +72,8 @@ public:
         check("nudb", error::missing_value);
         check("nudb", error::size_mismatch);
         check("nudb", error::duplicate_value);
+        check("nudb", error::not_trace_file);
+        check("nudb", error::invalid_trace_record);
     }
 };
 
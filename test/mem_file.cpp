@@ -0,0 +1,218 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/mem_file.hpp>
+
+#include <nudb/test/test_store.hpp>
+#include <nudb/progress.hpp>
+#include <nudb/recover.hpp>
+#include <nudb/rekey.hpp>
+#include <nudb/verify.hpp>
+#include <nudb/visit.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace nudb {
+
+static_assert(!std::is_copy_constructible   <mem_file>{}, "");
+static_assert(!std::is_copy_assignable      <mem_file>{}, "");
+static_assert( std::is_move_constructible   <mem_file>{}, "");
+static_assert( std::is_move_assignable      <mem_file>{}, "");
+
+namespace test {
+
+class mem_file_test : public beast::unit_test::suite
+{
+public:
+    void
+    test_file()
+    {
+        testcase("file");
+        path_type const path = "mem_file_test/file";
+        error_code ec;
+        mem_file f;
+        f.open(file_mode::read, path, ec);
+        BEAST_EXPECTS(ec == errc::no_such_file_or_directory,
+            ec.message());
+        ec = {};
+        f.create(file_mode::write, path, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(f.is_open());
+        {
+            mem_file f2;
+            f2.create(file_mode::write, path, ec);
+            BEAST_EXPECTS(ec == errc::file_exists, ec.message());
+            ec = {};
+        }
+        BEAST_EXPECT(f.size(ec) == 0);
+
+        // Write across a chunk boundary,
+        // leaving a hole at the start.
+        std::uint64_t const offset = 100000;
+        char const text[] = "0123456789";
+        char buf[sizeof(text)];
+        f.write(offset - 5, text, sizeof(text), ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(f.size(ec) == offset - 5 + sizeof(text));
+        f.read(offset - 5, buf, sizeof(buf), ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(std::memcmp(buf, text, sizeof(text)) == 0);
+        f.read(0, buf, sizeof(buf), ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(buf[0] == 0 && buf[sizeof(buf) - 1] == 0);
+        f.read(offset, buf, sizeof(buf), ec);
+        BEAST_EXPECTS(ec == error::short_read, ec.message());
+        ec = {};
+        f.sync(ec);
+        BEAST_EXPECTS(! ec, ec.message());
+
+        // Truncating clears the tail
+        f.trunc(offset, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(f.size(ec) == offset);
+        f.trunc(offset + sizeof(buf), ec);
+        f.read(offset - 5, buf, sizeof(buf), ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(std::memcmp(buf, text, 5) == 0);
+        BEAST_EXPECT(buf[5] == 0 && buf[sizeof(buf) - 1] == 0);
+
+        // Other instances share the contents
+        mem_file f2;
+        f2.open(file_mode::read, path, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(f2.size(ec) == offset + sizeof(buf));
+        f2.write(0, text, sizeof(text), ec);
+        BEAST_EXPECTS(ec == errc::bad_file_descriptor,
+            ec.message());
+        ec = {};
+
+        // Move
+        mem_file f3{std::move(f2)};
+        BEAST_EXPECT(! f2.is_open());
+        BEAST_EXPECT(f3.is_open());
+        f2 = std::move(f3);
+        BEAST_EXPECT(f2.is_open());
+        BEAST_EXPECT(! f3.is_open());
+
+        // Erased files stay readable while open
+        mem_file::erase(path, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        f2.read(offset - 5, buf, 5, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(std::memcmp(buf, text, 5) == 0);
+        f.close();
+        f2.close();
+        BEAST_EXPECT(! f.is_open());
+        mem_file::erase(path, ec);
+        BEAST_EXPECTS(ec == errc::no_such_file_or_directory,
+            ec.message());
+        ec = {};
+        erase_file<mem_file>(path, ec);
+        BEAST_EXPECTS(! ec, ec.message());
+    }
+
+    void
+    test_database()
+    {
+        testcase("store");
+        std::size_t const N = 20000;
+        nsize_t const blockSize = 256;
+        float const loadFactor = 0.95f;
+        std::size_t const bufferSize = 1024 * 1024;
+        error_code ec;
+        basic_test_store<mem_file> ts{4, blockSize, loadFactor};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t i = 0; i < N; ++i)
+        {
+            auto const item = ts[i];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.db.commit(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t i = 0; i < N; ++i)
+        {
+            auto const item = ts[i];
+            ts.db.fetch(item.key,
+                [&](void const* data, std::size_t size)
+                {
+                    BEAST_EXPECT(size == item.size &&
+                        std::memcmp(data, item.data, size) == 0);
+                }, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // Nothing was written to disk
+        BEAST_EXPECT(! boost::filesystem::exists(ts.dp));
+
+        verify_info info;
+        verify<xxhasher, mem_file>(info, ts.dp, ts.kp,
+            bufferSize, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+        BEAST_EXPECT(info.spill_count > 0);
+
+        std::size_t n = 0;
+        visit<mem_file>(ts.dp,
+            [&](void const*, std::size_t,
+                void const*, std::size_t, error_code&)
+            {
+                ++n;
+            }, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(n == N);
+
+        auto const kp2 = ts.kp + "2";
+        rekey<xxhasher, mem_file>(ts.dp, kp2, ts.lp,
+            blockSize, loadFactor, N, bufferSize, ec,
+                no_progress{});
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify<xxhasher, mem_file>(info, ts.dp, kp2,
+            bufferSize, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+        erase_file<mem_file>(kp2);
+    }
+
+    void
+    run() override
+    {
+        test_file();
+        test_database();
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(mem_file, test, nudb);
+
+} // test
+} // nudb
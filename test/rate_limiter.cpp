@@ -0,0 +1,143 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/rate_limiter.hpp>
+
+#include <nudb/test/test_store.hpp>
+#include <nudb/progress.hpp>
+#include <nudb/verify.hpp>
+#include <nudb/visit.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <chrono>
+#include <type_traits>
+
+namespace nudb {
+
+static_assert(!std::is_copy_constructible   <rate_limiter>{}, "");
+static_assert(!std::is_copy_assignable      <rate_limiter>{}, "");
+static_assert( std::is_move_constructible   <rate_limited_file<native_file>>{}, "");
+static_assert( std::is_move_assignable      <rate_limited_file<native_file>>{}, "");
+
+namespace test {
+
+class rate_limiter_test : public beast::unit_test::suite
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    static
+    std::chrono::milliseconds
+    elapsed(clock_type::time_point when)
+    {
+        return std::chrono::duration_cast<
+            std::chrono::milliseconds>(clock_type::now() - when);
+    }
+
+    void
+    test_limiter()
+    {
+        testcase("limiter");
+        using std::chrono::milliseconds;
+        {
+            // No limit
+            rate_limiter r{0};
+            auto const start = clock_type::now();
+            for(int i = 0; i < 1000; ++i)
+                r.request(1024 * 1024);
+            BEAST_EXPECT(elapsed(start) < milliseconds{100});
+        }
+        {
+            // 1MB/s with a 64KB burst, 256KB
+            // should take at least 192ms.
+            rate_limiter r{1024 * 1024, 64 * 1024};
+            BEAST_EXPECT(r.rate() == 1024 * 1024);
+            auto const start = clock_type::now();
+            for(int i = 0; i < 64; ++i)
+                r.request(4096);
+            BEAST_EXPECT(elapsed(start) >= milliseconds{180});
+            r.rate(0);
+            BEAST_EXPECT(r.rate() == 0);
+            r.request(1024 * 1024 * 1024);
+        }
+    }
+
+    void
+    test_file()
+    {
+        testcase("file");
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // Limit commit writes
+        rate_limiter r{16 * 1024 * 1024};
+        ts.db.commit_rate(&r);
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        using File = rate_limited_file<native_file>;
+        {
+            verify_info info;
+            verify<xxhasher, File>(info, ts.dp, ts.kp,
+                0, no_progress{}, ec, r);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(info.value_count == N);
+        }
+        {
+            std::size_t count = 0;
+            visit<File>(ts.dp,
+                [&](void const*, std::size_t,
+                    void const*, std::size_t, error_code&)
+                {
+                    ++count;
+                }, no_progress{}, ec, r);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(count == N);
+        }
+        {
+            // Default constructed file is not limited
+            File f;
+            f.open(file_mode::read, ts.kp, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(f.is_open());
+            BEAST_EXPECT(f.size(ec) > 0);
+            char buf[64];
+            f.read(0, buf, sizeof(buf), ec);
+            BEAST_EXPECTS(! ec, ec.message());
+            f.close();
+            BEAST_EXPECT(! f.is_open());
+        }
+    }
+
+    void
+    run() override
+    {
+        test_limiter();
+        test_file();
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(rate_limiter, test, nudb);
+
+} // test
+} // nudb
@@ -43,6 +43,66 @@ public:
             return;
     }
 
+    // A reusable log holding a commit is not
+    // applied to an invalid key file.
+    void
+    test_reusable_bad_key_file()
+    {
+        testcase("reusable log, bad key file header");
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.db.reusable_log(64 * 1024);
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t i = 0; i < 100; ++i)
+        {
+            auto const item = ts[i];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // Mark the log as holding a commit
+        {
+            native_file df;
+            df.open(file_mode::read, ts.dp, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            native_file lf;
+            lf.open(file_mode::write, ts.lp, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            detail::reusable_log_header h;
+            detail::read(lf, h, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            h.lh.dat_file_size = df.size(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            detail::write(lf, h, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        // Damage the type in the key file header
+        {
+            native_file kf;
+            kf.open(file_mode::write, ts.kp, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            kf.write(0, "nudb.bad", 8, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        recover<xxhasher>(ts.dp, ts.kp, ts.lp, ec);
+        BEAST_EXPECTS(ec == error::not_key_file, ec.message());
+    }
+
     // Creates and opens a database, performs a bunch
     // of inserts, then fetches all of them to make sure
     // they are there. Uses a fail_file that causes the n-th
@@ -51,6 +111,7 @@ public:
     do_work(
         test_store& ts,
         std::size_t N,
+        std::uint64_t logSize,
         fail_counter& c,
         error_code& ec)
     {
@@ -58,6 +119,7 @@ public:
         if(ec)
             return;
         basic_store<xxhasher, fail_file<native_file>> db;
+        db.reusable_log(logSize);
         db.open(ts.dp, ts.kp, ts.lp, 16 * 1024 * 1024, ec, c);
         if(ec)
             return;
@@ -125,17 +187,19 @@ public:
 
     void
     test_recover(std::size_t blockSize,
-        float loadFactor, std::size_t N)
+        float loadFactor, std::size_t N,
+            std::uint64_t logSize = 0)
     {
-        testcase(std::to_string(N) + " inserts",
-            beast::unit_test::abort_on_fail);
+        testcase(std::to_string(N) + " inserts" +
+            (logSize > 0 ? ", reusable log" : ""),
+                beast::unit_test::abort_on_fail);
         test_store ts{sizeof(key_type), blockSize, loadFactor};
         for(std::size_t n = 1;; ++n)
         {
             {
                 error_code ec;
                 fail_counter c{n};
-                do_work(ts, N, c, ec);
+                do_work(ts, N, logSize, c, ec);
                 if(! ec)
                     break;
                 if(! BEAST_EXPECTS(ec ==
@@ -164,10 +228,13 @@ public:
     run() override
     {
         test_ok();
+        test_reusable_bad_key_file();
         test_recover(4096, 0.55f, 0);
         test_recover(4096, 0.55f, 10);
         test_recover(4096, 0.55f, 100);
         test_recover(4096, 0.55f, 1000);
+        test_recover(4096, 0.55f, 100, 64 * 1024);
+        test_recover(4096, 0.55f, 1000, 64 * 1024);
     }
 };
 
@@ -0,0 +1,231 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/replay.hpp>
+
+#include <nudb/test/temp_dir.hpp>
+#include <nudb/test/test_store.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <atomic>
+#include <chrono>
+
+namespace nudb {
+namespace test {
+
+class replay_test : public beast::unit_test::suite
+{
+public:
+    std::size_t const N = 1000;
+
+    // Record N inserts, a commit, then a
+    // fetch of each key and of N missing keys.
+    void
+    record(test_store& ts, path_type const& path, error_code& ec)
+    {
+        trace_writer w;
+        w.create(path, ts.keySize, ec);
+        if(ec)
+            return;
+        ts.create(ec);
+        if(ec)
+            return;
+        ts.db.trace(&w);
+        ts.open(ec);
+        if(ec)
+            return;
+        for(std::size_t i = 0; i < N; ++i)
+        {
+            auto const item = ts[i];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(ec)
+                return;
+        }
+        ts.db.commit(ec);
+        if(ec)
+            return;
+        for(std::size_t i = 0; i < 2 * N; ++i)
+        {
+            auto const item = ts[i];
+            ts.db.fetch(item.key,
+                [](void const*, std::size_t)
+                {
+                }, ec);
+            if(ec == error::key_not_found)
+                ec = {};
+            if(ec)
+                return;
+        }
+        ts.close(ec);
+        if(ec)
+            return;
+        w.close(ec);
+    }
+
+    void
+    test_replay(std::size_t threads)
+    {
+        testcase << "replay, " << threads << " threads";
+        error_code ec;
+        test_store ts0{8, 4096, 0.5f};
+        temp_dir td;
+        auto const path = td.file("nudb.trc");
+        record(ts0, path, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        replay_options options;
+        options.threads = threads;
+        replay_info info;
+        std::atomic<std::size_t> calls{0};
+        replay(ts.db, path, options, info,
+            [&](std::size_t thread, trace_op,
+                std::chrono::steady_clock::duration)
+            {
+                BEAST_EXPECT(thread < threads);
+                ++calls;
+            }, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.records == 3 * N + 1);
+        BEAST_EXPECT(calls == info.records);
+        BEAST_EXPECT(info.inserts == N);
+        BEAST_EXPECT(info.duplicates == 0);
+        BEAST_EXPECT(info.fetches == 2 * N);
+        BEAST_EXPECT(info.fetch_misses == N);
+        BEAST_EXPECT(info.commits == 1);
+        BEAST_EXPECT(info.preloaded == 0);
+        BEAST_EXPECT(info.mismatches == 0);
+
+        // Again, now every insert is a duplicate
+        replay(ts.db, path, options, info, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.duplicates == N);
+        BEAST_EXPECT(info.mismatches == 0);
+        ts.close(ec);
+        BEAST_EXPECTS(! ec, ec.message());
+    }
+
+    void
+    test_preload()
+    {
+        testcase("preload");
+        error_code ec;
+        test_store ts0{8, 4096, 0.5f};
+        temp_dir td;
+        auto const path = td.file("nudb.trc");
+        {
+            // Record only fetches
+            ts0.create(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            ts0.open(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            for(std::size_t i = 0; i < N; ++i)
+            {
+                auto const item = ts0[i];
+                ts0.db.insert(item.key, item.data, item.size, ec);
+            }
+            ts0.close(ec);
+            trace_writer w;
+            w.create(path, ts0.keySize, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            ts0.db.trace(&w);
+            ts0.open(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            for(std::size_t i = 0; i < 2 * N; ++i)
+            {
+                auto const item = ts0[i];
+                ts0.db.fetch(item.key,
+                    [](void const*, std::size_t)
+                    {
+                    }, ec);
+            }
+            ts0.close(ec);
+            w.close(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        replay_options options;
+        options.preload = true;
+        options.speed = 1;
+        replay_info info;
+        replay(ts.db, path, options, info, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.preloaded == N);
+        BEAST_EXPECT(info.fetches == 2 * N);
+        BEAST_EXPECT(info.fetch_misses == N);
+        BEAST_EXPECT(info.mismatches == 0);
+        // Played at the recorded speed
+        BEAST_EXPECT(info.elapsed >= info.duration);
+        ts.close(ec);
+        BEAST_EXPECTS(! ec, ec.message());
+    }
+
+    void
+    test_errors()
+    {
+        testcase("errors");
+        error_code ec;
+        test_store ts0{4, 4096, 0.5f};
+        temp_dir td;
+        auto const path = td.file("nudb.trc");
+        {
+            trace_writer w;
+            w.create(path, 8, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            w.close(ec);
+        }
+        ts0.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts0.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        replay_info info;
+        replay(ts0.db, path, replay_options{}, info, ec);
+        BEAST_EXPECTS(ec == error::key_size_mismatch, ec.message());
+        ec = {};
+        replay(ts0.db, path + ".missing", replay_options{}, info, ec);
+        BEAST_EXPECT(ec);
+        ts0.close(ec);
+    }
+
+    void
+    run() override
+    {
+        test_replay(1);
+        test_replay(4);
+        test_preload();
+        test_errors();
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(replay, test, nudb);
+
+} // test
+} // nudb
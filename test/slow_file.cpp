@@ -0,0 +1,201 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/test/slow_file.hpp>
+
+#include <nudb/test/xor_shift_engine.hpp>
+#include <nudb/mem_file.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace nudb {
+namespace test {
+
+static_assert(!std::is_copy_constructible   <slow_file<mem_file>>{}, "");
+static_assert(!std::is_copy_assignable      <slow_file<mem_file>>{}, "");
+static_assert( std::is_move_constructible   <slow_file<mem_file>>{}, "");
+static_assert( std::is_move_assignable      <slow_file<mem_file>>{}, "");
+
+class slow_file_test : public beast::unit_test::suite
+{
+public:
+    using micros = std::chrono::duration<double, std::micro>;
+
+    bool
+    throws(std::string const& spec)
+    {
+        try
+        {
+            delay_distribution{spec};
+        }
+        catch(std::invalid_argument const&)
+        {
+            return true;
+        }
+        return false;
+    }
+
+    void
+    test_parse()
+    {
+        testcase("parse");
+        for(auto const spec : {
+            "none", "fixed:0", "fixed:10", "fixed:2.5",
+            "lognormal:100:0.5", "lognormal:1:0",
+            "none,stall:2:5", "fixed:10,stall:3:1000",
+            "lognormal:100:1,stall:1:0"})
+        {
+            if(! BEAST_EXPECTS(! throws(spec), spec))
+                continue;
+            BEAST_EXPECTS(delay_distribution{spec}.str() == spec, spec);
+        }
+        BEAST_EXPECT(delay_distribution{}.empty());
+        BEAST_EXPECT(delay_distribution{}.str() == "none");
+        BEAST_EXPECT(delay_distribution{"none"}.empty());
+        BEAST_EXPECT(! delay_distribution{"fixed:0"}.empty());
+        BEAST_EXPECT(! delay_distribution{"none,stall:2:5"}.empty());
+
+        for(auto const spec : {
+            "", "bogus", "none:1", "fixed", "fixed:", "fixed:x",
+            "fixed:1x", "fixed:1:2", "lognormal:100",
+            "lognormal:0:1", "fixed:1,", "fixed:1,stall",
+            "fixed:1,stall:2", "fixed:1,stall:0:5",
+            "fixed:1,stall:2:5:1", "fixed:1,wait:2:5",
+            "stall:2:5"})
+            BEAST_EXPECTS(throws(spec), spec);
+
+        // Negative values
+        for(auto const spec : {
+            "fixed:-1", "lognormal:-100:1", "lognormal:100:-1",
+            "none,stall:-2:5", "fixed:1,stall:2:-5"})
+            BEAST_EXPECTS(throws(spec), spec);
+    }
+
+    void
+    test_delays()
+    {
+        testcase("delays");
+        xor_shift_engine g{1};
+        {
+            delay_distribution const d;
+            for(std::uint64_t n = 1; n <= 10; ++n)
+                BEAST_EXPECT(d(g, n) == micros{0});
+        }
+        {
+            delay_distribution const d{"fixed:10"};
+            for(std::uint64_t n = 1; n <= 10; ++n)
+                BEAST_EXPECT(d(g, n) == micros{10});
+        }
+        {
+            // Every third operation stalls
+            delay_distribution const d{"fixed:10,stall:3:1000"};
+            for(std::uint64_t n = 1; n <= 12; ++n)
+                BEAST_EXPECTS(d(g, n) ==
+                    micros{n % 3 == 0 ? 1010 : 10},
+                        std::to_string(n));
+        }
+        {
+            delay_distribution const d{"none,stall:4:50"};
+            for(std::uint64_t n = 1; n <= 12; ++n)
+                BEAST_EXPECT(d(g, n) ==
+                    micros{n % 4 == 0 ? 50 : 0});
+        }
+        {
+            // With no spread every delay is the median
+            delay_distribution const d{"lognormal:100:0"};
+            for(std::uint64_t n = 1; n <= 10; ++n)
+                BEAST_EXPECT(std::abs(d(g, n).count() - 100) < 1e-6);
+        }
+        {
+            delay_distribution const d{"lognormal:100:1"};
+            for(std::uint64_t n = 1; n <= 100; ++n)
+                BEAST_EXPECT(d(g, n) > micros{0});
+        }
+    }
+
+    void
+    test_file()
+    {
+        testcase("file");
+        using clock_type = std::chrono::steady_clock;
+        path_type const path = "slow_file_test/file";
+        error_code ec;
+        slow_file_delays d;
+        d.write = delay_distribution{"fixed:100"};
+        d.read = delay_distribution{"none,stall:2:2000"};
+        d.trunc = delay_distribution{"fixed:50"};
+        slow_file<mem_file> f{d};
+        f.create(file_mode::write, path, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(d.total().count() == 0);
+
+        // Fixed delays
+        char const text[] = "0123456789";
+        for(std::uint64_t i = 0; i < 3; ++i)
+            f.write(i * sizeof(text), text, sizeof(text), ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(d.total() == std::chrono::microseconds{300});
+
+        // Only every second read stalls
+        char buf[sizeof(text)];
+        auto const start = clock_type::now();
+        for(std::uint64_t i = 0; i < 4; ++i)
+        {
+            std::memset(buf, 0, sizeof(buf));
+            f.read(i % 3 * sizeof(text), buf, sizeof(buf), ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(std::memcmp(buf, text, sizeof(text)) == 0);
+        }
+        BEAST_EXPECT(clock_type::now() - start >=
+            std::chrono::microseconds{4000});
+        BEAST_EXPECT(d.total() == std::chrono::microseconds{4300});
+
+        // No delay
+        f.sync(ec);
+        BEAST_EXPECTS(! ec, ec.message());
+        BEAST_EXPECT(d.total() == std::chrono::microseconds{4300});
+
+        f.trunc(sizeof(text), ec);
+        BEAST_EXPECTS(! ec, ec.message());
+        BEAST_EXPECT(f.size(ec) == sizeof(text));
+        BEAST_EXPECT(d.total() == std::chrono::microseconds{4350});
+
+        // Moving keeps the delays
+        slow_file<mem_file> f2{std::move(f)};
+        BEAST_EXPECT(f2.is_open());
+        BEAST_EXPECT(! f.is_open());
+        f2.write(0, text, sizeof(text), ec);
+        BEAST_EXPECTS(! ec, ec.message());
+        BEAST_EXPECT(d.total() == std::chrono::microseconds{4450});
+        f2.close();
+        mem_file::erase(path, ec);
+        BEAST_EXPECTS(! ec, ec.message());
+    }
+
+    void
+    run() override
+    {
+        test_parse();
+        test_delays();
+        test_file();
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(slow_file, test, nudb);
+
+} // test
+} // nudb
@@ -0,0 +1,75 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/thread_policy.hpp>
+
+#include <beast/unit_test/suite.hpp>
+#include <boost/thread/lock_types.hpp>
+#include <type_traits>
+
+namespace nudb {
+
+static_assert( multi_thread::background, "");
+static_assert(!single_thread::background, "");
+static_assert(std::is_empty<detail::null_mutex>{}, "");
+static_assert(std::is_empty<detail::null_gentex>{}, "");
+
+namespace test {
+
+class thread_policy_test : public beast::unit_test::suite
+{
+public:
+    void
+    test_null_mutex()
+    {
+        testcase("null_mutex");
+        single_thread::mutex_type m;
+        {
+            std::lock_guard<single_thread::mutex_type> lock{m};
+        }
+        BEAST_EXPECT(m.try_lock());
+        m.unlock();
+        single_thread::shared_mutex_type sm;
+        {
+            boost::shared_lock<
+                single_thread::shared_mutex_type> lock{sm};
+            BEAST_EXPECT(lock.owns_lock());
+        }
+        {
+            boost::unique_lock<
+                single_thread::shared_mutex_type> lock{sm};
+            BEAST_EXPECT(lock.owns_lock());
+            lock.unlock();
+            BEAST_EXPECT(! lock.owns_lock());
+        }
+    }
+
+    void
+    test_null_gentex()
+    {
+        testcase("null_gentex");
+        single_thread::gentex_type g;
+        g.start();
+        auto const gen = g.lock_gen();
+        g.finish();
+        g.unlock_gen(gen);
+        pass();
+    }
+
+    void
+    run() override
+    {
+        test_null_mutex();
+        test_null_gentex();
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(thread_policy, test, nudb);
+
+} // test
+} // nudb
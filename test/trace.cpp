@@ -0,0 +1,258 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/trace.hpp>
+
+#include <nudb/test/temp_dir.hpp>
+#include <nudb/test/test_store.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <cstring>
+#include <type_traits>
+
+namespace nudb {
+
+static_assert(!std::is_copy_constructible   <trace_writer>{}, "");
+static_assert(!std::is_copy_assignable      <trace_writer>{}, "");
+static_assert(!std::is_copy_constructible   <trace_reader>{}, "");
+static_assert(!std::is_copy_assignable      <trace_reader>{}, "");
+
+namespace test {
+
+class trace_test : public beast::unit_test::suite
+{
+public:
+    void
+    test_format()
+    {
+        testcase("format");
+        temp_dir td;
+        auto const path = td.file("nudb.trc");
+        error_code ec;
+        {
+            trace_writer w;
+            w.create(path, 4, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(w.is_open());
+            BEAST_EXPECT(w.key_size() == 4);
+            w.insert(0x123456789abc, "abcd", 100);
+            w.fetch(0x123456789abc, "abcd", 100);
+            w.fetch(42, "wxyz", 0);
+            w.commit();
+            BEAST_EXPECT(w.records() == 4);
+            w.close(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            BEAST_EXPECT(! w.is_open());
+        }
+        {
+            // Existing file
+            trace_writer w;
+            w.create(path, 4, ec);
+            BEAST_EXPECT(ec);
+            ec = {};
+        }
+        trace_reader r;
+        r.open(path, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(r.key_size() == 4);
+        BEAST_EXPECT(r.start() > 0);
+        trace_record t;
+        std::uint64_t time = 0;
+        BEAST_EXPECT(r.next(t, ec));
+        BEAST_EXPECT(t.op == trace_op::insert);
+        BEAST_EXPECT(t.hash == 0x123456789abc);
+        BEAST_EXPECT(t.size == 100);
+        BEAST_EXPECT(std::memcmp(t.key, "abcd", 4) == 0);
+        time = t.time;
+        BEAST_EXPECT(r.next(t, ec));
+        BEAST_EXPECT(t.op == trace_op::fetch);
+        BEAST_EXPECT(t.size == 100);
+        BEAST_EXPECT(t.time >= time);
+        BEAST_EXPECT(r.next(t, ec));
+        BEAST_EXPECT(t.op == trace_op::fetch);
+        BEAST_EXPECT(t.hash == 42);
+        BEAST_EXPECT(t.size == 0);
+        BEAST_EXPECT(std::memcmp(t.key, "wxyz", 4) == 0);
+        BEAST_EXPECT(r.next(t, ec));
+        BEAST_EXPECT(t.op == trace_op::commit);
+        BEAST_EXPECT(t.key == nullptr);
+        BEAST_EXPECT(! r.next(t, ec));
+        BEAST_EXPECTS(! ec, ec.message());
+        r.close();
+
+        {
+            // Partial record at the end
+            native_file f;
+            f.open(file_mode::write, path, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            auto const size = f.size(ec);
+            f.trunc(size - 3, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            f.close();
+            r.open(path, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            int n = 0;
+            while(r.next(t, ec))
+                ++n;
+            BEAST_EXPECTS(! ec, ec.message());
+            BEAST_EXPECT(n == 3);
+            r.close();
+        }
+        {
+            // Not a trace file
+            native_file f;
+            f.open(file_mode::write, path, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            f.write(0, "nudb.dat", 8, ec);
+            f.close();
+            r.open(path, ec);
+            BEAST_EXPECTS(ec == error::not_trace_file,
+                ec.message());
+        }
+    }
+
+    void
+    test_record()
+    {
+        testcase("record");
+        std::size_t const N = 100;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        temp_dir td;
+        auto const path = td.file("nudb.trc");
+        trace_writer w;
+        {
+            // Key size must match
+            w.create(path, 4, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            ts.create(ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            ts.db.trace(&w);
+            ts.open(ec);
+            BEAST_EXPECTS(ec == error::key_size_mismatch,
+                ec.message());
+            w.close(ec);
+            File::erase(path, ec);
+            ec = {};
+        }
+        w.create(path, ts.keySize, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t i = 0; i < N; ++i)
+        {
+            auto const item = ts[i];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        // Duplicates are not recorded
+        ts.db.insert(ts[0].key, ts[0].data, ts[0].size, ec);
+        BEAST_EXPECT(ec == error::key_exists);
+        ec = {};
+        ts.db.commit(ec);
+        for(std::size_t i = 0; i < 2 * N; ++i)
+        {
+            auto const item = ts[i];
+            ts.db.fetch(item.key,
+                [](void const*, std::size_t)
+                {
+                }, ec);
+            BEAST_EXPECT(i < N ? ! ec : ec == error::key_not_found);
+            ec = {};
+        }
+        {
+            auto const item = ts[N];
+            auto p = ts.db.insert_prepare(
+                item.key, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+            std::memcpy(p, item.data, item.size);
+            ts.db.insert_commit(ec);
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        w.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+
+        trace_reader r;
+        r.open(path, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        std::size_t inserts = 0;
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t commits = 0;
+        trace_record t;
+        while(r.next(t, ec))
+        {
+            switch(t.op)
+            {
+            case trace_op::insert:
+            {
+                auto const item = ts[inserts++];
+                BEAST_EXPECT(t.size == item.size);
+                BEAST_EXPECT(std::memcmp(
+                    t.key, item.key, ts.keySize) == 0);
+                break;
+            }
+            case trace_op::fetch:
+            {
+                auto const item = ts[hits + misses];
+                BEAST_EXPECT(std::memcmp(
+                    t.key, item.key, ts.keySize) == 0);
+                if(t.size > 0)
+                {
+                    BEAST_EXPECT(t.size == item.size);
+                    ++hits;
+                }
+                else
+                {
+                    ++misses;
+                }
+                break;
+            }
+            case trace_op::commit:
+                ++commits;
+                break;
+            }
+        }
+        BEAST_EXPECTS(! ec, ec.message());
+        BEAST_EXPECT(inserts == N + 1);
+        BEAST_EXPECT(hits == N);
+        BEAST_EXPECT(misses == N);
+        BEAST_EXPECT(commits == 1);
+    }
+
+    void
+    run() override
+    {
+        test_format();
+        test_record();
+    }
+
+private:
+    using File = native_file;
+};
+
+BEAST_DEFINE_TESTSUITE(trace, test, nudb);
+
+} // test
+} // nudb
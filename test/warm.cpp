@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/warm.hpp>
+
+#include <nudb/test/test_store.hpp>
+#include <nudb/progress.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace nudb {
+namespace test {
+
+class warm_test : public beast::unit_test::suite
+{
+public:
+    void
+    test_warm()
+    {
+        testcase("warm");
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        std::uint64_t amount = 0;
+        std::uint64_t total = 0;
+        warm<native_file>(ts.kp, 8192,
+            [&](std::uint64_t amount_, std::uint64_t total_)
+            {
+                BEAST_EXPECT(amount_ >= amount);
+                amount = amount_;
+                total = total_;
+            }, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(total > 0);
+        BEAST_EXPECT(amount == total);
+
+        warm<native_file>(ts.kp + ".missing",
+            8192, no_progress{}, ec);
+        BEAST_EXPECTS(ec ==
+            errc::no_such_file_or_directory, ec.message());
+    }
+
+    void
+    test_store_warm()
+    {
+        testcase("store warm");
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        std::atomic<bool> done{false};
+        ts.db.warm(4096,
+            [&](std::uint64_t amount, std::uint64_t total)
+            {
+                if(amount == total)
+                    done = true;
+            });
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        for(int i = 0; i < 500 && ! done; ++i)
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds{10});
+        BEAST_EXPECT(done);
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // Closing stops warming in progress
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.db.warm(1, no_progress{});
+        ts.close(ec);
+        BEAST_EXPECTS(! ec, ec.message());
+    }
+
+    void
+    run() override
+    {
+        test_warm();
+        test_store_warm();
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(warm, test, nudb);
+
+} // test
+} // nudb
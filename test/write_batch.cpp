@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2015-2016 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Test that header file is self-contained
+#include <nudb/write_batch.hpp>
+
+#include <nudb/test/test_store.hpp>
+#include <nudb/progress.hpp>
+#include <nudb/verify.hpp>
+#include <beast/unit_test/suite.hpp>
+#include <cstring>
+#include <type_traits>
+
+namespace nudb {
+
+static_assert(!std::is_copy_constructible   <write_batch>{}, "");
+static_assert(!std::is_copy_assignable      <write_batch>{}, "");
+
+namespace test {
+
+class write_batch_test : public beast::unit_test::suite
+{
+public:
+    void
+    test_batch()
+    {
+        testcase("batch");
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        write_batch wb{ts.keySize};
+        BEAST_EXPECT(wb.empty());
+        BEAST_EXPECT(wb.key_size() == ts.keySize);
+        for(std::size_t n = 0; n < 100; ++n)
+        {
+            auto const item = ts[n];
+            wb.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        BEAST_EXPECT(wb.size() == 100);
+        {
+            auto const item = ts[7];
+            wb.insert(item.key, item.data, item.size, ec);
+            BEAST_EXPECTS(ec == error::key_exists, ec.message());
+            ec = {};
+            BEAST_EXPECT(wb.size() == 100);
+        }
+        wb.clear();
+        BEAST_EXPECT(wb.empty());
+    }
+
+    void
+    test_insert()
+    {
+        testcase("insert");
+        std::size_t const N = 1000;
+        error_code ec;
+        test_store ts{8, 4096, 0.5f};
+        ts.create(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        ts.open(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        write_batch wb{ts.keySize};
+        for(std::size_t n = 0; n < N; ++n)
+        {
+            auto const item = ts[n];
+            wb.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.db.insert(wb, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        // One existing key rejects the whole batch
+        wb.clear();
+        for(std::size_t n = N - 1; n < N + 10; ++n)
+        {
+            auto const item = ts[n];
+            wb.insert(item.key, item.data, item.size, ec);
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.db.insert(wb, ec);
+        BEAST_EXPECTS(ec == error::key_exists, ec.message());
+        ec = {};
+        for(std::size_t n = 0; n < N + 10; ++n)
+        {
+            auto const item = ts[n];
+            ts.db.fetch(item.key,
+                [&](void const* data, std::size_t size)
+                {
+                    if(! BEAST_EXPECT(size == item.size))
+                        return;
+                    BEAST_EXPECT(
+                        std::memcmp(data, item.data, size) == 0);
+                }, ec);
+            if(n >= N)
+            {
+                BEAST_EXPECTS(ec == error::key_not_found,
+                    ec.message());
+                ec = {};
+                continue;
+            }
+            if(! BEAST_EXPECTS(! ec, ec.message()))
+                return;
+        }
+        ts.close(ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        verify_info info;
+        verify<xxhasher>(info, ts.dp, ts.kp,
+            0, no_progress{}, ec);
+        if(! BEAST_EXPECTS(! ec, ec.message()))
+            return;
+        BEAST_EXPECT(info.value_count == N);
+    }
+
+    void
+    run() override
+    {
+        test_batch();
+        test_insert();
+    }
+};
+
+BEAST_DEFINE_TESTSUITE(write_batch, test, nudb);
+
+} // test
+} // nudb
@@ -9,6 +9,7 @@
 #include <nudb/util.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <iostream>
@@ -125,6 +126,15 @@ public:
                             "Path to log file.")
            ("count,n",     po::value<std::uint64_t>(),
                             "The number of items in the data file.")
+           ("rate,r",      po::value<std::uint64_t>(),
+                            "Limit file I/O to this many bytes per second.")
+           ("trace,t",     po::value<std::string>(),
+                            "Path to trace file.")
+           ("speed,s",     po::value<double>(),
+                            "Replay speed relative to the trace, 0 for fastest.")
+           ("threads",     po::value<std::size_t>(),
+                            "The number of threads replaying the trace.")
+           ("preload",     "Insert the values found by the trace first.")
            ("command",     "Command to run.")
             ;
     }
@@ -166,7 +176,7 @@ public:
             "        file is present.  Running commands on an unrecovered database\n"
             "        may result in lost or corrupted data.\n"
             "\n"
-            "    rekey <dat-path] <key-path> <log-path> --count=<items> --buffer=<bytes>\n"
+            "    rekey <dat-path] <key-path> <log-path> --count=<items> --buffer=<bytes> [--rate=<bytes>]\n"
             "\n"
             "        Generate the key file for a data file.  The buffer  option is\n"
             "        required,  larger  buffers process faster.  A buffer equal to\n"
@@ -177,7 +187,17 @@ public:
             "        If the rekey is aborted before completion,  the database must\n"
             "        be subsequently restored by running the 'recover' command.\n"
             "\n"
-            "    verify <dat-path> <key-path> [--buffer=<bytes>]\n"
+            "    replay <dat-path> <key-path> <log-path> --trace=<path> [--speed=<factor>]\n"
+            "           [--threads=<count>] [--preload]\n"
+            "\n"
+            "        Play back the operations recorded in a trace file against a\n"
+            "        database, and show the time taken. The speed option issues\n"
+            "        operations at the recorded times divided by the factor, or\n"
+            "        as fast as possible when omitted or zero. The preload option\n"
+            "        first inserts the values which the trace fetches before it\n"
+            "        inserts them, for a trace taken from an existing database.\n"
+            "\n"
+            "    verify <dat-path> <key-path> [--buffer=<bytes>] [--rate=<bytes>]\n"
             "\n"
             "        Verify  the  integrity of a  database.  The buffer  option is\n"
             "        optional, if omitted a slow  algorithm is used. When a buffer\n"
@@ -185,14 +205,23 @@ public:
             "        buffers  resulting in bigger speedups.  A buffer equal to the\n"
             "        size of the key file provides the fastest speedup.\n"
             "\n"
-            "    visit <dat-path>\n"
+            "    visit <dat-path> [--rate=<bytes>]\n"
             "\n"
             "        Iterate a data file and show information, including the count\n"
             "        of items in the file and a histogram of their log base2 size.\n"
             "\n"
+            "    warm <path> [<path> [<path>]] [--buffer=<bytes>]\n"
+            "\n"
+            "        Load files into the operating system cache by reading them\n"
+            "        sequentially.  Usually  run on the key file before starting\n"
+            "        an  application,  to avoid  slow  fetches while  the  cache\n"
+            "        fills from random reads.\n"
+            "\n"
             "Notes:\n"
             "\n"
             "    Paths may be full or relative, and should include the extension.\n"
+            "    The rate option limits the bytes read and written each second,\n"
+            "    so that the command does not starve other users of the device.\n"
             "    The recover  algorithm  should be  invoked  before  running  any\n"
             "    operation which can modify the database.\n"
             "\n"
@@ -200,6 +229,14 @@ public:
         desc_.print(std::cout);
     };
 
+    static
+    std::uint64_t
+    rate(boost::program_options::variables_map const& vm)
+    {
+        return vm.count("rate") ?
+            vm["rate"].as<std::uint64_t>() : 0;
+    }
+
     int
     error(std::string const& why)
     {
@@ -253,12 +290,18 @@ public:
             if(cmd == "rekey")
                 return do_rekey(vm);
 
+            if(cmd == "replay")
+                return do_replay(vm);
+
             if(cmd == "verify")
                 return do_verify(vm);
 
             if(cmd == "visit")
                 return do_visit(vm);
 
+            if(cmd == "warm")
+                return do_warm(vm);
+
             return error("Unknown command '" + cmd + "'");
         }
         catch(std::exception const& e)
@@ -393,9 +436,10 @@ private:
         auto const bufferSize = vm["buffer"].as<std::size_t>();
         error_code ec;
         progress p{std::cout};
-        rekey<Hasher, native_file>(dp, kp, lp,
+        rate_limiter r{rate(vm)};
+        rekey<Hasher, rate_limited_file<native_file>>(dp, kp, lp,
             block_size(kp), 0.5f, itemCount,
-                bufferSize, ec, p);
+                bufferSize, ec, p, r);
         if(ec)
         {
             std::cerr << "rekey: " << ec.message() << "\n";
@@ -404,6 +448,59 @@ private:
         return EXIT_SUCCESS;
     }
 
+    int
+    do_replay(boost::program_options::variables_map const& vm)
+    {
+        if(! vm.count("dat") || ! vm.count("key") || ! vm.count("log"))
+            return error("Missing file specifications");
+        if(! vm.count("trace"))
+            return error("Missing trace file");
+        replay_options options;
+        if(vm.count("speed"))
+            options.speed = vm["speed"].as<double>();
+        if(vm.count("threads"))
+            options.threads = vm["threads"].as<std::size_t>();
+        options.preload = vm.count("preload") != 0;
+        error_code ec;
+        basic_store<Hasher, native_file> db;
+        db.open(
+            vm["dat"].as<std::string>(),
+            vm["key"].as<std::string>(),
+            vm["log"].as<std::string>(),
+            16 * 1024 * 1024,
+            ec);
+        if(! ec)
+        {
+            replay_info info;
+            replay(db, vm["trace"].as<std::string>(),
+                options, info, ec);
+            if(! ec)
+                std::cout <<
+                    "records:         " << fdec(info.records) << "\n"
+                    "fetches:         " << fdec(info.fetches) << "\n"
+                    "fetch_misses:    " << fdec(info.fetch_misses) << "\n"
+                    "mismatches:      " << fdec(info.mismatches) << "\n"
+                    "inserts:         " << fdec(info.inserts) << "\n"
+                    "duplicates:      " << fdec(info.duplicates) << "\n"
+                    "commits:         " << fdec(info.commits) << "\n"
+                    "preloaded:       " << fdec(info.preloaded) << "\n"
+                    "duration:        " << std::fixed << std::setprecision(3) << info.duration.count() << "s\n"
+                    "elapsed:         " << std::fixed << std::setprecision(3) << info.elapsed.count() << "s\n"
+                    "per_second:      " << std::fixed << std::setprecision(0) <<
+                        info.records / std::max(info.elapsed.count(), 1e-9) << "\n"
+                    "max_lag:         " << std::fixed << std::setprecision(3) << info.max_lag.count() * 1000 << "ms\n"
+                    ;
+        }
+        if(! ec)
+            db.close(ec);
+        if(ec)
+        {
+            std::cerr << "replay: " << ec.message() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
     int
     do_verify(boost::program_options::variables_map const& vm)
     {
@@ -429,7 +526,9 @@ private:
         progress p(std::cout);
         {
             verify_info info;
-            verify<Hasher>(info, dp, kp, bufferSize, p, ec);
+            rate_limiter r{rate(vm)};
+            verify<Hasher, rate_limited_file<native_file>>(
+                info, dp, kp, bufferSize, p, ec, r);
             if(! ec)
                 std::cout << info;
         }
@@ -478,7 +577,8 @@ private:
         std::array<std::uint64_t, 64> hist;
         hist.fill(0);
         progress p{std::cout};
-        visit(path,
+        rate_limiter r{rate(vm)};
+        visit<rate_limited_file<native_file>>(path,
             [&](void const*, std::size_t,
                 void const*, std::size_t data_size,
                 error_code& ec)
@@ -486,7 +586,7 @@ private:
                 ++n;
                 ++hist[log2(data_size)];
                 //std::this_thread::sleep_for(std::chrono::milliseconds{1});
-            }, p, ec);
+            }, p, ec, r);
         if(! ec)
             std::cout <<
                 "value_count      " << fdec(n) << "\n" <<
@@ -498,6 +598,31 @@ private:
         }
         return EXIT_SUCCESS;
     }
+
+    int
+    do_warm(boost::program_options::variables_map const& vm)
+    {
+        if(! vm.count("dat") && ! vm.count("key") && ! vm.count("log"))
+            return error("No files specified");
+        for(char const* name : {"dat", "key", "log"})
+        {
+            if(! vm.count(name))
+                continue;
+            auto const path = vm[name].as<std::string>();
+            auto const bufferSize = vm.count("buffer") ?
+                vm["buffer"].as<std::size_t>() :
+                    1024 * block_size(path);
+            error_code ec;
+            progress p{std::cout};
+            warm<native_file>(path, bufferSize, p, ec);
+            if(ec)
+            {
+                std::cerr << "warm: " << path << ": " << ec.message() << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
 };
 
 } // nudb